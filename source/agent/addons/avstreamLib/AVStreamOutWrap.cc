@@ -62,6 +62,8 @@ void AVStreamOutWrap::New(const v8::FunctionCallbackInfo<v8::Value>& args)
     //     video_resolution: (required when require_video === true, string),
     //     url: (required, string),
     //     interval: (required, only for 'file')
+    //     maxQueueBytes: (optional, number, 0 for no limit)
+    //     maxQueueMs: (optional, number, 0 for no limit)
     // }
     Local<Object> options = args[0]->ToObject();
     bool requireAudio = (*options->Get(String::NewFromUtf8(isolate, "require_audio"))->ToBoolean())->BooleanValue();
@@ -118,6 +120,13 @@ void AVStreamOutWrap::New(const v8::FunctionCallbackInfo<v8::Value>& args)
     }
     obj->dest = obj->me;
 
+    Local<Value> maxQueueBytes = options->Get(String::NewFromUtf8(isolate, "maxQueueBytes"));
+    Local<Value> maxQueueMs = options->Get(String::NewFromUtf8(isolate, "maxQueueMs"));
+    if (maxQueueBytes->IsNumber() || maxQueueMs->IsNumber()) {
+        obj->me->setQueueLimits(maxQueueBytes->IsNumber() ? maxQueueBytes->IntegerValue() : 0,
+                maxQueueMs->IsNumber() ? maxQueueMs->IntegerValue() : 0);
+    }
+
     if (args.Length() > 1 && args[1]->IsFunction())
         Local<Object>::New(isolate, obj->m_store)->Set(String::NewFromUtf8(isolate, "init"), args[1]);
 
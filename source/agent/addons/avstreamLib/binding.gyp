@@ -33,5 +33,67 @@
         'cflags_cc!': ['-fno-exceptions']
       }],
     ]
-  }]
+  },
+# not build test target
+#  {
+#    'target_name': 'NaluScannerTest',
+#    'type' : 'executable',
+#    'sources': [
+#      '../../../core/owt_base/NaluScannerTest.cpp',
+#    ],
+#    'include_dirs': [
+#      '$(CORE_HOME)/common',
+#      '$(CORE_HOME)/owt_base',
+#    ],
+#    'cflags_cc':  ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11'],
+#  },
+#  {
+#    'target_name': 'NaluScannerTestAVX2',
+#    'type' : 'executable',
+#    'sources': [
+#      '../../../core/owt_base/NaluScannerTest.cpp',
+#    ],
+#    'include_dirs': [
+#      '$(CORE_HOME)/common',
+#      '$(CORE_HOME)/owt_base',
+#    ],
+#    'cflags_cc':  ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11', '-mavx2'],
+#  },
+#  {
+#    'target_name': 'NaluScannerTestScalar',
+#    'type' : 'executable',
+#    'sources': [
+#      '../../../core/owt_base/NaluScannerTest.cpp',
+#    ],
+#    'include_dirs': [
+#      '$(CORE_HOME)/common',
+#      '$(CORE_HOME)/owt_base',
+#    ],
+#    'cflags_cc':  ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11', '-mno-sse2'],
+#  },
+#  {
+#    'target_name': 'NaluScannerBenchmark',
+#    'type' : 'executable',
+#    'sources': [
+#      '../../../core/owt_base/NaluScannerBenchmark.cpp',
+#    ],
+#    'include_dirs': [
+#      '$(CORE_HOME)/common',
+#      '$(CORE_HOME)/owt_base',
+#    ],
+#    'cflags_cc':  ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11'],
+#  },
+#  {
+#    'target_name': 'NaluScannerBenchmarkAVX2',
+#    'type' : 'executable',
+#    'sources': [
+#      '../../../core/owt_base/NaluScannerBenchmark.cpp',
+#    ],
+#    'include_dirs': [
+#      '$(CORE_HOME)/common',
+#      '$(CORE_HOME)/owt_base',
+#    ],
+#    'cflags_cc':  ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11', '-mavx2'],
+#  }
+  ]
 }
@@ -22,6 +22,8 @@ void InternalOut::Init(v8::Local<v8::Object> exports) {
   tpl->InstanceTemplate()->SetInternalFieldCount(1);
   // Prototype
   NODE_SET_PROTOTYPE_METHOD(tpl, "close", close);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setQueueLimits", setQueueLimits);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getQueueStats", getQueueStats);
 
   constructor.Reset(isolate, tpl->GetFunction());
   exports->Set(String::NewFromUtf8(isolate, "Out"), tpl->GetFunction());
@@ -51,4 +53,42 @@ void InternalOut::close(const v8::FunctionCallbackInfo<v8::Value>& args) {
   InternalOut* obj = ObjectWrap::Unwrap<InternalOut>(args.Holder());
   owt_base::InternalOut* me = obj->me;
   delete me;
+  obj->me = NULL;
+  obj->dest = NULL;
+}
+
+void InternalOut::setQueueLimits(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+  InternalOut* obj = ObjectWrap::Unwrap<InternalOut>(args.Holder());
+  owt_base::InternalOut* me = obj->me;
+  if (!me)
+    return;
+
+  unsigned int maxBytes = args[0]->Uint32Value();
+  unsigned int maxDelayMs = args[1]->Uint32Value();
+  me->setSendQueueLimits(maxBytes, maxDelayMs);
+}
+
+// Returns {queuedMessages, queuedBytes, queuedDelayMs, maxQueuedBytes, droppedMessages, droppedBytes, keyFrameRequests}.
+void InternalOut::getQueueStats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+  InternalOut* obj = ObjectWrap::Unwrap<InternalOut>(args.Holder());
+  owt_base::InternalOut* me = obj->me;
+  if (!me)
+    return;
+
+  owt_base::TransportQueueStats stats = me->getSendQueueStats();
+
+  Local<Object> result = Object::New(isolate);
+  result->Set(String::NewFromUtf8(isolate, "queuedMessages"), Number::New(isolate, stats.queuedMessages));
+  result->Set(String::NewFromUtf8(isolate, "queuedBytes"), Number::New(isolate, stats.queuedBytes));
+  result->Set(String::NewFromUtf8(isolate, "queuedDelayMs"), Number::New(isolate, stats.queuedDelayMs));
+  result->Set(String::NewFromUtf8(isolate, "maxQueuedBytes"), Number::New(isolate, stats.maxQueuedBytes));
+  result->Set(String::NewFromUtf8(isolate, "droppedMessages"), Number::New(isolate, stats.droppedMessages));
+  result->Set(String::NewFromUtf8(isolate, "droppedBytes"), Number::New(isolate, stats.droppedBytes));
+  result->Set(String::NewFromUtf8(isolate, "keyFrameRequests"), Number::New(isolate, stats.keyFrameRequests));
+
+  args.GetReturnValue().Set(result);
 }
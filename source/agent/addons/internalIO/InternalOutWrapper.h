@@ -25,6 +25,9 @@ class InternalOut : public FrameDestination {
 
   static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void close(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  static void setQueueLimits(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void getQueueStats(const v8::FunctionCallbackInfo<v8::Value>& args);
 };
 
 #endif
@@ -6,15 +6,48 @@
 #include "InternalOutWrapper.h"
 #include "InternalIOWrapper.h"
 
+#include <IOScheduler.h>
 #include <node.h>
 
 using namespace v8;
 
+static Local<Object> toObject(Isolate* isolate, const owt_base::IOSchedulerStats& stats) {
+  Local<Object> result = Object::New(isolate);
+  result->Set(String::NewFromUtf8(isolate, "threads"), Number::New(isolate, stats.threads));
+  result->Set(String::NewFromUtf8(isolate, "pendingTasks"), Number::New(isolate, stats.pendingTasks));
+
+  Local<Array> strands = Array::New(isolate, stats.strands.size());
+  for (size_t i = 0; i < stats.strands.size(); ++i) {
+    Local<Object> strand = Object::New(isolate);
+    strand->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, stats.strands[i].name.c_str()));
+    strand->Set(String::NewFromUtf8(isolate, "pendingTasks"), Number::New(isolate, stats.strands[i].pendingTasks));
+    strand->Set(String::NewFromUtf8(isolate, "lastLatencyUs"), Number::New(isolate, stats.strands[i].lastLatencyUs));
+    strand->Set(String::NewFromUtf8(isolate, "maxLatencyUs"), Number::New(isolate, stats.strands[i].maxLatencyUs));
+    strands->Set(i, strand);
+  }
+  result->Set(String::NewFromUtf8(isolate, "strands"), strands);
+  return result;
+}
+
+// Reports the state of the process wide IOSchedulers, the one running the
+// internal transports and the one running the media processing under compute, e.g.
+// {threads: 8, pendingTasks: 0, strands: [{name, pendingTasks, lastLatencyUs, maxLatencyUs}], compute: {threads, pendingTasks, strands}}.
+void getIOSchedulerStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  Local<Object> result = toObject(isolate, owt_base::IOScheduler::instance().getStats());
+  result->Set(String::NewFromUtf8(isolate, "compute"), toObject(isolate, owt_base::IOScheduler::compute().getStats()));
+
+  args.GetReturnValue().Set(result);
+}
+
 void InitAll(Handle<Object> exports) {
   InternalIn::Init(exports);
   InternalOut::Init(exports);
   SctpIn::Init(exports);
   SctpOut::Init(exports);
+  NODE_SET_METHOD(exports, "getIOSchedulerStats", getIOSchedulerStats);
 }
 
 NODE_MODULE(addon, InitAll)
@@ -6,6 +6,7 @@
       'InternalInWrapper.cc',
       'InternalOutWrapper.cc',
       'InternalIOWrapper.cc',
+      '../../../core/owt_base/FrameFragmentation.cpp',
       '../../../core/owt_base/InternalIn.cpp',
       '../../../core/owt_base/InternalOut.cpp',
       '../../../core/owt_base/InternalSctp.cpp',
@@ -74,6 +75,25 @@
 #        'cflags_cc!': ['-fno-exceptions']
 #      }],
 #    ]
+#  },
+#  {
+#    'target_name': 'RawTransportBenchmark',
+#    'type' : 'executable',
+#    'sources': [
+#      '../../../core/owt_base/RawTransport.cpp',
+#      '../../../core/owt_base/RawTransportBenchmark.cpp',
+#    ],
+#    'include_dirs': [
+#      '$(CORE_HOME)/common',
+#      '$(CORE_HOME)/owt_base',
+#    ],
+#    'libraries': [
+#      '-lboost_system',
+#      '-lboost_thread',
+#      '-lboost_chrono',
+#      '-llog4cxx',
+#    ],
+#    'cflags_cc':  ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11'],
 #  }
   ]
 }
@@ -55,6 +55,8 @@ void QuicIn::dFrame(char* buf) {
         case TDT_MEDIA_FRAME:
             frame = reinterpret_cast<Frame*>(buf + 1);
             frame->payload = reinterpret_cast<uint8_t*>(buf + 1 + sizeof(Frame));
+            frame->buffer = nullptr;
+            frame->padding = FRAME_BUFFER_PADDING;
             deliverFrame(*frame);
             // std::cout << "deliverFrame" << std::endl;
             break;
@@ -68,8 +70,9 @@ void QuicIn::onData(uint32_t session_id, uint32_t stream_id, char* buf, uint32_t
     if (!m_hasStream) {
         m_hasStream = true;
     }
-    if (m_receivedBytes + len >= m_bufferSize) {
-        m_bufferSize += (m_receivedBytes + len);
+    // Room for the padding after the last message.
+    if (m_receivedBytes + len + FRAME_BUFFER_PADDING >= m_bufferSize) {
+        m_bufferSize += (m_receivedBytes + len + FRAME_BUFFER_PADDING);
         std::cout << "new_bufferSize: " << m_bufferSize << std::endl;
         char* new_buffer = new char[m_bufferSize];
         memcpy(new_buffer, m_receiveData.buffer.get(), m_receivedBytes);
@@ -88,7 +91,14 @@ void QuicIn::onData(uint32_t session_id, uint32_t stream_id, char* buf, uint32_t
             // std::cout << "receive: " << expectedLen << std::endl;
             m_receivedBytes -= expectedLen;
             char* dpos = m_receiveData.buffer.get() + 4;
+            // The next message may follow, it's put back after the frame got
+            // delivered with the padding zeroed.
+            char* tail = dpos + payloadlen;
+            char saved[FRAME_BUFFER_PADDING];
+            memcpy(saved, tail, FRAME_BUFFER_PADDING);
+            memset(tail, 0, FRAME_BUFFER_PADDING);
             dFrame(dpos);
+            memcpy(tail, saved, FRAME_BUFFER_PADDING);
             if (m_receivedBytes > 0) {
                 std::cout << "not zero m_receiveBytes" << std::endl;
                 memcpy(m_receiveData.buffer.get(), m_receiveData.buffer.get() + expectedLen, m_receivedBytes);
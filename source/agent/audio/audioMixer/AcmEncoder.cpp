@@ -7,6 +7,8 @@
 
 #include "AudioTime.h"
 
+#include <boost/bind.hpp>
+
 namespace mcu {
 
 using namespace webrtc;
@@ -18,24 +20,18 @@ AcmEncoder::AcmEncoder(const FrameFormat format)
     : m_format(format)
     , m_rtpSampleRate(0)
     , m_valid(false)
-    , m_running(false)
-    , m_incomingFrameCount(0)
 {
     AudioCodingModule::Config config;
     m_audioCodingModule.reset(AudioCodingModule::Create(config));
 
-    m_frame.reset(new AudioFrame());
-    m_running = true;
-    m_thread = boost::thread(&AcmEncoder::encodeLoop, this);
+    m_encodeQueue.reset(new AudioEncodeQueue(boost::bind(&AcmEncoder::encodeFrame, this, _1)));
 }
 
 AcmEncoder::~AcmEncoder()
 {
     int ret;
 
-    m_running = false;
-    m_cond.notify_one();
-    m_thread.join();
+    m_encodeQueue->close();
 
     if (!m_valid)
         return;
@@ -100,50 +96,16 @@ bool AcmEncoder::addAudioFrame(const AudioFrame* audioFrame)
             audioFrame->timestamp_
             );
 
-    {
-        boost::mutex::scoped_lock lock(m_mutex);
-
-        m_frame->CopyFrom(*audioFrame);
-
-        if (m_incomingFrameCount > 1)
-            ELOG_DEBUG_T("Too many pending frames(%d)", m_incomingFrameCount);
-
-        if (m_incomingFrameCount == 3)
-            ELOG_WARN_T("Too many pending frames(%d)", m_incomingFrameCount);
-
-        m_incomingFrameCount++;
-        m_cond.notify_one();
-    }
-
+    m_encodeQueue->pushFrame(audioFrame, AudioTime::currentTime());
     return true;
 }
 
-void AcmEncoder::encodeLoop()
+void AcmEncoder::encodeFrame(const AudioFrame& audioFrame)
 {
-    while (true) {
-        boost::shared_ptr<AudioFrame> frame;
-
-        {
-            boost::mutex::scoped_lock lock(m_mutex);
-
-            while (m_running && m_incomingFrameCount == 0) {
-                m_cond.wait(lock);
-            }
-
-            if (!m_running)
-                break;
-
-            m_incomingFrameCount = 0;
-            frame = m_frame;
-        }
-
-        int ret = m_audioCodingModule->Add10MsData(*frame.get());
-        if (ret < 0) {
-            ELOG_ERROR_T("Fail to insert raw into acm");
-        }
+    int ret = m_audioCodingModule->Add10MsData(audioFrame);
+    if (ret < 0) {
+        ELOG_ERROR_T("Fail to insert raw into acm");
     }
-
-    ELOG_DEBUG_T("Thread exited!");
 }
 
 int32_t AcmEncoder::SendData(FrameType frame_type,
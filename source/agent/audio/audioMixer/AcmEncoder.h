@@ -7,7 +7,6 @@
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/thread.hpp>
 
 #include <webrtc/modules/audio_coding/include/audio_coding_module.h>
 
@@ -15,6 +14,7 @@
 
 #include "MediaFramePipeline.h"
 #include "AudioEncoder.h"
+#include "AudioEncodeQueue.h"
 
 namespace mcu {
 using namespace owt_base;
@@ -40,7 +40,8 @@ public:
             const RTPFragmentationHeader* fragmentation) override;
 
 protected:
-    void encodeLoop();
+    // Runs on the compute threads.
+    void encodeFrame(const AudioFrame& audioFrame);
 
 private:
     boost::shared_ptr<AudioCodingModule> m_audioCodingModule;
@@ -49,13 +50,7 @@ private:
 
     bool m_valid;
 
-    bool m_running;
-    boost::thread m_thread;
-    boost::mutex m_mutex;
-    boost::condition_variable m_cond;
-
-    uint32_t m_incomingFrameCount;
-    boost::shared_ptr<AudioFrame> m_frame;
+    boost::scoped_ptr<AudioEncodeQueue> m_encodeQueue;
 };
 
 } /* namespace mcu */
@@ -3,9 +3,79 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "AcmmFrameMixer.h"
+#include "OwtMixEngine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <IOScheduler.h>
 
 namespace mcu {
 
+/**
+ * The decoding of the inputs for one mixing tick, fanned out on the compute
+ * threads. The mixer thread and the helpers take the tasks by index, the
+ * mixer then waits for the ones still running elsewhere, so that a batch
+ * never waits on a compute thread busy with another mixer.
+ */
+class DecodeBatch {
+public:
+    DecodeBatch(const std::vector<boost::function<void()>>& tasks)
+        : m_tasks(tasks)
+        , m_size(tasks.size())
+        , m_next(0)
+        , m_done(0)
+    {
+    }
+
+    static void run(const std::vector<boost::function<void()>>& tasks)
+    {
+        boost::shared_ptr<DecodeBatch> batch(new DecodeBatch(tasks));
+        owt_base::IOScheduler& compute = owt_base::IOScheduler::compute();
+
+        size_t helpers = std::min<size_t>(tasks.size(), compute.threads()) - 1;
+        for (size_t i = 0; i < helpers; i++)
+            compute.ioService().post(boost::bind(&DecodeBatch::runTasks, batch));
+
+        batch->runTasks();
+        batch->wait();
+    }
+
+private:
+    // A helper posted after the tasks are all taken finds none left, the
+    // tasks are not touched after the batch is done.
+    void runTasks()
+    {
+        size_t index;
+        while ((index = m_next++) < m_size) {
+            m_tasks[index]();
+            if (++m_done == m_size) {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_doneCond.notify_one();
+            }
+        }
+    }
+
+    void wait()
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        while (m_done < m_size)
+            m_doneCond.wait(lock);
+    }
+
+    const std::vector<boost::function<void()>>& m_tasks;
+    const size_t m_size;
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_done;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_doneCond;
+};
+
 static inline AudioConferenceMixer::Frequency convert2Frequency(int32_t freq)
 {
     switch (freq) {
@@ -28,24 +98,33 @@ static inline AudioConferenceMixer::Frequency convert2Frequency(int32_t freq)
 
 DEFINE_LOGGER(AcmmFrameMixer, "mcu.media.AcmmFrameMixer");
 
-AcmmFrameMixer::AcmmFrameMixer()
+AcmmFrameMixer::AcmmFrameMixer(bool owtMixEngine, uint32_t maxMixedSpeakers)
     : m_asyncHandle(NULL)
     , m_vadEnabled(false)
+    , m_mixTicks(0)
     , m_frequency(0)
+    , m_reportedOverruns(0)
 {
-    m_mixerModule.reset(AudioConferenceMixer::Create(0));
-    m_mixerModule->RegisterMixedStreamCallback(this);
-    m_mixerModule->SetMultipleInputs(true);
-
-    m_groupIds.resize(MAX_GROUPS + 1);
-    for (size_t i = 1; i < MAX_GROUPS + 1; ++i)
-        m_groupIds[i] = true;
-
-    //reserved for broadcast group
-    m_groupIds[0] = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    if (owtMixEngine)
+        m_mixEngine.reset(new OwtMixEngine(maxMixedSpeakers));
+    else
+        m_mixEngine.reset(new AcmmMixEngine());
+    m_mixEngine->RegisterMixedStreamCallback(this);
+
+    m_groups.resize(MAX_GROUPS + 1);
+    m_groupListIndex.resize(MAX_GROUPS + 1);
+    m_uniqueMixTicks.resize(MAX_GROUPS + 1);
+    m_groupList.reserve(MAX_GROUPS);
+
+    //0 reserved for broadcast group, the lowest ids are taken first
+    m_freeGroupIds.reserve(MAX_GROUPS);
+    for (int32_t i = MAX_GROUPS; i > 0; --i)
+        m_freeGroupIds.push_back(i);
     m_broadcastGroup.reset(new AcmmBroadcastGroup());
 
-    m_jobTimer.reset(new JobTimer(MIXER_FREQUENCY, this));
+    m_jobTimer.reset(new JobTimer(MIXER_FREQUENCY, this, owt_base::IOScheduler::compute()));
 }
 
 AcmmFrameMixer::~AcmmFrameMixer()
@@ -54,38 +133,33 @@ AcmmFrameMixer::~AcmmFrameMixer()
 
     boost::unique_lock<boost::shared_mutex> lock(m_mutex);
 
-    m_mixerModule->UnRegisterMixedStreamCallback();
+    m_mixEngine->UnRegisterMixedStreamCallback();
 
     if (m_vadEnabled) {
-        m_mixerModule->UnRegisterMixerVadCallback();
+        m_mixEngine->UnRegisterMixerVadCallback();
         m_vadEnabled = false;
     }
 }
 
 bool AcmmFrameMixer::getFreeGroupId(uint16_t *id)
 {
-    for (size_t i = 0; i < m_groupIds.size(); ++i) {
-        if (m_groupIds[i]) {
-            m_groupIds[i] = false;
-
-            *id = i;
-            return true;
-        }
+    if (m_freeGroupIds.empty()) {
+        ELOG_WARN("No free Id, max groups reached(%d)!", MAX_GROUPS);
+        return false;
     }
 
-    ELOG_WARN("No free Id, max groups reached(%d)!", MAX_GROUPS);
-    return false;
+    *id = m_freeGroupIds.back();
+    m_freeGroupIds.pop_back();
+    return true;
 }
 
 boost::shared_ptr<AcmmGroup> AcmmFrameMixer::getGroup(const std::string& group)
 {
-    if (m_groupIdMap.find(group) == m_groupIdMap.end())
-        return NULL;
-
-    if (m_groups.find(m_groupIdMap[group]) == m_groups.end())
+    auto it = m_groupIdMap.find(group);
+    if (it == m_groupIdMap.end())
         return NULL;
 
-    return m_groups[m_groupIdMap[group]];
+    return m_groups[it->second];
 }
 
 boost::shared_ptr<AcmmGroup> AcmmFrameMixer::addGroup(const std::string& group)
@@ -94,9 +168,12 @@ boost::shared_ptr<AcmmGroup> AcmmFrameMixer::addGroup(const std::string& group)
     boost::shared_ptr<AcmmGroup> acmmGroup;
 
     if (getFreeGroupId(&id)) {
-        m_groupIdMap[group] = id;
         acmmGroup.reset(new AcmmGroup(id));
-        m_groups[m_groupIdMap[group]] = acmmGroup;
+        m_groupIdMap[group] = id;
+        m_groups[id] = acmmGroup;
+        m_groupListIndex[id] = m_groupList.size();
+        m_groupList.push_back(acmmGroup);
+        m_uniqueMixTicks[id] = 0;
     }
 
     return acmmGroup;
@@ -104,9 +181,19 @@ boost::shared_ptr<AcmmGroup> AcmmFrameMixer::addGroup(const std::string& group)
 
 void AcmmFrameMixer::removeGroup(const std::string& group)
 {
-    m_groups.erase(m_groupIdMap[group]);
-    m_groupIds[m_groupIdMap[group]] = true;
-    m_groupIdMap.erase(group);
+    auto it = m_groupIdMap.find(group);
+    if (it == m_groupIdMap.end())
+        return;
+
+    uint16_t id = it->second;
+    uint32_t index = m_groupListIndex[id];
+    m_groupList[index] = m_groupList.back();
+    m_groupListIndex[m_groupList[index]->id()] = index;
+    m_groupList.pop_back();
+
+    m_groups[id].reset();
+    m_freeGroupIds.push_back(id);
+    m_groupIdMap.erase(it);
 }
 
 void AcmmFrameMixer::setEventRegistry(EventRegistry* handle)
@@ -124,7 +211,7 @@ void AcmmFrameMixer::enableVAD(uint32_t period)
 
     m_vadEnabled = true;
     m_mostActiveInput.reset();
-    m_mixerModule->RegisterMixerVadCallback(this, period / 10);
+    m_mixEngine->RegisterMixerVadCallback(this, period / 10);
 }
 
 void AcmmFrameMixer::disableVAD()
@@ -134,7 +221,7 @@ void AcmmFrameMixer::disableVAD()
 
     m_vadEnabled = false;
     m_mostActiveInput.reset();
-    m_mixerModule->UnRegisterMixerVadCallback();
+    m_mixEngine->UnRegisterMixerVadCallback();
 }
 
 void AcmmFrameMixer::resetVAD()
@@ -184,14 +271,14 @@ bool AcmmFrameMixer::addInput(const std::string& group, const std::string& inStr
             return false;
         }
 
-        ret = m_mixerModule->SetMixabilityStatus(acmmInput.get(), true);
+        ret = m_mixEngine->SetMixabilityStatus(acmmInput.get(), true);
         if (ret != 0) {
             ELOG_ERROR("Fail to SetMixabilityStatus");
             return false;
         }
 
         if (!acmmGroup->numOfOutputs()) {
-            ret = m_mixerModule->SetAnonymousMixabilityStatus(acmmInput.get(), true);
+            ret = m_mixEngine->SetAnonymousMixabilityStatus(acmmInput.get(), true);
             if (ret != 0) {
                 ELOG_ERROR("Fail to SetAnonymousMixabilityStatus");
                 return false;
@@ -199,18 +286,13 @@ bool AcmmFrameMixer::addInput(const std::string& group, const std::string& inStr
         }
 
         if (!acmmGroup->anyOutputsConnected()) {
-            std::vector<boost::shared_ptr<AcmmOutput>> outputs;
-            acmmGroup->getOutputs(outputs);
-            for(auto& o : outputs) {
-                m_broadcastGroup->removeDest(m_outputInfoMap[o.get()].dest);
-                if (!o->addDest(m_outputInfoMap[o.get()].format, m_outputInfoMap[o.get()].dest)) {
-                    ELOG_ERROR("Fail to reconnect dest");
-                    return false;
-                }
-            }
+            if (!connectOwnOutputs(acmmGroup))
+                return false;
         }
     }
 
+    updateDecodeTasks();
+
     statistics();
     return true;
 }
@@ -236,24 +318,18 @@ void AcmmFrameMixer::removeInput(const std::string& group, const std::string& in
         return;
     }
 
-    ret = m_mixerModule->SetMixabilityStatus(acmmInput.get(), false);
+    ret = m_mixEngine->SetMixabilityStatus(acmmInput.get(), false);
     if (ret != 0) {
         ELOG_ERROR("Fail to unSetMixabilityStatus");
         return;
     }
 
     acmmGroup->removeInput(inStream);
+    updateDecodeTasks();
 
     if (acmmGroup->allInputsMuted() && acmmGroup->anyOutputsConnected()) {
-        std::vector<boost::shared_ptr<AcmmOutput>> outputs;
-        acmmGroup->getOutputs(outputs);
-        for(auto& o : outputs) {
-            o->removeDest(m_outputInfoMap[o.get()].dest);
-            if (!m_broadcastGroup->addDest(m_outputInfoMap[o.get()].format, m_outputInfoMap[o.get()].dest)) {
-                ELOG_ERROR("Fail to reconnect broadcast dest");
-                return;
-            }
-        }
+        if (!connectBroadcastOutputs(acmmGroup))
+            return;
     }
 
     if (!acmmGroup->numOfInputs() && !acmmGroup->numOfOutputs()) {
@@ -296,25 +372,11 @@ void AcmmFrameMixer::setInputActive(const std::string& group, const std::string&
         return;
 
     if (acmmGroup->allInputsMuted() && acmmGroup->anyOutputsConnected()) {
-        std::vector<boost::shared_ptr<AcmmOutput>> outputs;
-        acmmGroup->getOutputs(outputs);
-        for(auto& o : outputs) {
-            o->removeDest(m_outputInfoMap[o.get()].dest);
-            if (!m_broadcastGroup->addDest(m_outputInfoMap[o.get()].format, m_outputInfoMap[o.get()].dest)) {
-                ELOG_ERROR("Fail to reconnect broadcast dest");
-                return;
-            }
-        }
+        if (!connectBroadcastOutputs(acmmGroup))
+            return;
     } else if (!acmmGroup->allInputsMuted() && !acmmGroup->anyOutputsConnected()) {
-        std::vector<boost::shared_ptr<AcmmOutput>> outputs;
-        acmmGroup->getOutputs(outputs);
-        for(auto& o : outputs) {
-            m_broadcastGroup->removeDest(m_outputInfoMap[o.get()].dest);
-            if (!o->addDest(m_outputInfoMap[o.get()].format, m_outputInfoMap[o.get()].dest)) {
-                ELOG_ERROR("Fail to reconnect dest");
-                return;
-            }
-        }
+        if (!connectOwnOutputs(acmmGroup))
+            return;
     }
 
     statistics();
@@ -344,7 +406,7 @@ bool AcmmFrameMixer::addOutput(const std::string& group, const std::string& outS
     if (acmmOutput) {
         ELOG_DEBUG("Update previous output");
 
-        if (acmmGroup->allInputsMuted()) {
+        if (!acmmOutput->hasDest()) {
             m_broadcastGroup->removeDest(m_outputInfoMap[acmmOutput.get()].dest);
             m_outputInfoMap.erase(acmmOutput.get());
 
@@ -377,14 +439,15 @@ bool AcmmFrameMixer::addOutput(const std::string& group, const std::string& outS
             std::vector<boost::shared_ptr<AcmmInput>> inputs;
             acmmGroup->getInputs(inputs);
             for(auto& i : inputs) {
-                ret = m_mixerModule->SetAnonymousMixabilityStatus(i.get(), false);
+                ret = m_mixEngine->SetAnonymousMixabilityStatus(i.get(), false);
                 if (ret != 0) {
                     ELOG_WARN("Fail to unSetAnonymousMixabilityStatus");
                 }
             }
         }
 
-        if (acmmGroup->allInputsMuted()) {
+        // Until the group speaks, it gets the general mix like the muted ones.
+        if (acmmGroup->allInputsMuted() || !acmmGroup->anyOutputsConnected()) {
             if (!m_broadcastGroup->addDest(format, destination)) {
                 ELOG_ERROR("Fail to add broadcast dest");
                 return false;
@@ -433,14 +496,14 @@ void AcmmFrameMixer::removeOutput(const std::string& group, const std::string& o
         std::vector<boost::shared_ptr<AcmmInput>> inputs;
         acmmGroup->getInputs(inputs);
         for(auto& i : inputs) {
-            ret = m_mixerModule->SetAnonymousMixabilityStatus(i.get(), true);
+            ret = m_mixEngine->SetAnonymousMixabilityStatus(i.get(), true);
             if (ret != 0) {
                 ELOG_WARN("Fail to unSetAnonymousMixabilityStatus");
             }
         }
     }
 
-    if (acmmGroup->allInputsMuted()) {
+    if (!acmmOutput->hasDest()) {
         m_broadcastGroup->removeDest(m_outputInfoMap[acmmOutput.get()].dest);
     } else {
         acmmOutput->removeDest(m_outputInfoMap[acmmOutput.get()].dest);
@@ -464,14 +527,14 @@ void AcmmFrameMixer::updateFrequency()
     int32_t freq;
     int ret;
 
-    for (auto& g : m_groups) {
-        freq = g.second->NeededFrequency();
+    for (auto& g : m_groupList) {
+        freq = g->NeededFrequency();
         if (freq > maxFreq)
             maxFreq= freq;
     }
 
     if (m_frequency != maxFreq) {
-        ret = m_mixerModule->SetMinimumMixingFrequency(convert2Frequency(maxFreq));
+        ret = m_mixEngine->SetMinimumMixingFrequency(convert2Frequency(maxFreq));
         if (ret != 0) {
             ELOG_WARN("Fail to SetMinimumMixingFrequency, %d", maxFreq);
             return;
@@ -484,6 +547,65 @@ void AcmmFrameMixer::updateFrequency()
     return;
 }
 
+// The destinations of the outputs of a group are either on the own encoders
+// of the group, or on the ones of the broadcast group encoding the general
+// mix once per format for all the groups getting it.
+bool AcmmFrameMixer::connectOwnOutputs(boost::shared_ptr<AcmmGroup> acmmGroup)
+{
+    std::vector<boost::shared_ptr<AcmmOutput>> outputs;
+    acmmGroup->getOutputs(outputs);
+    for(auto& o : outputs) {
+        auto it = m_outputInfoMap.find(o.get());
+        if (o->hasDest() || it == m_outputInfoMap.end())
+            continue;
+
+        m_broadcastGroup->removeDest(it->second.dest);
+        if (!o->addDest(it->second.format, it->second.dest)) {
+            ELOG_ERROR("Fail to reconnect dest");
+            // Back to the general mix rather than no audio at all.
+            if (!m_broadcastGroup->addDest(it->second.format, it->second.dest))
+                ELOG_ERROR("Fail to restore broadcast dest(%p)", it->second.dest);
+            return false;
+        }
+    }
+
+    acmmGroup->resetGeneralMixTicks();
+    return true;
+}
+
+bool AcmmFrameMixer::connectBroadcastOutputs(boost::shared_ptr<AcmmGroup> acmmGroup)
+{
+    std::vector<boost::shared_ptr<AcmmOutput>> outputs;
+    acmmGroup->getOutputs(outputs);
+    for(auto& o : outputs) {
+        auto it = m_outputInfoMap.find(o.get());
+        if (!o->hasDest() || it == m_outputInfoMap.end())
+            continue;
+
+        o->removeDest(it->second.dest);
+        if (!m_broadcastGroup->addDest(it->second.format, it->second.dest)) {
+            ELOG_ERROR("Fail to reconnect broadcast dest");
+            if (!o->addDest(it->second.format, it->second.dest))
+                ELOG_ERROR("Fail to restore dest(%p)", it->second.dest);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void AcmmFrameMixer::updateDecodeTasks()
+{
+    m_decodeTasks.clear();
+    for (auto& g : m_groupList) {
+        std::vector<boost::shared_ptr<AcmmInput>> inputs;
+        g->getInputs(inputs);
+        // The inputs are held by the groups and only removed with the lock taken.
+        for (auto& i : inputs)
+            m_decodeTasks.push_back(boost::bind(&AcmmInput::prepareAudioFrame, i.get()));
+    }
+}
+
 void AcmmFrameMixer::onTimeout()
 {
     performMix();
@@ -492,7 +614,57 @@ void AcmmFrameMixer::onTimeout()
 void AcmmFrameMixer::performMix()
 {
     boost::upgrade_lock<boost::shared_mutex> lock(m_mutex);
-    m_mixerModule->Process();
+
+    auto start = std::chrono::steady_clock::now();
+    // Decode the 10ms of all the inputs at once, the mixer then just picks them.
+    if (m_decodeTasks.size() >= MIN_PARALLEL_DECODES) {
+        DecodeBatch::run(m_decodeTasks);
+    } else {
+        for (auto& task : m_decodeTasks)
+            task();
+    }
+    auto decoded = std::chrono::steady_clock::now();
+
+    m_mixEngine->Process();
+
+    auto end = std::chrono::steady_clock::now();
+    updateTickStats(std::chrono::duration_cast<std::chrono::microseconds>(decoded - start).count(),
+            std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
+void AcmmFrameMixer::updateTickStats(uint32_t decodeUs, uint32_t tickUs)
+{
+    boost::unique_lock<boost::mutex> lock(m_statsMutex);
+
+    m_stats.ticks++;
+    if (tickUs > 1000000 / MIXER_FREQUENCY)
+        m_stats.overruns++;
+    m_stats.lastTickUs = tickUs;
+    if (tickUs > m_stats.maxTickUs)
+        m_stats.maxTickUs = tickUs;
+    m_stats.lastDecodeUs = decodeUs;
+    if (decodeUs > m_stats.maxDecodeUs)
+        m_stats.maxDecodeUs = decodeUs;
+
+    if (m_stats.ticks % STATS_REPORT_TICKS == 0 && m_stats.overruns != m_reportedOverruns) {
+        ELOG_WARN("%lu of %u mixing ticks overran, inputs(%lu), last tick(%u us), decode(%u us)"
+                , m_stats.overruns - m_reportedOverruns
+                , STATS_REPORT_TICKS
+                , m_decodeTasks.size()
+                , tickUs
+                , decodeUs
+                );
+        m_reportedOverruns = m_stats.overruns;
+    }
+}
+
+void AcmmFrameMixer::getStats(AudioFrameMixerStats& stats)
+{
+    boost::unique_lock<boost::mutex> lock(m_statsMutex);
+
+    stats = m_stats;
+    m_stats.maxTickUs = 0;
+    m_stats.maxDecodeUs = 0;
 }
 
 void AcmmFrameMixer::NewMixedAudio(int32_t id,
@@ -500,7 +672,7 @@ void AcmmFrameMixer::NewMixedAudio(int32_t id,
         const AudioFrame** uniqueAudioFrames,
         uint32_t size)
 {
-    std::map<uint16_t, bool> groupMap;
+    m_mixTicks++;
     for(uint32_t i = 0; i< size; i++) {
         uint16_t groupId = (uniqueAudioFrames[i]->id_ >> 16) & 0xffff;
 
@@ -508,23 +680,31 @@ void AcmmFrameMixer::NewMixedAudio(int32_t id,
                 , uniqueAudioFrames[i]->id_
                 , groupId);
 
-        if (m_groups.find(groupId) != m_groups.end()) {
-            boost::shared_ptr<AcmmGroup> acmmGroup = m_groups[groupId];
+        if (groupId < m_groups.size() && m_groups[groupId]) {
+            const boost::shared_ptr<AcmmGroup>& acmmGroup = m_groups[groupId];
             if (acmmGroup->numOfInputs()) {
                 if (acmmGroup->numOfOutputs()) {
+                    // A speaker must not hear itself in the general mix.
+                    if (!acmmGroup->anyOutputsConnected() && !connectOwnOutputs(acmmGroup))
+                        ELOG_WARN("Group(%u) left in the general mix", groupId);
+                    acmmGroup->resetGeneralMixTicks();
                     acmmGroup->NewMixedAudio(uniqueAudioFrames[i]);
                 }
 
-                groupMap[groupId] = true;
+                m_uniqueMixTicks[groupId] = m_mixTicks;
             }
         }
     }
 
-    for (auto& p : m_groups) {
-        boost::shared_ptr<AcmmGroup> acmmGroup = p.second;
-        if (groupMap.find(acmmGroup->id()) == groupMap.end()) {
-            if (acmmGroup->numOfOutputs()) {
-                acmmGroup->NewMixedAudio(&generalAudioFrame);
+    for (auto& acmmGroup : m_groupList) {
+        if (m_uniqueMixTicks[acmmGroup->id()] != m_mixTicks) {
+            if (acmmGroup->numOfOutputs() && acmmGroup->anyOutputsConnected()) {
+                // The same frames as the broadcast group, share its encoders
+                // unless the group is likely to speak again soon. The outputs
+                // still connected if that fails get the general mix from here.
+                if (acmmGroup->onGeneralMix() < SHARED_MIX_DELAY_TICKS
+                        || !connectBroadcastOutputs(acmmGroup))
+                    acmmGroup->NewMixedAudio(&generalAudioFrame);
             }
         }
     }
@@ -537,7 +717,7 @@ boost::shared_ptr<AcmmInput> AcmmFrameMixer::getInputById(int32_t id)
     uint16_t groupId = (id >> 16) & 0xffff;
     uint16_t streamId = id & 0xffff;
 
-    if (m_groups.find(groupId) != m_groups.end())
+    if (groupId < m_groups.size() && m_groups[groupId])
         return m_groups[groupId]->getInput(streamId);
 
     return NULL;
@@ -586,16 +766,17 @@ void AcmmFrameMixer::VadParticipants(const ParticipantVadStatistics *statistics,
 void AcmmFrameMixer::statistics()
 {
     uint32_t activeCount = 0;
+    uint32_t sharedCount = 0;
     uint32_t mutedCount = 0;
     uint32_t receivedOnlyCount = 0;
     uint32_t streamInCount = 0;
     uint32_t unknownCount = 0;
 
-    for (auto& p : m_groups) {
-        boost::shared_ptr<AcmmGroup> acmmGroup = p.second;
-
+    for (auto& acmmGroup : m_groupList) {
         if(!acmmGroup->allInputsMuted() && acmmGroup->anyOutputsConnected())
             activeCount++;
+        else if(!acmmGroup->allInputsMuted() && acmmGroup->numOfOutputs())
+            sharedCount++;
         else if(acmmGroup->numOfInputs() && acmmGroup->allInputsMuted() && acmmGroup->numOfOutputs())
             mutedCount++;
         else if(acmmGroup->numOfInputs() && acmmGroup->numOfOutputs() == 0)
@@ -606,9 +787,10 @@ void AcmmFrameMixer::statistics()
             unknownCount++;
     }
 
-    ELOG_DEBUG("All(%ld), Active(%d), Muted(%d), ReceivedOnly(%d), StreamIn(%d), Unknown(%d)"
-            , m_groups.size()
+    ELOG_DEBUG("All(%ld), Active(%d), Shared(%d), Muted(%d), ReceivedOnly(%d), StreamIn(%d), Unknown(%d)"
+            , m_groupList.size()
             , activeCount
+            , sharedCount
             , mutedCount
             , receivedOnlyCount
             , streamInCount
@@ -5,6 +5,9 @@
 #ifndef AcmmFrameMixer_h
 #define AcmmFrameMixer_h
 
+#include <unordered_map>
+
+#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <logger.h>
@@ -16,6 +19,7 @@
 
 #include "MediaFramePipeline.h"
 #include "AudioFrameMixer.h"
+#include "AudioMixEngine.h"
 
 #include "AcmmBroadcastGroup.h"
 #include "AcmmGroup.h"
@@ -32,6 +36,12 @@ class AcmmFrameMixer : public AudioFrameMixer,
 
     static const int32_t MAX_GROUPS = 10240;
     static const int32_t MIXER_FREQUENCY = 100;
+    // Below this many inputs, decoding them on the mixer thread is cheaper.
+    static const size_t MIN_PARALLEL_DECODES = 4;
+    static const uint32_t STATS_REPORT_TICKS = 1000;
+    // How long a group no longer speaking keeps encoding the general mix on
+    // its own before sharing the encoders of the broadcast group.
+    static const uint32_t SHARED_MIX_DELAY_TICKS = 100;
 
     struct OutputInfo {
         owt_base::FrameFormat format;
@@ -39,7 +49,9 @@ class AcmmFrameMixer : public AudioFrameMixer,
     };
 
 public:
-    AcmmFrameMixer();
+    // The speakers mixed can only be set for the owt mix engine, the webrtc
+    // module mixes 3 of them.
+    AcmmFrameMixer(bool owtMixEngine, uint32_t maxMixedSpeakers);
     virtual ~AcmmFrameMixer();
 
     // Implements AudioFrameMixer
@@ -57,6 +69,8 @@ public:
 
     void setEventRegistry(EventRegistry* handle) override;
 
+    void getStats(AudioFrameMixerStats& stats) override;
+
     // Implements JobTimerListener
     void onTimeout() override;
 
@@ -83,6 +97,11 @@ protected:
 
     void updateFrequency();
 
+    bool connectOwnOutputs(boost::shared_ptr<AcmmGroup> acmmGroup);
+    bool connectBroadcastOutputs(boost::shared_ptr<AcmmGroup> acmmGroup);
+    void updateDecodeTasks();
+    void updateTickStats(uint32_t decodeUs, uint32_t tickUs);
+
     boost::shared_ptr<AcmmInput> getInputById(int32_t id);
 
     void statistics();
@@ -90,19 +109,32 @@ protected:
 private:
     EventRegistry *m_asyncHandle;
     boost::scoped_ptr<JobTimer> m_jobTimer;
-    boost::shared_ptr<AudioConferenceMixer> m_mixerModule;
+    boost::shared_ptr<AudioMixEngine> m_mixEngine;
 
     std::map<AcmmOutput*, OutputInfo> m_outputInfoMap;
     boost::shared_ptr<AcmmBroadcastGroup> m_broadcastGroup;
 
-    std::vector<bool> m_groupIds;
-    std::map<std::string, uint16_t> m_groupIdMap;
-    std::map<uint16_t, boost::shared_ptr<AcmmGroup>> m_groups;
+    std::vector<uint16_t> m_freeGroupIds;
+    std::unordered_map<std::string, uint16_t> m_groupIdMap;
+    // Indexed by the group ids.
+    std::vector<boost::shared_ptr<AcmmGroup>> m_groups;
+    // The groups in use, to iterate over, and their position in it by id.
+    std::vector<boost::shared_ptr<AcmmGroup>> m_groupList;
+    std::vector<uint32_t> m_groupListIndex;
+    // The last tick each group got its own mix in, by id.
+    std::vector<uint64_t> m_uniqueMixTicks;
+    uint64_t m_mixTicks;
     boost::shared_mutex m_mutex;
 
     bool m_vadEnabled;
     boost::shared_ptr<AcmmInput> m_mostActiveInput;
     int32_t m_frequency;
+
+    std::vector<boost::function<void()>> m_decodeTasks;
+
+    boost::mutex m_statsMutex;
+    AudioFrameMixerStats m_stats;
+    uint64_t m_reportedOverruns;
 };
 
 } /* namespace mcu */
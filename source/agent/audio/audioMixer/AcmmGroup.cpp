@@ -13,6 +13,7 @@ DEFINE_LOGGER(AcmmGroup, "mcu.media.AcmmGroup");
 
 AcmmGroup::AcmmGroup(uint16_t id)
     : m_groupId(id)
+    , m_generalMixTicks(0)
 {
     ELOG_DEBUG_T("AcmmGroup(%u)", id);
 
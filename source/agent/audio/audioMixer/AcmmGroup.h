@@ -55,12 +55,17 @@ public:
     int32_t NeededFrequency();
     void NewMixedAudio(const AudioFrame* audioFrame);
 
+    // Counts the consecutive mixing ticks the group got the general mix for.
+    uint32_t onGeneralMix() {return ++m_generalMixTicks;}
+    void resetGeneralMixTicks() {m_generalMixTicks = 0;}
+
 protected:
     bool getFreeInputId(uint16_t *id);
     bool getFreeOutputId(uint16_t *id);
 
 private:
     uint16_t m_groupId;
+    uint32_t m_generalMixTicks;
 
     std::vector<bool> m_inputIds;
     std::map<std::string, uint16_t> m_inputIdMap;
@@ -20,6 +20,9 @@ AcmmInput::AcmmInput(int32_t id, const std::string &name)
     , m_active(true)
     , m_srcFormat(FRAME_FORMAT_UNKNOWN)
     , m_source(NULL)
+    , m_lastSampleRate(0)
+    , m_prepared(false)
+    , m_preparedValid(false)
 {
     ELOG_DEBUG_T("AcmmInput(0x%x)", id);
 }
@@ -78,11 +81,23 @@ void AcmmInput::unsetSource()
     m_source = NULL;
     m_srcFormat = FRAME_FORMAT_UNKNOWN;
     m_decoder.reset();
+    m_prepared = false;
 }
 
 void AcmmInput::setActive(bool active)
 {
     m_active = active;
+    m_prepared = false;
+}
+
+void AcmmInput::prepareAudioFrame()
+{
+    if (!m_active || !m_decoder || m_prepared || !m_lastSampleRate)
+        return;
+
+    m_preparedFrame.sample_rate_hz_ = m_lastSampleRate;
+    m_preparedValid = m_decoder->getAudioFrame(&m_preparedFrame);
+    m_prepared = true;
 }
 
 int32_t AcmmInput::GetAudioFrame(int32_t id, AudioFrame* audio_frame)
@@ -90,7 +105,20 @@ int32_t AcmmInput::GetAudioFrame(int32_t id, AudioFrame* audio_frame)
     if (!m_active)
         return -1;
 
-    if (!m_decoder || !m_decoder->getAudioFrame(audio_frame)) {
+    bool valid;
+    if (m_prepared && m_preparedFrame.sample_rate_hz_ == audio_frame->sample_rate_hz_) {
+        valid = m_preparedValid;
+        if (valid)
+            audio_frame->CopyFrom(m_preparedFrame);
+    } else {
+        // Not prepared, or the mixing frequency just changed and the 10ms
+        // prepared are dropped.
+        valid = m_decoder && m_decoder->getAudioFrame(audio_frame);
+    }
+    m_prepared = false;
+    m_lastSampleRate = audio_frame->sample_rate_hz_;
+
+    if (!valid) {
         ELOG_DEBUG_T("Error GetAudioFrame");
         return -1;
     }
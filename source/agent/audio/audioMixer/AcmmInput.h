@@ -38,6 +38,10 @@ public:
 
     void setActive(bool active);
 
+    // Decodes the next 10ms ahead of the mixer asking for it, so that the
+    // inputs can be decoded in parallel. Runs on the compute threads.
+    void prepareAudioFrame();
+
     // Implements MixerParticipant
     int32_t GetAudioFrame(int32_t id, AudioFrame* audioFrame) override;
     int32_t NeededFrequency(int32_t id) const override;
@@ -52,6 +56,12 @@ private:
     FrameSource *m_source;
 
     boost::shared_ptr<AudioDecoder> m_decoder;
+
+    // The mixing frequency last asked for, the frame is prepared at this rate.
+    int m_lastSampleRate;
+    bool m_prepared;
+    bool m_preparedValid;
+    AudioFrame m_preparedFrame;
 };
 
 } /* namespace mcu */
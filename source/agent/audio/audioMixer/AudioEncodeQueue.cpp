@@ -0,0 +1,93 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "AudioEncodeQueue.h"
+
+#include <boost/bind.hpp>
+
+namespace mcu {
+
+using namespace webrtc;
+
+DEFINE_LOGGER(AudioEncodeQueue, "mcu.media.AudioEncodeQueue");
+
+AudioEncodeQueue::AudioEncodeQueue(const EncodeFunc& encode)
+    : m_encode(encode)
+    , m_scheduled(false)
+    , m_closed(false)
+    , m_dropped(0)
+    , m_strand("AudioEncodeQueue", owt_base::IOScheduler::compute())
+{
+}
+
+AudioEncodeQueue::~AudioEncodeQueue()
+{
+    close();
+}
+
+void AudioEncodeQueue::close()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_closed = true;
+        m_frames.clear();
+    }
+    m_strand.drain();
+}
+
+void AudioEncodeQueue::pushFrame(const AudioFrame* frame, int64_t mixTimeMs)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    if (m_closed)
+        return;
+
+    PendingFrame pending;
+    if (m_frames.size() >= MAX_QUEUED_FRAMES) {
+        // Way behind, better to catch up than keep the latency.
+        pending.frame = m_frames.front().frame;
+        m_frames.pop_front();
+        if (m_dropped++ % 100 == 0)
+            ELOG_WARN("Encoder %p too slow, %u frames dropped", this, m_dropped);
+    } else if (!m_freeFrames.empty()) {
+        pending.frame = m_freeFrames.back();
+        m_freeFrames.pop_back();
+    } else {
+        pending.frame.reset(new AudioFrame());
+    }
+
+    pending.frame->CopyFrom(*frame);
+    pending.mixTimeMs = mixTimeMs;
+    m_frames.push_back(pending);
+
+    if (!m_scheduled) {
+        m_scheduled = true;
+        m_strand.post(boost::bind(&AudioEncodeQueue::encodeNext, this));
+    }
+}
+
+void AudioEncodeQueue::encodeNext()
+{
+    PendingFrame pending;
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        if (m_closed || m_frames.empty()) {
+            m_scheduled = false;
+            return;
+        }
+        pending = m_frames.front();
+        m_frames.pop_front();
+    }
+
+    m_encode(*pending.frame, pending.mixTimeMs);
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_freeFrames.push_back(pending.frame);
+    // One frame at a time, for the other queues to get their turn.
+    if (!m_frames.empty())
+        m_strand.post(boost::bind(&AudioEncodeQueue::encodeNext, this));
+    else
+        m_scheduled = false;
+}
+
+} /* namespace mcu */
@@ -0,0 +1,71 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef AudioEncodeQueue_h
+#define AudioEncodeQueue_h
+
+#include <deque>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <webrtc/modules/include/module_common_types.h>
+
+#include <logger.h>
+#include <IOScheduler.h>
+
+namespace mcu {
+
+/**
+ * The 10ms mixed frames of an audio encoder, encoded in order, one at a
+ * time, on the compute threads instead of a thread per encoder.
+ * The queues are served first come first served, a queue takes its turn on
+ * the compute threads once its first frame is pushed and gives the thread
+ * back after each frame, there is no deadline ordering.
+ */
+class AudioEncodeQueue {
+    DECLARE_LOGGER();
+
+    // Frames kept, the oldest are dropped beyond.
+    static const size_t MAX_QUEUED_FRAMES = 50;
+
+public:
+    // Gets the frame with the AudioTime it was mixed at.
+    typedef boost::function<void(const webrtc::AudioFrame&, int64_t mixTimeMs)> EncodeFunc;
+
+    AudioEncodeQueue(const EncodeFunc& encode);
+    ~AudioEncodeQueue();
+
+    // Drops the frames pending, returns once the queue is not encoding.
+    void close();
+
+    void pushFrame(const webrtc::AudioFrame* frame, int64_t mixTimeMs);
+
+private:
+    struct PendingFrame {
+        int64_t mixTimeMs;
+        boost::shared_ptr<webrtc::AudioFrame> frame;
+    };
+
+    void encodeNext();
+
+    EncodeFunc m_encode;
+
+    boost::mutex m_mutex;
+    std::deque<PendingFrame> m_frames;
+    // Of the frames encoded, to be reused.
+    std::vector<boost::shared_ptr<webrtc::AudioFrame>> m_freeFrames;
+    // An encodeNext() is posted.
+    bool m_scheduled;
+    bool m_closed;
+    uint32_t m_dropped;
+
+    owt_base::IOStrand m_strand;
+};
+
+} /* namespace mcu */
+
+#endif /* AudioEncodeQueue_h */
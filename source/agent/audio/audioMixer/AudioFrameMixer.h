@@ -11,6 +11,17 @@
 
 namespace mcu {
 
+struct AudioFrameMixerStats {
+    // Mixing ticks, and the ones taking longer than the 10ms period.
+    uint64_t ticks;
+    uint64_t overruns;
+    uint32_t lastTickUs;
+    uint32_t maxTickUs;
+    // Of the decoding of the inputs ahead of the mix.
+    uint32_t lastDecodeUs;
+    uint32_t maxDecodeUs;
+};
+
 class AudioFrameMixer {
 public:
     virtual ~AudioFrameMixer() {}
@@ -28,6 +39,9 @@ public:
     virtual void removeOutput(const std::string& group, const std::string& outStream) = 0;
 
     virtual void setEventRegistry(EventRegistry* handle) = 0;
+
+    // Resets the max durations.
+    virtual void getStats(AudioFrameMixerStats& stats) = 0;
 };
 
 } /* namespace mcu */
@@ -0,0 +1,97 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef AudioMixEngine_h
+#define AudioMixEngine_h
+
+#include <boost/shared_ptr.hpp>
+
+#include <webrtc/modules/audio_conference_mixer/include/audio_conference_mixer.h>
+#include <webrtc/modules/audio_conference_mixer/include/audio_conference_mixer_defines.h>
+
+namespace mcu {
+
+using namespace webrtc;
+
+/**
+ * Mixes the participants of AcmmFrameMixer, the subset of the webrtc
+ * AudioConferenceMixer interface it relies on, so that the webrtc module and
+ * the owt one are interchangeable. The calls are serialized by the owner.
+ */
+class AudioMixEngine {
+public:
+    virtual ~AudioMixEngine() {}
+
+    virtual int32_t RegisterMixedStreamCallback(AudioMixerOutputReceiver* receiver) = 0;
+    virtual int32_t UnRegisterMixedStreamCallback() = 0;
+
+    // The VAD statistics are reported every period of 10ms.
+    virtual void RegisterMixerVadCallback(AudioMixerVadReceiver* receiver, int period) = 0;
+    virtual void UnRegisterMixerVadCallback() = 0;
+
+    virtual int32_t SetMixabilityStatus(MixerParticipant* participant, bool mixable) = 0;
+    // Anonymous participants are always mixed and don't get their own mix.
+    virtual int32_t SetAnonymousMixabilityStatus(MixerParticipant* participant, bool anonymous) = 0;
+    virtual int32_t SetMinimumMixingFrequency(AudioConferenceMixer::Frequency freq) = 0;
+
+    // Mixes the next 10ms.
+    virtual void Process() = 0;
+};
+
+// The webrtc AudioConferenceMixer module.
+class AcmmMixEngine : public AudioMixEngine {
+public:
+    AcmmMixEngine()
+        : m_mixerModule(AudioConferenceMixer::Create(0))
+    {
+        m_mixerModule->SetMultipleInputs(true);
+    }
+
+    int32_t RegisterMixedStreamCallback(AudioMixerOutputReceiver* receiver) override
+    {
+        return m_mixerModule->RegisterMixedStreamCallback(receiver);
+    }
+
+    int32_t UnRegisterMixedStreamCallback() override
+    {
+        return m_mixerModule->UnRegisterMixedStreamCallback();
+    }
+
+    void RegisterMixerVadCallback(AudioMixerVadReceiver* receiver, int period) override
+    {
+        m_mixerModule->RegisterMixerVadCallback(receiver, period);
+    }
+
+    void UnRegisterMixerVadCallback() override
+    {
+        m_mixerModule->UnRegisterMixerVadCallback();
+    }
+
+    int32_t SetMixabilityStatus(MixerParticipant* participant, bool mixable) override
+    {
+        return m_mixerModule->SetMixabilityStatus(participant, mixable);
+    }
+
+    int32_t SetAnonymousMixabilityStatus(MixerParticipant* participant, bool anonymous) override
+    {
+        return m_mixerModule->SetAnonymousMixabilityStatus(participant, anonymous);
+    }
+
+    int32_t SetMinimumMixingFrequency(AudioConferenceMixer::Frequency freq) override
+    {
+        return m_mixerModule->SetMinimumMixingFrequency(freq);
+    }
+
+    void Process() override
+    {
+        m_mixerModule->Process();
+    }
+
+private:
+    boost::shared_ptr<AudioConferenceMixer> m_mixerModule;
+};
+
+} /* namespace mcu */
+
+#endif /* AudioMixEngine_h */
@@ -0,0 +1,153 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Measure the mixes per second of the owt and the webrtc mix engines with 10,
+// 100 and 1000 inputs
+//
+// Usage: AudioMixEngineBenchmark [seconds] [frequency] [speakers]
+//
+// Each input gives a frame of noise at every mix, at a level of its own that
+// changes every second of audio, so that the loudest speakers change as in a
+// conference. The mixes run back to back on one thread, where a mixer runs
+// one every 10ms, so the mixes/s over 100 is the number of such mixers a core
+// can run.
+
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AudioMixEngine.h"
+#include "OwtMixEngine.h"
+
+using namespace std;
+using namespace mcu;
+
+static const int kLevels = 16;
+static const int kTicksPerLevel = 100;
+
+class BenchmarkInput : public MixerParticipant {
+public:
+    BenchmarkInput(int32_t id, const vector<AudioFrame>& levels)
+        : m_id(id)
+        , m_levels(levels)
+        , m_ticks(0)
+    {
+    }
+
+    int32_t GetAudioFrame(int32_t id, AudioFrame* audioFrame) override
+    {
+        // A level picked from the input id and the time, the same for both engines.
+        uint32_t hash = (m_id * 2654435761u) ^ ((m_ticks++ / kTicksPerLevel) * 40503u);
+        const AudioFrame& level = m_levels[(hash >> 8) % kLevels];
+
+        audioFrame->id_ = m_id;
+        audioFrame->timestamp_ = level.timestamp_;
+        audioFrame->samples_per_channel_ = level.samples_per_channel_;
+        audioFrame->sample_rate_hz_ = level.sample_rate_hz_;
+        audioFrame->num_channels_ = level.num_channels_;
+        audioFrame->speech_type_ = AudioFrame::kNormalSpeech;
+        audioFrame->vad_activity_ = AudioFrame::kVadActive;
+        memcpy(audioFrame->data_, level.data_, level.samples_per_channel_ * level.num_channels_ * sizeof(int16_t));
+        return 0;
+    }
+
+    int32_t NeededFrequency(int32_t id) const override
+    {
+        return 0;
+    }
+
+private:
+    int32_t m_id;
+    const vector<AudioFrame>& m_levels;
+    uint32_t m_ticks;
+};
+
+class BenchmarkReceiver : public AudioMixerOutputReceiver, public AudioMixerVadReceiver {
+public:
+    BenchmarkReceiver() : m_mixes(0), m_uniqueFrames(0) {}
+
+    void NewMixedAudio(int32_t id, const AudioFrame& generalAudioFrame, const AudioFrame** uniqueAudioFrames, uint32_t size) override
+    {
+        m_mixes++;
+        m_uniqueFrames += size;
+    }
+
+    void VadParticipants(const ParticipantVadStatistics* statistics, const uint32_t size) override { }
+
+    uint64_t m_mixes;
+    uint64_t m_uniqueFrames;
+};
+
+static vector<AudioFrame> createLevels(int frequency)
+{
+    vector<AudioFrame> levels(kLevels);
+    uint32_t seed = 1;
+    for (int i = 0; i < kLevels; ++i) {
+        AudioFrame& frame = levels[i];
+        frame.samples_per_channel_ = frequency / 100;
+        frame.sample_rate_hz_ = frequency;
+        frame.num_channels_ = 1;
+        // From silence to loud, 3dB apart.
+        int32_t amplitude = i == 0 ? 0 : 16384 >> ((kLevels - i) / 2);
+        for (size_t j = 0; j < frame.samples_per_channel_; ++j) {
+            seed = seed * 1103515245 + 12345;
+            frame.data_[j] = amplitude ? (int32_t)((seed >> 16) % (2 * amplitude)) - amplitude : 0;
+        }
+    }
+    return levels;
+}
+
+static void runCase(const char* name, AudioMixEngine* engine, uint32_t inputCount, int frequency, double seconds)
+{
+    vector<AudioFrame> levels = createLevels(frequency);
+    vector<unique_ptr<BenchmarkInput>> inputs;
+    BenchmarkReceiver receiver;
+
+    engine->RegisterMixedStreamCallback(&receiver);
+    // AcmmFrameMixer's default VAD period of 100ms.
+    engine->RegisterMixerVadCallback(&receiver, 10);
+    engine->SetMinimumMixingFrequency((AudioConferenceMixer::Frequency)frequency);
+    for (uint32_t i = 0; i < inputCount; ++i) {
+        inputs.push_back(unique_ptr<BenchmarkInput>(new BenchmarkInput((i + 1) << 16, levels)));
+        engine->SetMixabilityStatus(inputs.back().get(), true);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        for (int i = 0; i < 16; ++i)
+            engine->Process();
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    for (auto& input : inputs)
+        engine->SetMixabilityStatus(input.get(), false);
+    engine->UnRegisterMixerVadCallback();
+    engine->UnRegisterMixedStreamCallback();
+
+    cout << name << ", " << inputCount << " inputs: " << receiver.m_mixes << " mixes in " << elapsed << "s, "
+         << (uint64_t)(receiver.m_mixes / elapsed) << " mixes/s, "
+         << (receiver.m_mixes ? (double)receiver.m_uniqueFrames / receiver.m_mixes : 0) << " unique frames per mix" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2;
+    int frequency = argc > 2 ? atoi(argv[2]) : 48000;
+    uint32_t speakers = argc > 3 ? atoi(argv[3]) : 3;
+
+    uint32_t inputCounts[] = {10, 100, 1000};
+    for (uint32_t inputCount : inputCounts) {
+        AcmmMixEngine webrtcEngine;
+        runCase("webrtc", &webrtcEngine, inputCount, frequency, seconds);
+
+        OwtMixEngine owtEngine(speakers);
+        runCase("owt", &owtEngine, inputCount, frequency, seconds);
+    }
+    cout << "finish benchmark" << endl;
+    return 0;
+}
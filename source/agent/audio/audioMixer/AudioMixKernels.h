@@ -0,0 +1,150 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef AudioMixKernels_h
+#define AudioMixKernels_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace mcu {
+
+// The mix of 16 bits samples is summed on 32 bits and saturated once at the
+// end, so that it doesn't depend on the order of the participants.
+
+static inline int16_t saturate16(int32_t sample)
+{
+    return sample > 32767 ? 32767 : (sample < -32768 ? -32768 : sample);
+}
+
+// acc[i] += src[i]
+inline void mixAccumulate(int32_t* acc, const int16_t* src, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 16 <= n; i += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1));
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(acc + i)), lo));
+        _mm256_storeu_si256((__m256i*)(acc + i + 8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(acc + i + 8)), hi));
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i)), lo));
+        _mm_storeu_si128((__m128i*)(acc + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i + 4)), hi));
+    }
+#endif
+    for (; i < n; i++)
+        acc[i] += src[i];
+}
+
+// dst[i] = saturate(acc[i] - src[i]), the mix without one participant.
+// Without src, dst[i] = saturate(acc[i]).
+inline void mixSaturate(int16_t* dst, const int32_t* acc, const int16_t* src, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(acc + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(acc + i + 8));
+        if (src) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            lo = _mm256_sub_epi32(lo, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)));
+            hi = _mm256_sub_epi32(hi, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)));
+        }
+        // packs works per 128 bits lane, put the quadwords back in order.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+        _mm256_storeu_si256((__m256i*)(dst + i), packed);
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(acc + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(acc + i + 4));
+        if (src) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            lo = _mm_sub_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            hi = _mm_sub_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = saturate16(src ? acc[i] - src[i] : acc[i]);
+}
+
+// The mean of the squared samples.
+inline uint32_t mixEnergy(const int16_t* src, size_t n)
+{
+    if (n == 0)
+        return 0;
+
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    // The pairs of squares fit in 32 bits unsigned.
+    __m256i zero = _mm256_setzero_si256();
+    __m256i sums = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i squares = _mm256_madd_epi16(s, s);
+        sums = _mm256_add_epi64(sums, _mm256_unpacklo_epi32(squares, zero));
+        sums = _mm256_add_epi64(sums, _mm256_unpackhi_epi32(squares, zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, sums);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i sums = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i squares = _mm_madd_epi16(s, s);
+        sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(squares, zero));
+        sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(squares, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, sums);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < n; i++)
+        sum += src[i] * src[i];
+    return sum / n;
+}
+
+// Fades the samples in from silence, or out to silence, in place, for a
+// participant to join or leave the mix without a click.
+inline void mixRamp(int16_t* samples, size_t samplesPerChannel, size_t channels, bool up)
+{
+    for (size_t i = 0; i < samplesPerChannel; i++) {
+        int32_t gain = up ? i : samplesPerChannel - i;
+        for (size_t c = 0; c < channels; c++) {
+            int16_t& sample = samples[i * channels + c];
+            sample = (int32_t)sample * gain / (int32_t)samplesPerChannel;
+        }
+    }
+}
+
+// Duplicates the mono samples into both channels, in place, the buffer must
+// hold twice as many.
+inline void mixMonoToStereo(int16_t* samples, size_t samplesPerChannel)
+{
+    for (size_t i = samplesPerChannel; i-- > 0;) {
+        samples[2 * i] = samples[i];
+        samples[2 * i + 1] = samples[i];
+    }
+}
+
+}
+
+#endif // AudioMixKernels_h
@@ -2,6 +2,11 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
 #include <webrtc/base/logging.h>
 #include <webrtc/system_wrappers/include/trace.h>
 
@@ -42,7 +47,23 @@ AudioMixer::AudioMixer(const std::string& configStr)
 
     AudioTime::setTimestampOffset(currentTimeMs());
 
-    m_mixer.reset(new AcmmFrameMixer());
+    std::string mixerEngine = "webrtc";
+    uint32_t mixedSpeakers = 3;
+    try {
+        boost::property_tree::ptree config;
+        std::istringstream is(configStr);
+        boost::property_tree::read_json(is, config);
+        mixerEngine = config.get<std::string>("mixerEngine", mixerEngine);
+        mixedSpeakers = config.get<uint32_t>("mixedSpeakers", mixedSpeakers);
+    } catch (std::exception& e) {
+        ELOG_WARN("Invalid config(%s), %s", configStr.c_str(), e.what());
+    }
+
+    if (mixedSpeakers < 1)
+        mixedSpeakers = 1;
+    ELOG_DEBUG("mixer engine(%s), mixed speakers(%u)", mixerEngine.c_str(), mixedSpeakers);
+
+    m_mixer.reset(new AcmmFrameMixer(mixerEngine == "owt", mixedSpeakers));
 }
 
 AudioMixer::~AudioMixer()
@@ -54,6 +75,11 @@ void AudioMixer::setEventRegistry(EventRegistry *handle)
     m_mixer->setEventRegistry(handle);
 }
 
+void AudioMixer::getStats(AudioFrameMixerStats& stats)
+{
+    m_mixer->getStats(stats);
+}
+
 void AudioMixer::enableVAD(uint32_t period)
 {
     m_mixer->enableVAD(period);
@@ -33,6 +33,8 @@ public:
 
     void setEventRegistry(EventRegistry* handle);
 
+    void getStats(AudioFrameMixerStats& stats);
+
 private:
     boost::shared_ptr<AudioFrameMixer> m_mixer;
 };
@@ -30,6 +30,7 @@ void AudioMixer::Init(Handle<Object> exports, Handle<Object> module) {
   NODE_SET_PROTOTYPE_METHOD(tpl, "setInputActive", setInputActive);
   NODE_SET_PROTOTYPE_METHOD(tpl, "addOutput", addOutput);
   NODE_SET_PROTOTYPE_METHOD(tpl, "removeOutput", removeOutput);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getStats", getStats);
 
   constructor.Reset(isolate, tpl->GetFunction());
   module->Set(String::NewFromUtf8(isolate, "exports"), tpl->GetFunction());
@@ -176,3 +177,25 @@ void AudioMixer::removeOutput(const v8::FunctionCallbackInfo<v8::Value>& args) {
 
   me->removeOutput(endpointID, streamID);
 }
+
+void AudioMixer::getStats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  AudioMixer* obj = ObjectWrap::Unwrap<AudioMixer>(args.Holder());
+  mcu::AudioMixer* me = obj->me;
+  if (me == nullptr)
+    return;
+
+  mcu::AudioFrameMixerStats stats;
+  me->getStats(stats);
+
+  Local<Object> result = Object::New(isolate);
+  result->Set(String::NewFromUtf8(isolate, "ticks"), Number::New(isolate, stats.ticks));
+  result->Set(String::NewFromUtf8(isolate, "overruns"), Number::New(isolate, stats.overruns));
+  result->Set(String::NewFromUtf8(isolate, "lastTickUs"), Number::New(isolate, stats.lastTickUs));
+  result->Set(String::NewFromUtf8(isolate, "maxTickUs"), Number::New(isolate, stats.maxTickUs));
+  result->Set(String::NewFromUtf8(isolate, "lastDecodeUs"), Number::New(isolate, stats.lastDecodeUs));
+  result->Set(String::NewFromUtf8(isolate, "maxDecodeUs"), Number::New(isolate, stats.maxDecodeUs));
+  args.GetReturnValue().Set(result);
+}
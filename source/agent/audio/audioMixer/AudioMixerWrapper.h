@@ -33,6 +33,7 @@ class AudioMixer : public node::ObjectWrap, public NodeEventRegistry {
   static void setInputActive(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void addOutput(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void removeOutput(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void getStats(const v8::FunctionCallbackInfo<v8::Value>& args);
 };
 
 #endif
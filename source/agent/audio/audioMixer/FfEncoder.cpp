@@ -7,6 +7,8 @@
 
 #include "AudioTime.h"
 
+#include <boost/bind.hpp>
+
 namespace mcu {
 
 using namespace webrtc;
@@ -35,6 +37,7 @@ FfEncoder::FfEncoder(const FrameFormat format)
     , m_audioEnc(NULL)
     , m_audioFifo(NULL)
     , m_audioFrame(NULL)
+    , m_mixTimeMs(0)
 {
     if (ELOG_IS_TRACE_ENABLED())
         av_log_set_level(AV_LOG_DEBUG);
@@ -47,10 +50,14 @@ FfEncoder::FfEncoder(const FrameFormat format)
 
     m_sampleRate = getAudioSampleRate(format);
     m_channels = getAudioChannels(format);
+
+    m_encodeQueue.reset(new AudioEncodeQueue(boost::bind(&FfEncoder::encodeFrame, this, _1, _2)));
 }
 
 FfEncoder::~FfEncoder()
 {
+    m_encodeQueue->close();
+
     if (!m_valid)
         return;
 
@@ -256,7 +263,7 @@ void FfEncoder::sendOut(AVPacket &pkt)
     frame.additionalInfo.audio.nbSamples = m_audioEnc->frame_size;
     frame.additionalInfo.audio.sampleRate = m_audioEnc->sample_rate;
     frame.additionalInfo.audio.channels = m_audioEnc->channels;
-    frame.timeStamp = (AudioTime::currentTime()) * frame.additionalInfo.audio.sampleRate / 1000;
+    frame.timeStamp = m_mixTimeMs * frame.additionalInfo.audio.sampleRate / 1000;
 
     ELOG_TRACE_T("deliverFrame(%s), sampleRate(%d), channels(%d), timeStamp(%d), length(%d), %s",
             getFormatStr(frame.format),
@@ -279,11 +286,17 @@ bool FfEncoder::addAudioFrame(const AudioFrame* audioFrame)
         return false;
     }
 
-    if (!addToFifo(audioFrame))
-        return false;
+    m_encodeQueue->pushFrame(audioFrame, AudioTime::currentTime());
+    return true;
+}
 
+void FfEncoder::encodeFrame(const AudioFrame& audioFrame, int64_t mixTimeMs)
+{
+    if (!addToFifo(&audioFrame))
+        return;
+
+    m_mixTimeMs = mixTimeMs;
     encode();
-    return true;
 }
 
 
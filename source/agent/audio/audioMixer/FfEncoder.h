@@ -14,6 +14,7 @@
 
 #include "MediaFramePipeline.h"
 #include "AudioEncoder.h"
+#include "AudioEncodeQueue.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -42,6 +43,8 @@ public:
 protected:
     bool initEncoder(const FrameFormat format);
     bool addToFifo(const AudioFrame* audioFrame);
+    // Runs on the compute threads.
+    void encodeFrame(const AudioFrame& audioFrame, int64_t mixTimeMs);
     void encode();
     void sendOut(AVPacket &pkt);
     char *ff_err2str(int errRet);
@@ -60,6 +63,11 @@ private:
     AVFrame* m_audioFrame;
 
     char m_errbuff[500];
+
+    // Of the last frame added to the fifo, the packets are stamped with it.
+    int64_t m_mixTimeMs;
+
+    boost::scoped_ptr<AudioEncodeQueue> m_encodeQueue;
 };
 
 } /* namespace mcu */
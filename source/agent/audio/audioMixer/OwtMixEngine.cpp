@@ -0,0 +1,269 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "OwtMixEngine.h"
+
+#include <algorithm>
+
+#include "AudioMixKernels.h"
+
+namespace mcu {
+
+DEFINE_LOGGER(OwtMixEngine, "mcu.media.OwtMixEngine");
+
+OwtMixEngine::OwtMixEngine(uint32_t maxSpeakers)
+    : m_maxSpeakers(maxSpeakers)
+    , m_receiver(NULL)
+    , m_vadReceiver(NULL)
+    , m_vadPeriod(0)
+    , m_vadTicks(0)
+    , m_frequency(DEFAULT_FREQUENCY)
+    , m_timestamp(0)
+{
+    ELOG_DEBUG("OwtMixEngine, maxSpeakers(%u)", maxSpeakers);
+
+    // For the speakers and as many fading out.
+    m_mixBuffer.resize(AudioFrame::kMaxDataSizeSamples);
+    for (uint32_t i = 0; i < 2 * m_maxSpeakers; ++i)
+        m_uniqueFrames.push_back(std::unique_ptr<AudioFrame>(new AudioFrame()));
+    m_uniqueFramePtrs.reserve(2 * m_maxSpeakers);
+}
+
+OwtMixEngine::~OwtMixEngine()
+{
+    ELOG_DEBUG("~OwtMixEngine");
+}
+
+int32_t OwtMixEngine::RegisterMixedStreamCallback(AudioMixerOutputReceiver* receiver)
+{
+    m_receiver = receiver;
+    return 0;
+}
+
+int32_t OwtMixEngine::UnRegisterMixedStreamCallback()
+{
+    m_receiver = NULL;
+    return 0;
+}
+
+void OwtMixEngine::RegisterMixerVadCallback(AudioMixerVadReceiver* receiver, int period)
+{
+    m_vadReceiver = receiver;
+    m_vadPeriod = period > 0 ? period : 1;
+    m_vadTicks = 0;
+    for (auto& p : m_participants)
+        p.vadEnergy = 0;
+}
+
+void OwtMixEngine::UnRegisterMixerVadCallback()
+{
+    m_vadReceiver = NULL;
+}
+
+OwtMixEngine::Participant* OwtMixEngine::findParticipant(MixerParticipant* participant)
+{
+    for (auto& p : m_participants) {
+        if (p.participant == participant)
+            return &p;
+    }
+    return NULL;
+}
+
+int32_t OwtMixEngine::SetMixabilityStatus(MixerParticipant* participant, bool mixable)
+{
+    Participant* p = findParticipant(participant);
+
+    if (mixable) {
+        if (p)
+            return 0;
+
+        Participant added;
+        added.participant = participant;
+        added.anonymous = false;
+        added.id = 0;
+        added.valid = false;
+        added.energy = 0;
+        added.mixed = false;
+        added.wasMixed = false;
+        added.vadEnergy = 0;
+        added.frame.reset(new AudioFrame());
+        m_participants.push_back(std::move(added));
+    } else {
+        if (!p)
+            return -1;
+
+        std::swap(*p, m_participants.back());
+        m_participants.pop_back();
+    }
+    return 0;
+}
+
+int32_t OwtMixEngine::SetAnonymousMixabilityStatus(MixerParticipant* participant, bool anonymous)
+{
+    Participant* p = findParticipant(participant);
+    if (!p)
+        return -1;
+
+    p->anonymous = anonymous;
+    return 0;
+}
+
+int32_t OwtMixEngine::SetMinimumMixingFrequency(AudioConferenceMixer::Frequency freq)
+{
+    if (freq == AudioConferenceMixer::kLowestPossible) {
+        m_frequency = DEFAULT_FREQUENCY;
+        return 0;
+    }
+
+    if (freq != AudioConferenceMixer::kNbInHz
+            && freq != AudioConferenceMixer::kWbInHz
+            && freq != AudioConferenceMixer::kSwbInHz
+            && freq != AudioConferenceMixer::kFbInHz) {
+        ELOG_ERROR("Invalid frequency(%d)", freq);
+        return -1;
+    }
+
+    m_frequency = freq;
+    return 0;
+}
+
+void OwtMixEngine::getFrames(int32_t frequency)
+{
+    size_t samplesPerChannel = frequency / 100;
+
+    for (auto& p : m_participants) {
+        AudioFrame* frame = p.frame.get();
+        frame->sample_rate_hz_ = frequency;
+
+        p.valid = p.participant->GetAudioFrame(0, frame) == 0
+                && frame->sample_rate_hz_ == frequency
+                && frame->samples_per_channel_ == samplesPerChannel
+                && (frame->num_channels_ == 1 || frame->num_channels_ == 2);
+
+        if (p.valid) {
+            p.id = frame->id_;
+            p.energy = mixEnergy(frame->data_, frame->samples_per_channel_ * frame->num_channels_);
+        } else {
+            p.energy = 0;
+        }
+        p.vadEnergy += p.energy;
+    }
+}
+
+void OwtMixEngine::selectSpeakers()
+{
+    m_candidates.clear();
+    for (auto& p : m_participants) {
+        p.wasMixed = p.mixed;
+        p.mixed = false;
+        if (p.valid && !p.anonymous && p.energy > 0)
+            m_candidates.push_back(&p);
+    }
+
+    size_t speakers = std::min<size_t>(m_maxSpeakers, m_candidates.size());
+    if (speakers < m_candidates.size()) {
+        // The speakers already mixed are favored by 3dB, not to switch
+        // between speakers as loud.
+        std::nth_element(m_candidates.begin(), m_candidates.begin() + speakers, m_candidates.end(),
+                [](const Participant* a, const Participant* b) {
+                    return ((uint64_t)a->energy << a->wasMixed) > ((uint64_t)b->energy << b->wasMixed);
+                });
+    }
+
+    for (size_t i = 0; i < speakers; ++i)
+        m_candidates[i]->mixed = true;
+}
+
+void OwtMixEngine::Process()
+{
+    int32_t frequency = m_frequency;
+    size_t samplesPerChannel = frequency / 100;
+
+    getFrames(frequency);
+    selectSpeakers();
+
+    // Mix in stereo as soon as one of the frames is.
+    size_t channels = 1;
+    for (auto& p : m_participants) {
+        if (p.valid && (p.mixed || p.wasMixed || p.anonymous) && p.frame->num_channels_ == 2)
+            channels = 2;
+    }
+
+    size_t samples = samplesPerChannel * channels;
+    std::fill(m_mixBuffer.begin(), m_mixBuffer.begin() + samples, 0);
+
+    for (auto& p : m_participants) {
+        if (!p.valid || !(p.mixed || p.wasMixed || p.anonymous))
+            continue;
+
+        AudioFrame* frame = p.frame.get();
+        if (frame->num_channels_ != channels) {
+            mixMonoToStereo(frame->data_, samplesPerChannel);
+            frame->num_channels_ = channels;
+        }
+
+        if (!p.anonymous && p.mixed != p.wasMixed)
+            mixRamp(frame->data_, samplesPerChannel, channels, p.mixed);
+
+        mixAccumulate(m_mixBuffer.data(), frame->data_, samples);
+    }
+
+    m_generalFrame.id_ = 0;
+    m_generalFrame.timestamp_ = m_timestamp;
+    m_generalFrame.samples_per_channel_ = samplesPerChannel;
+    m_generalFrame.sample_rate_hz_ = frequency;
+    m_generalFrame.num_channels_ = channels;
+    m_generalFrame.speech_type_ = AudioFrame::kNormalSpeech;
+    m_generalFrame.vad_activity_ = AudioFrame::kVadUnknown;
+    mixSaturate(m_generalFrame.data_, m_mixBuffer.data(), NULL, samples);
+
+    // The speakers get the mix without themselves, and so do the ones fading
+    // out, their last frame is still in the mix.
+    m_uniqueFramePtrs.clear();
+    for (auto& p : m_participants) {
+        if (!p.mixed && !(p.wasMixed && p.valid && !p.anonymous))
+            continue;
+
+        AudioFrame* unique = m_uniqueFrames[m_uniqueFramePtrs.size()].get();
+        unique->id_ = p.id;
+        unique->timestamp_ = m_timestamp;
+        unique->samples_per_channel_ = samplesPerChannel;
+        unique->sample_rate_hz_ = frequency;
+        unique->num_channels_ = channels;
+        unique->speech_type_ = AudioFrame::kNormalSpeech;
+        unique->vad_activity_ = AudioFrame::kVadUnknown;
+        mixSaturate(unique->data_, m_mixBuffer.data(), p.frame->data_, samples);
+        m_uniqueFramePtrs.push_back(unique);
+    }
+
+    m_timestamp += samplesPerChannel;
+
+    if (m_receiver)
+        m_receiver->NewMixedAudio(0, m_generalFrame, m_uniqueFramePtrs.data(), m_uniqueFramePtrs.size());
+
+    if (m_vadReceiver && ++m_vadTicks >= m_vadPeriod)
+        reportVad();
+}
+
+void OwtMixEngine::reportVad()
+{
+    m_vadStatistics.clear();
+    for (auto& p : m_participants) {
+        if (!p.id) {
+            p.vadEnergy = 0;
+            continue;
+        }
+
+        ParticipantVadStatistics statistics;
+        statistics.id = p.id;
+        statistics.energy = p.vadEnergy / m_vadTicks;
+        m_vadStatistics.push_back(statistics);
+        p.vadEnergy = 0;
+    }
+    m_vadTicks = 0;
+
+    m_vadReceiver->VadParticipants(m_vadStatistics.data(), m_vadStatistics.size());
+}
+
+} /* namespace mcu */
@@ -0,0 +1,93 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OwtMixEngine_h
+#define OwtMixEngine_h
+
+#include <memory>
+#include <vector>
+
+#include <logger.h>
+
+#include "AudioMixEngine.h"
+
+namespace mcu {
+
+/**
+ * Mixes the loudest participants, as many as configured, plus the anonymous
+ * ones. The frames are summed once on 32 bits and each speaker gets the sum
+ * without itself, instead of a mix per speaker. Participants fade in and out
+ * of the mix over a frame, and still get the sum without themselves while
+ * fading out. No other processing is done.
+ */
+class OwtMixEngine : public AudioMixEngine {
+    DECLARE_LOGGER();
+
+    static const int32_t DEFAULT_FREQUENCY = 16000;
+
+    struct Participant {
+        MixerParticipant* participant;
+        bool anonymous;
+
+        // Of the last frame got.
+        int32_t id;
+        bool valid;
+        uint32_t energy;
+
+        bool mixed;
+        bool wasMixed;
+
+        // Over the current VAD period.
+        uint64_t vadEnergy;
+
+        std::unique_ptr<AudioFrame> frame;
+    };
+
+public:
+    OwtMixEngine(uint32_t maxSpeakers);
+    virtual ~OwtMixEngine();
+
+    int32_t RegisterMixedStreamCallback(AudioMixerOutputReceiver* receiver) override;
+    int32_t UnRegisterMixedStreamCallback() override;
+
+    void RegisterMixerVadCallback(AudioMixerVadReceiver* receiver, int period) override;
+    void UnRegisterMixerVadCallback() override;
+
+    int32_t SetMixabilityStatus(MixerParticipant* participant, bool mixable) override;
+    int32_t SetAnonymousMixabilityStatus(MixerParticipant* participant, bool anonymous) override;
+    int32_t SetMinimumMixingFrequency(AudioConferenceMixer::Frequency freq) override;
+
+    void Process() override;
+
+private:
+    Participant* findParticipant(MixerParticipant* participant);
+
+    void getFrames(int32_t frequency);
+    void selectSpeakers();
+    void reportVad();
+
+    const uint32_t m_maxSpeakers;
+
+    AudioMixerOutputReceiver* m_receiver;
+    AudioMixerVadReceiver* m_vadReceiver;
+    int m_vadPeriod;
+    int m_vadTicks;
+
+    int32_t m_frequency;
+    uint32_t m_timestamp;
+
+    std::vector<Participant> m_participants;
+
+    // Reused at each tick.
+    std::vector<Participant*> m_candidates;
+    std::vector<int32_t> m_mixBuffer;
+    AudioFrame m_generalFrame;
+    std::vector<std::unique_ptr<AudioFrame>> m_uniqueFrames;
+    std::vector<const AudioFrame*> m_uniqueFramePtrs;
+    std::vector<ParticipantVadStatistics> m_vadStatistics;
+};
+
+} /* namespace mcu */
+
+#endif /* OwtMixEngine_h */
@@ -10,7 +10,9 @@
       'AcmEncoder.cpp',
       'PcmEncoder.cpp',
       'FfEncoder.cpp',
+      'AudioEncodeQueue.cpp',
       'AcmmFrameMixer.cpp',
+      'OwtMixEngine.cpp',
       'AcmmBroadcastGroup.cpp',
       'AcmmGroup.cpp',
       'AcmmInput.cpp',
@@ -43,5 +45,26 @@
       '<!@(pkg-config --libs libavformat)',
       '<!@(pkg-config --libs libavutil)',
     ],
-  }]
+  },
+# not build test target
+#  {
+#    'target_name': 'AudioMixEngineBenchmark',
+#    'type' : 'executable',
+#    'sources': [
+#      'AudioMixEngineBenchmark.cpp',
+#      'OwtMixEngine.cpp',
+#    ],
+#    'cflags_cc': ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11', '-DWEBRTC_POSIX'],
+#    'cflags_cc!': ['-fno-exceptions'],
+#    'include_dirs': [ '$(CORE_HOME)/common',
+#                      '$(CORE_HOME)/owt_base',
+#                      '$(CORE_HOME)/../../third_party/webrtc/src',
+#    ],
+#    'libraries': [
+#      '-L$(CORE_HOME)/../../third_party/webrtc', '-lwebrtc',
+#      '-lboost_thread',
+#      '-llog4cxx',
+#    ],
+#  }
+  ]
 }
@@ -44,6 +44,10 @@ module.exports.load = () => {
       config.internal.ip_address = addr.ip;
     }
 
+    config.audio = config.audio || {};
+    config.audio.mixerEngine = config.audio.mixer_engine || 'webrtc';
+    config.audio.mixedSpeakers = config.audio.mixed_speakers || 3;
+
     return config;
   } catch (e) {
     console.error('Parsing config error on line ' + e.line + ', column ' + e.column + ': ' + e.message);
@@ -46,6 +46,8 @@ module.exports.load = () => {
 
     config.recording = config.recording || {};
     config.recording.initializeTimeout = config.recording.initialize_timeout || 3000;
+    config.recording.maxQueueBytes = config.recording.max_queue_bytes || 33554432;
+    config.recording.maxQueueMs = config.recording.max_queue_ms || 10000;
     config.recording.path = config.recording.path || '/tmp'
     try {
       fs.accessSync(config.recording.path, fs.F_OK);
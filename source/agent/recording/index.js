@@ -53,7 +53,9 @@ module.exports = function (rpcClient, selfRpcId, parentRpcId, clusterWorkerIP) {
                                 video_codec: 'h264'/*FIXME: should be removed later*/,
                                 url: recording_path,
                                 interval: 1000/*FIXME: should be removed later*/,
-                                initializeTimeout: global.config.recording.initializeTimeout};
+                                initializeTimeout: global.config.recording.initializeTimeout,
+                                maxQueueBytes: global.config.recording.maxQueueBytes,
+                                maxQueueMs: global.config.recording.maxQueueMs};
 
         var connection = new AVStreamOut(avstream_options, function (error) {
             if (error) {
@@ -67,6 +69,9 @@ module.exports = function (rpcClient, selfRpcId, parentRpcId, clusterWorkerIP) {
             log.error('media recording error:', error);
             notifyStatus(options.controller, connectionId, 'out', {type: 'failed', reason: 'recording fatal error: ' + error});
         });
+        connection.addEventListener('queue', function (stats) {
+            log.warn('media recording falls behind:', stats);
+        });
 
         connection.receiver = function(type) {
             return this;
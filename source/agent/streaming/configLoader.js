@@ -48,6 +48,8 @@ module.exports.load = () => {
 
     config.avstream = config.avstream || {};
     config.avstream.initializeTimeout = config.avstream.initialize_timeout || 3000;
+    config.avstream.maxQueueBytes = config.avstream.max_queue_bytes || 8388608;
+    config.avstream.maxQueueMs = config.avstream.max_queue_ms || 5000;
 
     return config;
   } catch (e) {
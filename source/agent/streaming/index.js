@@ -53,7 +53,9 @@ module.exports = function (rpcClient, selfRpcId, parentRpcId, clusterWorkerIP) {
                                 require_audio: !!options.media.audio,
                                 require_video: !!options.media.video,
                                 connection: options.connection,
-                                initializeTimeout: global.config.avstream.initializeTimeout};
+                                initializeTimeout: global.config.avstream.initializeTimeout,
+                                maxQueueBytes: global.config.avstream.maxQueueBytes,
+                                maxQueueMs: global.config.avstream.maxQueueMs};
 
         if ((options.connection.protocol === 'dash' || options.connection.protocol === 'hls') && !options.connection.url.startsWith('http')) {
             var fs = require('fs');
@@ -78,6 +80,9 @@ module.exports = function (rpcClient, selfRpcId, parentRpcId, clusterWorkerIP) {
                 notifyStatus(options.controller, connectionId, 'out', {type: 'failed', reason: 'avstream_out fatal error: ' + error});
             }
         });
+        connection.addEventListener('queue', function (stats) {
+            log.warn('avstream-out falls behind:', stats);
+        });
 
         connection.receiver = function(type) {
             return this;
@@ -831,7 +831,7 @@ MsdkFrameGenerator::MsdkFrameGenerator(
 
     ELOG_DEBUG_T("MsdkVpp(%p)", m_msdkVpp.get());
 
-    m_jobTimer.reset(new JobTimer(m_maxSupportedFps, this));
+    m_jobTimer.reset(new JobTimer(m_maxSupportedFps, this, owt_base::IOScheduler::compute()));
     m_jobTimer->start();
 }
 
@@ -0,0 +1,154 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Test SoftScaledFrameCache on the composition pool: one input shown in two
+// regions of two generators, composing concurrently, must neither deadlock
+// nor get a frame scaled differently than on its own. Neither must an input
+// shown in a single region, which is scaled right into the composite.
+//
+// Usage: SoftScaledFrameCacheTest [frames]
+
+#include <iostream>
+#include <atomic>
+#include <cassert>
+#include <string.h>
+#include <stdlib.h>
+
+#include "libyuv/scale.h"
+#include "SoftVideoCompositor.h"
+
+using namespace std;
+using namespace mcu;
+
+// Gives up if the generators are not done after so long, a deadlock.
+static const int kTimeoutSeconds = 30;
+
+static boost::shared_ptr<webrtc::VideoFrame> createFrame(uint32_t width, uint32_t height, uint8_t seed)
+{
+    rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(width, height);
+    for (uint32_t y = 0; y < height; ++y)
+        for (uint32_t x = 0; x < width; ++x)
+            buffer->MutableDataY()[y * buffer->StrideY() + x] = (x * 3 + y * 5 + seed) & 0xff;
+    for (uint32_t y = 0; y < height / 2; ++y) {
+        for (uint32_t x = 0; x < width / 2; ++x) {
+            buffer->MutableDataU()[y * buffer->StrideU() + x] = (x + y * 7 + seed) & 0xff;
+            buffer->MutableDataV()[y * buffer->StrideV() + x] = (x * 11 + y + seed) & 0xff;
+        }
+    }
+    return boost::make_shared<webrtc::VideoFrame>(buffer, webrtc::kVideoRotation_0, 0);
+}
+
+static rtc::scoped_refptr<webrtc::I420Buffer> scaleReference(const boost::shared_ptr<webrtc::VideoFrame>& frame, uint32_t width, uint32_t height)
+{
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> src = frame->video_frame_buffer();
+    rtc::scoped_refptr<webrtc::I420Buffer> dst = webrtc::I420Buffer::Create(width, height);
+    libyuv::I420Scale(src->DataY(), src->StrideY(), src->DataU(), src->StrideU(), src->DataV(), src->StrideV(),
+            src->width(), src->height(),
+            dst->MutableDataY(), dst->StrideY(), dst->MutableDataU(), dst->StrideU(), dst->MutableDataV(), dst->StrideV(),
+            width, height, libyuv::kFilterBox);
+    return dst;
+}
+
+static bool samePlane(const uint8_t* a, int strideA, const uint8_t* b, int strideB, uint32_t width, uint32_t height)
+{
+    for (uint32_t y = 0; y < height; ++y) {
+        if (memcmp(a + y * strideA, b + y * strideB, width))
+            return false;
+    }
+    return true;
+}
+
+static bool sameFrame(rtc::scoped_refptr<webrtc::VideoFrameBuffer> a, rtc::scoped_refptr<webrtc::VideoFrameBuffer> b)
+{
+    return a && b && a->width() == b->width() && a->height() == b->height()
+        && samePlane(a->DataY(), a->StrideY(), b->DataY(), b->StrideY(), a->width(), a->height())
+        && samePlane(a->DataU(), a->StrideU(), b->DataU(), b->StrideU(), a->width() / 2, a->height() / 2)
+        && samePlane(a->DataV(), a->StrideV(), b->DataV(), b->StrideV(), a->width() / 2, a->height() / 2);
+}
+
+struct Input {
+    boost::shared_ptr<SoftScaledFrameCache> cache;
+    boost::shared_ptr<webrtc::VideoFrame> frames[2];
+    uint64_t generations[2];
+};
+
+struct Region {
+    Input* input;
+    uint32_t width;
+    uint32_t height;
+    // Scaled into a composite at (x, y) if not zero.
+    uint32_t x;
+    uint32_t y;
+};
+
+static std::atomic<uint32_t> mismatches(0);
+
+static void scaleRegion(const Region& region, uint32_t frame)
+{
+    Input* input = region.input;
+    uint32_t i = frame % 2;
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> frameBuffer = input->frames[i]->video_frame_buffer();
+    rtc::scoped_refptr<webrtc::I420Buffer> composite;
+    if (region.x || region.y)
+        composite = webrtc::I420Buffer::Create(region.x + region.width, region.y + region.height);
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> scaled = input->cache->getScaledFrame(
+            input->frames[i], input->generations[i] + frame / 2 * 2,
+            0, 0, frameBuffer->width(), frameBuffer->height(), region.width, region.height,
+            composite, region.x, region.y);
+    if (!scaled && composite) {
+        scaled = webrtc::I420Buffer::Copy(region.width, region.height,
+                composite->DataY() + region.y * composite->StrideY() + region.x, composite->StrideY(),
+                composite->DataU() + (region.y * composite->StrideU() + region.x) / 2, composite->StrideU(),
+                composite->DataV() + (region.y * composite->StrideV() + region.x) / 2, composite->StrideV());
+    }
+    if (!sameFrame(scaled, scaleReference(input->frames[i], region.width, region.height)))
+        mismatches++;
+}
+
+// Composes the regions of a generator as SoftFrameGenerator does, one pool task per region.
+static void runGenerator(boost::shared_ptr<SoftCompositionPool> pool, const std::vector<Region>& regions, uint32_t frames)
+{
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        std::vector<SoftCompositionPool::Task> tasks;
+        for (auto& region : regions)
+            tasks.push_back(boost::bind(scaleRegion, region, frame));
+        pool->run(tasks);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t frames = argc > 1 ? atoi(argv[1]) : 200;
+    boost::shared_ptr<SoftCompositionPool> pool = SoftCompositionPool::getInstance();
+
+    Input inputs[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        inputs[i].cache.reset(new SoftScaledFrameCache(pool));
+        for (uint32_t j = 0; j < 2; ++j) {
+            inputs[i].frames[j] = createFrame(1920, 1080, i * 2 + j);
+            inputs[i].generations[j] = j + 1;
+        }
+    }
+
+    // Input 0 in two regions of both generators, at the same size, and
+    // input 1 next to it, in the opposite order in the other generator.
+    // Input 2 only in a region of the first one.
+    std::vector<Region> generator1 = {{&inputs[0], 1280, 720, 64, 32}, {&inputs[0], 1280, 720}, {&inputs[1], 960, 540, 32, 64},
+        {&inputs[2], 640, 360, 96, 16}};
+    std::vector<Region> generator2 = {{&inputs[1], 960, 540}, {&inputs[0], 1280, 720}, {&inputs[0], 1280, 720}};
+
+    boost::thread thread1(boost::bind(runGenerator, pool, generator1, frames));
+    boost::thread thread2(boost::bind(runGenerator, pool, generator2, frames));
+    bool done = thread1.try_join_for(boost::chrono::seconds(kTimeoutSeconds))
+        && thread2.try_join_for(boost::chrono::seconds(kTimeoutSeconds));
+    if (!done) {
+        cout << "Generators stuck after " << kTimeoutSeconds << "s, deadlock" << endl;
+        abort();
+    }
+
+    cout << "pool threads " << pool->size() << ", frames " << frames << ", mismatches " << mismatches << endl;
+    assert(mismatches == 0);
+    cout << "finish test" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
@@ -7,6 +7,9 @@
 #include "libyuv/convert.h"
 #include "libyuv/scale.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 
@@ -17,6 +20,195 @@ using namespace owt_base;
 
 namespace mcu {
 
+// The composite buffers in use at most, the one being composed included.
+static const uint32_t kMaxCompositeBuffers = 3;
+// Scaled frames kept per input, enough for the regions of both generators.
+static const uint32_t kMaxScaledFrames = 8;
+// The pixels of a composition task at least, larger work is split into stripes.
+static const uint32_t kMinTaskPixels = 320 * 240;
+// The composition latency is reported every interval.
+static const int64_t kCompositionStatsIntervalMs = 10000;
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+uint64_t nextFrameGeneration()
+{
+    static std::atomic<uint64_t> generation(0);
+    return ++generation;
+}
+
+DEFINE_LOGGER(SoftCompositionPool, "mcu.media.SoftVideoCompositor.SoftCompositionPool");
+
+boost::shared_ptr<SoftCompositionPool> SoftCompositionPool::getInstance()
+{
+    static boost::mutex mutex;
+    static boost::weak_ptr<SoftCompositionPool> instance;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    boost::shared_ptr<SoftCompositionPool> pool = instance.lock();
+    if (!pool) {
+        uint32_t nThreads = boost::thread::hardware_concurrency() / 2;
+        if (nThreads > 16)
+            nThreads = 16;
+        if (nThreads < 2)
+            nThreads = 0;
+
+        pool.reset(new SoftCompositionPool(nThreads));
+        instance = pool;
+    }
+    return pool;
+}
+
+SoftCompositionPool::SoftCompositionPool(uint32_t nThreads)
+    : m_nextWorker(0)
+    , m_queued(0)
+    , m_running(true)
+{
+    ELOG_DEBUG("hardware concurrency %d, composition threads %d", boost::thread::hardware_concurrency(), nThreads);
+
+    for (uint32_t i = 0; i < nThreads; i++)
+        m_workers.push_back(boost::make_shared<Worker>());
+    for (uint32_t i = 0; i < nThreads; i++)
+        m_threads.create_thread(boost::bind(&SoftCompositionPool::workerLoop, this, i));
+}
+
+SoftCompositionPool::~SoftCompositionPool()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_running = false;
+        m_cond.notify_all();
+    }
+    m_threads.join_all();
+}
+
+uint32_t SoftCompositionPool::getTaskCount(uint32_t pixels)
+{
+    // A couple of tasks per thread, so that the idle ones have something to steal.
+    uint32_t maxTasks = 2 * (m_workers.size() + 1);
+    uint32_t count = pixels / kMinTaskPixels;
+
+    if (m_workers.empty() || count < 2)
+        return 1;
+    return std::min(count, maxTasks);
+}
+
+void SoftCompositionPool::run(const std::vector<Task>& tasks)
+{
+    if (tasks.empty())
+        return;
+
+    if (m_workers.empty() || tasks.size() == 1) {
+        for (auto& task : tasks)
+            task();
+        return;
+    }
+
+    Batch batch;
+    batch.pending = tasks.size();
+
+    uint32_t start;
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_queued += tasks.size();
+        start = m_nextWorker++;
+    }
+    for (size_t i = 0; i < tasks.size(); i++) {
+        Worker& worker = *m_workers[(start + i) % m_workers.size()];
+        boost::unique_lock<boost::mutex> lock(worker.mutex);
+        worker.queue.push_back(Item{tasks[i], &batch});
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_cond.notify_all();
+    }
+
+    // Help until every task is taken, then wait for the ones still running.
+    Item item;
+    while (popItem(start % m_workers.size(), &item, &batch))
+        execute(item);
+
+    boost::unique_lock<boost::mutex> lock(batch.mutex);
+    while (batch.pending > 0)
+        batch.cond.wait(lock);
+}
+
+void SoftCompositionPool::workerLoop(uint32_t index)
+{
+    Item item;
+    while (true) {
+        if (popItem(index, &item)) {
+            execute(item);
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        while (m_running && m_queued <= 0)
+            m_cond.wait(lock);
+        if (!m_running)
+            break;
+    }
+}
+
+// Takes the oldest task of the own queue, or steals the newest of the others.
+bool SoftCompositionPool::popItem(uint32_t index, Item *item, Batch *batch)
+{
+    bool found = false;
+
+    for (size_t i = 0; i < m_workers.size() && !found; i++) {
+        Worker& worker = *m_workers[(index + i) % m_workers.size()];
+        boost::unique_lock<boost::mutex> lock(worker.mutex);
+        if (worker.queue.empty())
+            continue;
+
+        if (batch) {
+            for (auto it = worker.queue.begin(); it != worker.queue.end(); ++it) {
+                if (it->batch == batch) {
+                    *item = *it;
+                    worker.queue.erase(it);
+                    found = true;
+                    break;
+                }
+            }
+        } else if (i == 0) {
+            *item = worker.queue.front();
+            worker.queue.pop_front();
+            found = true;
+        } else {
+            *item = worker.queue.back();
+            worker.queue.pop_back();
+            found = true;
+        }
+    }
+
+    if (found) {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_queued--;
+    }
+    return found;
+}
+
+void SoftCompositionPool::execute(Item &item)
+{
+    item.task();
+    item.task.clear();
+
+    // Signaled under the lock, the batch is gone as soon as the waiter sees it done.
+    boost::unique_lock<boost::mutex> lock(item.batch->mutex);
+    if (--item.batch->pending == 0)
+        item.batch->cond.notify_all();
+}
+
+
 DEFINE_LOGGER(AvatarManager, "mcu.media.SoftVideoCompositor.AvatarManager");
 
 AvatarManager::AvatarManager(uint8_t size)
@@ -132,6 +324,7 @@ bool AvatarManager::setAvatar(uint8_t index, const std::string &url)
             return true;
     }
     m_frames.erase(old_url);
+    m_generations.erase(old_url);
     return true;
 }
 
@@ -153,10 +346,11 @@ bool AvatarManager::unsetAvatar(uint8_t index)
             return true;
     }
     m_frames.erase(url);
+    m_generations.erase(url);
     return true;
 }
 
-boost::shared_ptr<webrtc::VideoFrame> AvatarManager::getAvatarFrame(uint8_t index)
+boost::shared_ptr<webrtc::VideoFrame> AvatarManager::getAvatarFrame(uint8_t index, uint64_t *generation)
 {
     boost::unique_lock<boost::shared_mutex> lock(m_mutex);
 
@@ -167,11 +361,16 @@ boost::shared_ptr<webrtc::VideoFrame> AvatarManager::getAvatarFrame(uint8_t inde
     }
     auto it2 = m_frames.find(it->second);
     if (it2 != m_frames.end()) {
+        if (generation)
+            *generation = m_generations[it->second];
         return it2->second;
     }
 
     boost::shared_ptr<webrtc::VideoFrame> frame = loadImage(it->second);
     m_frames[it->second] = frame;
+    m_generations[it->second] = nextFrameGeneration();
+    if (generation)
+        *generation = m_generations[it->second];
     return frame;
 }
 
@@ -179,9 +378,8 @@ DEFINE_LOGGER(SoftInput, "mcu.media.SoftVideoCompositor.SoftInput");
 
 SoftInput::SoftInput()
     : m_active(false)
+    , m_busyFrameGeneration(0)
 {
-    m_bufferManager.reset(new I420BufferManager(3));
-    m_converter.reset(new owt_base::FrameConverter());
 }
 
 SoftInput::~SoftInput()
@@ -192,8 +390,10 @@ void SoftInput::setActive(bool active)
 {
     boost::unique_lock<boost::shared_mutex> lock(m_mutex);
     m_active = active;
-    if (!m_active)
+    if (!m_active) {
         m_busyFrame.reset();
+        m_busyFrameGeneration = 0;
+    }
 }
 
 bool SoftInput::isActive(void)
@@ -203,39 +403,251 @@ bool SoftInput::isActive(void)
 
 void SoftInput::pushInput(webrtc::VideoFrame *videoFrame)
 {
-    {
-        boost::unique_lock<boost::shared_mutex> lock(m_mutex);
-        if (!m_active)
-            return;
+    // Hold the decoder's buffer instead of copying it, the decoder pools
+    // do not hand out a buffer again until all the references are gone.
+    boost::shared_ptr<webrtc::VideoFrame> frame(
+            new webrtc::VideoFrame(videoFrame->video_frame_buffer(), webrtc::kVideoRotation_0, 0));
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    if (m_active) {
+        m_busyFrame = frame;
+        m_busyFrameGeneration = nextFrameGeneration();
     }
+}
 
-    rtc::scoped_refptr<webrtc::I420Buffer> dstBuffer = m_bufferManager->getFreeBuffer(videoFrame->width(), videoFrame->height());
-    if (!dstBuffer) {
-        ELOG_ERROR("No free buffer");
-        return;
+boost::shared_ptr<VideoFrame> SoftInput::popInput(uint64_t *generation)
+{
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+
+    if(!m_active)
+        return NULL;
+
+    if (generation)
+        *generation = m_busyFrameGeneration;
+    return m_busyFrame;
+}
+
+DEFINE_LOGGER(SoftScaledFrameCache, "mcu.media.SoftVideoCompositor.SoftScaledFrameCache");
+
+SoftScaledFrameCache::SoftScaledFrameCache(boost::shared_ptr<SoftCompositionPool> pool)
+    : m_pool(pool)
+    , m_latestGeneration(0)
+    , m_previousGeneration(0)
+    , m_useCounter(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_directScales(0)
+{
+}
+
+SoftScaledFrameCache::~SoftScaledFrameCache()
+{
+    ELOG_DEBUG("Scaled frame cache hits %lu, misses %lu, direct %lu", m_hits, m_misses, m_directScales);
+}
+
+rtc::scoped_refptr<webrtc::VideoFrameBuffer> SoftScaledFrameCache::getScaledFrame(
+        const boost::shared_ptr<webrtc::VideoFrame>& frame, uint64_t generation,
+        uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+        uint32_t dst_width, uint32_t dst_height,
+        rtc::scoped_refptr<webrtc::I420Buffer> target, uint32_t target_x, uint32_t target_y)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    m_useCounter++;
+    uint32_t consumers = 1;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        Entry& entry = *it;
+        if (entry.generation == generation
+                && entry.src_x == src_x && entry.src_y == src_y
+                && entry.src_width == src_width && entry.src_height == src_height
+                && entry.dst_width == dst_width && entry.dst_height == dst_height) {
+            if (!entry.buffer) {
+                // Scaled into the target of another region, cache it this time.
+                consumers = entry.consumers + 1;
+                m_entries.erase(it);
+                break;
+            }
+
+            entry.lastUsed = m_useCounter;
+            entry.consumers++;
+            m_hits++;
+
+            // Being scaled by another region, the entry may move meanwhile.
+            rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer = entry.buffer;
+            boost::shared_ptr<Scaling> scaling = entry.scaling;
+            while (scaling && !scaling->done)
+                scaling->cond.wait(lock);
+            return buffer;
+        }
     }
 
-    rtc::scoped_refptr<webrtc::VideoFrameBuffer> srcI420Buffer = videoFrame->video_frame_buffer();
-    if (!m_converter->convert(srcI420Buffer, dstBuffer.get())) {
-        ELOG_ERROR("I420Copy failed");
-        return;
+    if (generation != m_latestGeneration) {
+        m_previousGeneration = m_latestGeneration;
+        m_latestGeneration = generation;
     }
 
-    {
-        boost::unique_lock<boost::shared_mutex> lock(m_mutex);
-        if (m_active)
-            m_busyFrame.reset(new webrtc::VideoFrame(dstBuffer, webrtc::kVideoRotation_0, 0));
+    if (target && consumers == 1
+            && isSingleConsumer(generation, src_x, src_y, src_width, src_height, dst_width, dst_height)) {
+        // Still recorded, for the regions asking for it later to know they are not alone.
+        if (makeRoom(dst_width, dst_height, NULL)) {
+            Entry entry{.generation = generation, .src_x = src_x, .src_y = src_y, .src_width = src_width, .src_height = src_height,
+                .dst_width = dst_width, .dst_height = dst_height, .lastUsed = m_useCounter, .consumers = 1};
+            m_entries.push_back(entry);
+        }
+        m_directScales++;
+        lock.unlock();
+
+        scale(frame, src_x, src_y, src_width, src_height, target, target_x, target_y, dst_width, dst_height);
+        return NULL;
     }
+
+    rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>> buffer = getFreeBuffer(dst_width, dst_height);
+    if (!buffer)
+        return NULL;
+
+    // Reserved before being scaled, the others wait for it instead of
+    // scaling it again. The lock is not held meanwhile, the other inputs and
+    // sizes are scaled concurrently.
+    boost::shared_ptr<Scaling> scaling = boost::make_shared<Scaling>();
+    scaling->done = false;
+    Entry entry{.generation = generation, .src_x = src_x, .src_y = src_y, .src_width = src_width, .src_height = src_height,
+        .dst_width = dst_width, .dst_height = dst_height, .lastUsed = m_useCounter, .consumers = consumers,
+        .buffer = buffer, .scaling = scaling};
+    m_entries.push_back(entry);
+    m_misses++;
+    lock.unlock();
+
+    scale(frame, src_x, src_y, src_width, src_height, buffer, 0, 0, dst_width, dst_height);
+
+    lock.lock();
+    scaling->done = true;
+    scaling->cond.notify_all();
+    for (auto& entry : m_entries) {
+        if (entry.scaling == scaling)
+            entry.scaling.reset();
+    }
+    return buffer;
 }
 
-boost::shared_ptr<VideoFrame> SoftInput::popInput()
+// Whether only one region asked for the last generation scaled the same way.
+bool SoftScaledFrameCache::isSingleConsumer(uint64_t generation,
+        uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+        uint32_t dst_width, uint32_t dst_height)
 {
-    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    const Entry *last = NULL;
+    for (auto& entry : m_entries) {
+        if (entry.generation != generation
+                && entry.src_x == src_x && entry.src_y == src_y
+                && entry.src_width == src_width && entry.src_height == src_height
+                && entry.dst_width == dst_width && entry.dst_height == dst_height
+                && (!last || entry.generation > last->generation))
+            last = &entry;
+    }
+    return last && last->consumers == 1;
+}
 
-    if(!m_active)
+// Large areas are scaled in stripes on the composition pool. The stripes
+// start on rows where the src and dst rows match exactly, both even for
+// the chroma planes, so that the result does not depend on the split.
+void SoftScaledFrameCache::scale(const boost::shared_ptr<webrtc::VideoFrame>& frame,
+        uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+        rtc::scoped_refptr<webrtc::I420Buffer> dst, uint32_t dst_x, uint32_t dst_y, uint32_t dst_width, uint32_t dst_height)
+{
+    ScaleJob job{.src = frame->video_frame_buffer(), .src_x = src_x, .src_y = src_y, .src_width = src_width, .src_height = src_height,
+        .dst = dst, .dst_x = dst_x, .dst_y = dst_y, .dst_width = dst_width, .dst_height = dst_height};
+    uint32_t nStripes = m_pool->getTaskCount(dst_width * dst_height);
+    uint32_t step = 2 * dst_height / gcd(src_height, dst_height);
+    uint32_t stripeHeight = (dst_height + nStripes - 1) / nStripes;
+    stripeHeight = (stripeHeight + step - 1) / step * step;
+    std::vector<SoftCompositionPool::Task> tasks;
+    for (uint32_t y = 0; y < dst_height; y += stripeHeight)
+        tasks.push_back(boost::bind(SoftScaledFrameCache::scaleStripe, boost::cref(job), y, std::min(stripeHeight, dst_height - y)));
+    m_pool->run(tasks);
+}
+
+// Scales the rows [stripe_y, stripe_y + stripe_height) of the dst area from
+// the matching rows of the src area.
+void SoftScaledFrameCache::scaleStripe(const ScaleJob& job, uint32_t stripe_y, uint32_t stripe_height)
+{
+    uint32_t src_top = (uint64_t)stripe_y * job.src_height / job.dst_height;
+    uint32_t src_bottom = (uint64_t)(stripe_y + stripe_height) * job.src_height / job.dst_height;
+
+    const webrtc::VideoFrameBuffer *src = job.src.get();
+    webrtc::I420Buffer *dst = job.dst.get();
+    uint32_t src_x = job.src_x;
+    uint32_t src_y = job.src_y + src_top;
+    uint32_t dst_x = job.dst_x;
+    uint32_t dst_y = job.dst_y + stripe_y;
+    int ret = libyuv::I420Scale(
+            src->DataY() + src_y * src->StrideY() + src_x, src->StrideY(),
+            src->DataU() + (src_y * src->StrideU() + src_x) / 2, src->StrideU(),
+            src->DataV() + (src_y * src->StrideV() + src_x) / 2, src->StrideV(),
+            job.src_width, src_bottom - src_top,
+            dst->MutableDataY() + dst_y * dst->StrideY() + dst_x, dst->StrideY(),
+            dst->MutableDataU() + (dst_y * dst->StrideU() + dst_x) / 2, dst->StrideU(),
+            dst->MutableDataV() + (dst_y * dst->StrideV() + dst_x) / 2, dst->StrideV(),
+            job.dst_width, stripe_height,
+            libyuv::kFilterBox);
+    if (ret != 0)
+        ELOG_ERROR("I420Scale failed, ret %d", ret);
+}
+
+// Drops the entries of stale generations, and the least recently used one
+// if still full, false if none can be. Hands out the buffer of a dropped
+// entry of the given size for reuse if asked.
+bool SoftScaledFrameCache::makeRoom(uint32_t width, uint32_t height, rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>> *reusable)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        // Keep the generations still asked for, and the ones being copied out of.
+        if (it->generation == m_latestGeneration || it->generation == m_previousGeneration
+                || (it->buffer && !it->buffer->HasOneRef())) {
+            ++it;
+            continue;
+        }
+
+        if (reusable && !*reusable && it->buffer && it->dst_width == width && it->dst_height == height)
+            *reusable = it->buffer;
+        it = m_entries.erase(it);
+    }
+
+    if (m_entries.size() >= kMaxScaledFrames) {
+        auto victim = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            // Skip the ones being copied out of.
+            if (it->buffer && !it->buffer->HasOneRef())
+                continue;
+            if (victim == m_entries.end()
+                    || it->generation < victim->generation
+                    || (it->generation == victim->generation && it->lastUsed < victim->lastUsed))
+                victim = it;
+        }
+        if (victim == m_entries.end())
+            return false;
+
+        if (reusable && !*reusable && victim->buffer && victim->dst_width == width && victim->dst_height == height)
+            *reusable = victim->buffer;
+        m_entries.erase(victim);
+    }
+    return true;
+}
+
+rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>> SoftScaledFrameCache::getFreeBuffer(uint32_t width, uint32_t height)
+{
+    rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>> buffer;
+    if (!makeRoom(width, height, &buffer)) {
+        ELOG_WARN("No free scaled frame buffer");
         return NULL;
+    }
 
-    return m_busyFrame;
+    if (!buffer)
+        buffer = new rtc::RefCountedObject<webrtc::I420Buffer>(width, height);
+    return buffer;
+}
+
+void SoftScaledFrameCache::clear()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_entries.clear();
 }
 
 DEFINE_LOGGER(SoftFrameGenerator, "mcu.media.SoftVideoCompositor.SoftFrameGenerator");
@@ -257,7 +669,15 @@ SoftFrameGenerator::SoftFrameGenerator(
     , m_bgColor(bgColor)
     , m_crop(crop)
     , m_configureChanged(false)
-    , m_parallelNum(0)
+    , m_lastComposite(-1)
+    , m_fullRepaint(true)
+    , m_compositedFrames(0)
+    , m_compositionTimeUs(0)
+    , m_maxCompositionTimeUs(0)
+    , m_statsStartMs(0)
+    , m_statsFrames(0)
+    , m_statsTotalLatencyUs(0)
+    , m_statsMaxLatencyUs(0)
 {
     ELOG_DEBUG_T("Support fps max(%d), min(%d)", m_maxSupportedFps, m_minSupportedFps);
 
@@ -281,28 +701,11 @@ SoftFrameGenerator::SoftFrameGenerator(
 
     m_outputs.resize(m_maxSupportedFps / m_minSupportedFps);
 
-    m_bufferManager.reset(new I420BufferManager(1));
-
-    // parallet composition
-    uint32_t nThreads = boost::thread::hardware_concurrency();
-    m_parallelNum = nThreads / 2;
-    if (m_parallelNum > 16)
-        m_parallelNum = 16;
-
-    ELOG_DEBUG_T("hardware concurrency %d, parallel composition num %d", nThreads, m_parallelNum);
-
-    if (m_parallelNum > 1) {
-        m_srv       = boost::make_shared<boost::asio::io_service>();
-        m_srvWork   = boost::make_shared<boost::asio::io_service::work>(*m_srv);
-        m_thrGrp    = boost::make_shared<boost::thread_group>();
-
-        for (uint32_t i = 0; i < m_parallelNum; i++)
-            m_thrGrp->create_thread(boost::bind(&boost::asio::io_service::run, m_srv));
-    }
+    m_pool = m_owner->m_pool;
 
     m_textDrawer.reset(new owt_base::FFmpegDrawText());
 
-    m_jobTimer.reset(new JobTimer(m_maxSupportedFps, this));
+    m_jobTimer.reset(new JobTimer(m_maxSupportedFps, this, owt_base::IOScheduler::compute()));
     m_jobTimer->start();
 }
 
@@ -310,19 +713,6 @@ SoftFrameGenerator::~SoftFrameGenerator()
 {
     ELOG_DEBUG_T("Exit");
 
-    if (m_srvWork)
-        m_srvWork.reset();
-
-    if (m_srv) {
-        m_srv->stop();
-        m_srv.reset();
-    }
-
-    if (m_thrGrp) {
-        m_thrGrp->join_all();
-        m_thrGrp.reset();
-    }
-
     m_jobTimer->stop();
 
     for (uint32_t i = 0; i <  m_outputs.size(); i++) {
@@ -399,7 +789,9 @@ void SoftFrameGenerator::onTimeout()
     }
 
     if (hasValidOutput) {
+        auto start = std::chrono::steady_clock::now();
         rtc::scoped_refptr<webrtc::VideoFrameBuffer> compositeBuffer = generateFrame();
+        updateCompositionStats(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
         if (compositeBuffer) {
             webrtc::VideoFrame compositeFrame(
                     compositeBuffer,
@@ -439,139 +831,329 @@ void SoftFrameGenerator::onTimeout()
     m_counter = (m_counter + 1) % m_counterMax;
 }
 
+void SoftFrameGenerator::updateCompositionStats(int64_t latencyUs)
+{
+    int64_t nowMs = m_clock->TimeInMilliseconds();
+
+    ELOG_TRACE_T("Composition latency %ldus", latencyUs);
+
+    m_compositedFrames++;
+    m_compositionTimeUs = latencyUs;
+    if (latencyUs > m_maxCompositionTimeUs)
+        m_maxCompositionTimeUs = latencyUs;
+
+    m_statsFrames++;
+    m_statsTotalLatencyUs += latencyUs;
+    if (latencyUs > m_statsMaxLatencyUs)
+        m_statsMaxLatencyUs = latencyUs;
+
+    if (m_statsStartMs == 0) {
+        m_statsStartMs = nowMs;
+    } else if (nowMs - m_statsStartMs >= kCompositionStatsIntervalMs) {
+        ELOG_DEBUG_T("Composition latency of %u frames, avg %ldus, max %ldus",
+                m_statsFrames, m_statsTotalLatencyUs / m_statsFrames, m_statsMaxLatencyUs);
+
+        m_statsStartMs = nowMs;
+        m_statsFrames = 0;
+        m_statsTotalLatencyUs = 0;
+        m_statsMaxLatencyUs = 0;
+    }
+}
+
+void SoftFrameGenerator::getStats(VideoCompositorStats& stats)
+{
+    stats.compositedFrames = m_compositedFrames;
+    stats.compositionTimeUs = m_compositionTimeUs;
+    stats.maxCompositionTimeUs = m_maxCompositionTimeUs;
+}
+
 rtc::scoped_refptr<webrtc::VideoFrameBuffer> SoftFrameGenerator::generateFrame()
 {
     reconfigureIfNeeded();
     return layout();
 }
 
-void SoftFrameGenerator::layout_regions(SoftFrameGenerator *t, rtc::scoped_refptr<webrtc::I420Buffer> compositeBuffer, const LayoutSolution &regions)
+bool SoftFrameGenerator::getRegionJob(const InputRegion &inputRegion, uint64_t *generation, RegionJob *job)
 {
-    uint32_t composite_width = compositeBuffer->width();
-    uint32_t composite_height = compositeBuffer->height();
+    *generation = 0;
+    boost::shared_ptr<webrtc::VideoFrame> inputFrame = m_owner->getInputFrame(inputRegion.input, generation);
+    if (inputFrame == NULL) {
+        *generation = 0;
+        return false;
+    }
 
-    for (LayoutSolution::const_iterator it = regions.begin(); it != regions.end(); ++it) {
-        boost::shared_ptr<webrtc::VideoFrame> inputFrame = t->m_owner->getInputFrame(it->input);
-        if (inputFrame == NULL) {
-            continue;
-        }
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> inputBuffer = inputFrame->video_frame_buffer();
+    uint32_t composite_width = m_size.width;
+    uint32_t composite_height = m_size.height;
+
+    const Region &region = inputRegion.region;
+    uint32_t dst_x      = (uint64_t)composite_width * region.area.rect.left.numerator / region.area.rect.left.denominator;
+    uint32_t dst_y      = (uint64_t)composite_height * region.area.rect.top.numerator / region.area.rect.top.denominator;
+    uint32_t dst_width  = (uint64_t)composite_width * region.area.rect.width.numerator / region.area.rect.width.denominator;
+    uint32_t dst_height = (uint64_t)composite_height * region.area.rect.height.numerator / region.area.rect.height.denominator;
+
+    if (dst_x + dst_width > composite_width)
+        dst_width = composite_width - dst_x;
+
+    if (dst_y + dst_height > composite_height)
+        dst_height = composite_height - dst_y;
+
+    uint32_t cropped_dst_width;
+    uint32_t cropped_dst_height;
+    uint32_t src_x;
+    uint32_t src_y;
+    uint32_t src_width;
+    uint32_t src_height;
+    if (m_crop) {
+        src_width   = std::min((uint32_t)inputBuffer->width(), dst_width * inputBuffer->height() / dst_height);
+        src_height  = std::min((uint32_t)inputBuffer->height(), dst_height * inputBuffer->width() / dst_width);
+        src_x       = (inputBuffer->width() - src_width) / 2;
+        src_y       = (inputBuffer->height() - src_height) / 2;
+
+        cropped_dst_width   = dst_width;
+        cropped_dst_height  = dst_height;
+    } else {
+        src_width   = inputBuffer->width();
+        src_height  = inputBuffer->height();
+        src_x       = 0;
+        src_y       = 0;
 
-        rtc::scoped_refptr<webrtc::VideoFrameBuffer> inputBuffer = inputFrame->video_frame_buffer();
-
-        Region region = it->region;
-        uint32_t dst_x      = (uint64_t)composite_width * region.area.rect.left.numerator / region.area.rect.left.denominator;
-        uint32_t dst_y      = (uint64_t)composite_height * region.area.rect.top.numerator / region.area.rect.top.denominator;
-        uint32_t dst_width  = (uint64_t)composite_width * region.area.rect.width.numerator / region.area.rect.width.denominator;
-        uint32_t dst_height = (uint64_t)composite_height * region.area.rect.height.numerator / region.area.rect.height.denominator;
-
-        if (dst_x + dst_width > composite_width)
-            dst_width = composite_width - dst_x;
-
-        if (dst_y + dst_height > composite_height)
-            dst_height = composite_height - dst_y;
-
-        uint32_t cropped_dst_width;
-        uint32_t cropped_dst_height;
-        uint32_t src_x;
-        uint32_t src_y;
-        uint32_t src_width;
-        uint32_t src_height;
-        if (t->m_crop) {
-            src_width   = std::min((uint32_t)inputBuffer->width(), dst_width * inputBuffer->height() / dst_height);
-            src_height  = std::min((uint32_t)inputBuffer->height(), dst_height * inputBuffer->width() / dst_width);
-            src_x       = (inputBuffer->width() - src_width) / 2;
-            src_y       = (inputBuffer->height() - src_height) / 2;
-
-            cropped_dst_width   = dst_width;
-            cropped_dst_height  = dst_height;
-        } else {
-            src_width   = inputBuffer->width();
-            src_height  = inputBuffer->height();
-            src_x       = 0;
-            src_y       = 0;
+        cropped_dst_width   = std::min(dst_width, inputBuffer->width() * dst_height / inputBuffer->height());
+        cropped_dst_height  = std::min(dst_height, inputBuffer->height() * dst_width / inputBuffer->width());
+    }
 
-            cropped_dst_width   = std::min(dst_width, inputBuffer->width() * dst_height / inputBuffer->height());
-            cropped_dst_height  = std::min(dst_height, inputBuffer->height() * dst_width / inputBuffer->width());
-        }
+    dst_x += (dst_width - cropped_dst_width) / 2;
+    dst_y += (dst_height - cropped_dst_height) / 2;
+
+    job->input      = inputRegion.input;
+    job->generation = *generation;
+    job->frame      = inputFrame;
+    job->src_x      = src_x & ~1;
+    job->src_y      = src_y & ~1;
+    job->src_width  = src_width & ~1;
+    job->src_height = src_height & ~1;
+    job->dst_x      = dst_x & ~1;
+    job->dst_y      = dst_y & ~1;
+    job->dst_width  = cropped_dst_width & ~1;
+    job->dst_height = cropped_dst_height & ~1;
+    return true;
+}
 
-        dst_x += (dst_width - cropped_dst_width) / 2;
-        dst_y += (dst_height - cropped_dst_height) / 2;
+void SoftFrameGenerator::scale_region(SoftFrameGenerator *t, RegionJob *job)
+{
+    // Null if scaled right into the target, nothing left to paint then.
+    job->buffer = t->m_owner->getScaledFrame(job->input, job->frame, job->generation,
+            job->src_x, job->src_y, job->src_width, job->src_height,
+            job->dst_width, job->dst_height, job->target, job->dst_x, job->dst_y);
+    job->buffer_x = 0;
+    job->buffer_y = 0;
+}
 
-        src_x               &= ~1;
-        src_y               &= ~1;
-        src_width           &= ~1;
-        src_height          &= ~1;
-        dst_x               &= ~1;
-        dst_y               &= ~1;
-        cropped_dst_width   &= ~1;
-        cropped_dst_height  &= ~1;
+// Paints the rows [top, bottom) of the composite, the regions in order.
+void SoftFrameGenerator::layout_regions(SoftFrameGenerator *t, rtc::scoped_refptr<webrtc::I420Buffer> compositeBuffer, const std::vector<RegionJob> &jobs,
+        uint32_t top, uint32_t bottom)
+{
+    for (auto& job : jobs) {
+        uint32_t dst_top = std::max(top, job.dst_y);
+        uint32_t dst_bottom = std::min(bottom, job.dst_y + job.dst_height);
+        if (!job.buffer || dst_top >= dst_bottom)
+            continue;
 
-        int ret = libyuv::I420Scale(
+        rtc::scoped_refptr<webrtc::VideoFrameBuffer> inputBuffer = job.buffer;
+        uint32_t src_x = job.buffer_x;
+        uint32_t src_y = job.buffer_y + dst_top - job.dst_y;
+        int ret = libyuv::I420Copy(
                 inputBuffer->DataY() + src_y * inputBuffer->StrideY() + src_x, inputBuffer->StrideY(),
                 inputBuffer->DataU() + (src_y * inputBuffer->StrideU() + src_x) / 2, inputBuffer->StrideU(),
                 inputBuffer->DataV() + (src_y * inputBuffer->StrideV() + src_x) / 2, inputBuffer->StrideV(),
-                src_width, src_height,
-                compositeBuffer->MutableDataY() + dst_y * compositeBuffer->StrideY() + dst_x, compositeBuffer->StrideY(),
-                compositeBuffer->MutableDataU() + (dst_y * compositeBuffer->StrideU() + dst_x) / 2, compositeBuffer->StrideU(),
-                compositeBuffer->MutableDataV() + (dst_y * compositeBuffer->StrideV() + dst_x) / 2, compositeBuffer->StrideV(),
-                cropped_dst_width, cropped_dst_height,
-                libyuv::kFilterBox);
+                compositeBuffer->MutableDataY() + dst_top * compositeBuffer->StrideY() + job.dst_x, compositeBuffer->StrideY(),
+                compositeBuffer->MutableDataU() + (dst_top * compositeBuffer->StrideU() + job.dst_x) / 2, compositeBuffer->StrideU(),
+                compositeBuffer->MutableDataV() + (dst_top * compositeBuffer->StrideV() + job.dst_x) / 2, compositeBuffer->StrideV(),
+                job.dst_width, dst_bottom - dst_top);
         if (ret != 0)
-            ELOG_ERROR("I420Scale failed, ret %d", ret);
+            ELOG_ERROR("I420Copy failed, ret %d", ret);
     }
 }
 
-rtc::scoped_refptr<webrtc::VideoFrameBuffer> SoftFrameGenerator::layout()
+// Returns the index of the buffer to compose into, which is the last
+// composite itself if the outputs released it, -1 if all are in use.
+int SoftFrameGenerator::getCompositeBuffer()
 {
-    rtc::scoped_refptr<webrtc::I420Buffer> compositeBuffer = m_bufferManager->getFreeBuffer(m_size.width, m_size.height);
-    if (!compositeBuffer) {
-        ELOG_ERROR("No valid composite buffer");
-        return NULL;
+    if (m_lastComposite >= 0 && m_compositeBuffers[m_lastComposite]->HasOneRef())
+        return m_lastComposite;
+
+    for (size_t i = 0; i < m_compositeBuffers.size(); ++i) {
+        if ((int)i != m_lastComposite && m_compositeBuffers[i]->HasOneRef())
+            return i;
     }
 
-    // Set the background color
-    libyuv::I420Rect(
-            compositeBuffer->MutableDataY(), compositeBuffer->StrideY(),
-            compositeBuffer->MutableDataU(), compositeBuffer->StrideU(),
-            compositeBuffer->MutableDataV(), compositeBuffer->StrideV(),
-            0, 0, compositeBuffer->width(), compositeBuffer->height(),
-            m_bgColor.y, m_bgColor.cb, m_bgColor.cr);
+    if (m_compositeBuffers.size() < kMaxCompositeBuffers) {
+        m_compositeBuffers.push_back(new rtc::RefCountedObject<webrtc::I420Buffer>(m_size.width, m_size.height));
+        return m_compositeBuffers.size() - 1;
+    }
 
-    bool isParallelFrameComposition = m_parallelNum > 1 && m_layout.size() > 4;
+    return -1;
+}
 
-    if (isParallelFrameComposition) {
-        int nParallelRegions = (m_layout.size() + m_parallelNum - 1) / m_parallelNum;
-        int nRegions = m_layout.size();
+static bool isOverlapped(uint32_t x1, uint32_t y1, uint32_t w1, uint32_t h1, uint32_t x2, uint32_t y2, uint32_t w2, uint32_t h2)
+{
+    return x1 < x2 + w2 && x2 < x1 + w1 && y1 < y2 + h2 && y2 < y1 + h1;
+}
 
-        LayoutSolution::iterator regions_begin = m_layout.begin();
-        LayoutSolution::iterator regions_end = m_layout.begin();
+rtc::scoped_refptr<webrtc::VideoFrameBuffer> SoftFrameGenerator::layout()
+{
+    uint32_t nRegions = m_layout.size();
+    std::vector<RegionJob> jobs(nRegions);
+    std::vector<uint64_t> generations(nRegions, 0);
+    std::vector<bool> dirty(nRegions, false);
+
+    // Text is drawn onto the composite, which can not be updated incrementally then.
+    bool fullRepaint = m_fullRepaint || m_lastComposite < 0 || m_textDrawer->isEnabled() || m_regionStates.size() != nRegions;
+
+    uint32_t i = 0;
+    for (auto it = m_layout.begin(); it != m_layout.end(); ++it, ++i) {
+        bool hasFrame = getRegionJob(*it, &generations[i], &jobs[i]);
+        if (fullRepaint) {
+            dirty[i] = hasFrame;
+            continue;
+        }
 
-        std::vector<boost::shared_ptr<boost::packaged_task<void>>> tasks;
-        while (nRegions > 0) {
-            if (nRegions < nParallelRegions)
-                nParallelRegions = nRegions;
+        const RegionState &state = m_regionStates[i];
+        if (generations[i] == state.generation)
+            continue;
 
-            regions_begin = regions_end;
-            advance(regions_end, nParallelRegions);
+        if (!hasFrame
+                || (state.generation != 0
+                    && (jobs[i].dst_x != state.x || jobs[i].dst_y != state.y
+                        || jobs[i].dst_width != state.width || jobs[i].dst_height != state.height))) {
+            // Something else has to show where this input was.
+            fullRepaint = true;
+            for (uint32_t j = 0; j <= i; ++j)
+                dirty[j] = (generations[j] != 0);
+            continue;
+        }
+        dirty[i] = true;
+    }
 
-            boost::shared_ptr<boost::packaged_task<void>> task = boost::make_shared<boost::packaged_task<void>>(
-                    boost::bind(SoftFrameGenerator::layout_regions,
-                        this,
-                        compositeBuffer,
-                        LayoutSolution(regions_begin, regions_end))
-                    );
-            m_srv->post(boost::bind(&boost::packaged_task<void>::operator(), task));
-            tasks.push_back(task);
+    if (!fullRepaint) {
+        // The regions painted after a dirty one stay on top of it.
+        for (i = 0; i < nRegions; ++i) {
+            if (!dirty[i])
+                continue;
+            for (uint32_t j = i + 1; j < nRegions; ++j) {
+                if (generations[j] != 0 && isOverlapped(jobs[i].dst_x, jobs[i].dst_y, jobs[i].dst_width, jobs[i].dst_height,
+                            jobs[j].dst_x, jobs[j].dst_y, jobs[j].dst_width, jobs[j].dst_height))
+                    dirty[j] = true;
+            }
+        }
 
-            nRegions -= nParallelRegions;
+        if (std::find(dirty.begin(), dirty.end(), true) == dirty.end()) {
+            ELOG_TRACE_T("No region changed, reuse the last composite");
+            return m_compositeBuffers[m_lastComposite];
         }
+    }
 
-        for (auto& task : tasks)
-            task->get_future().wait();
-    } else {
-        layout_regions(this, compositeBuffer, m_layout);
+    int index = getCompositeBuffer();
+    if (index < 0) {
+        ELOG_ERROR("No valid composite buffer");
+        return NULL;
+    }
+    rtc::scoped_refptr<webrtc::I420Buffer> compositeBuffer = m_compositeBuffers[index];
+
+    if (fullRepaint) {
+        // Set the background color
+        libyuv::I420Rect(
+                compositeBuffer->MutableDataY(), compositeBuffer->StrideY(),
+                compositeBuffer->MutableDataU(), compositeBuffer->StrideU(),
+                compositeBuffer->MutableDataV(), compositeBuffer->StrideV(),
+                0, 0, compositeBuffer->width(), compositeBuffer->height(),
+                m_bgColor.y, m_bgColor.cb, m_bgColor.cr);
+    } else if (index != m_lastComposite) {
+        // The outputs still hold the last composite, start from a copy of it.
+        rtc::scoped_refptr<webrtc::I420Buffer> lastBuffer = m_compositeBuffers[m_lastComposite];
+        libyuv::I420Copy(
+                lastBuffer->DataY(), lastBuffer->StrideY(),
+                lastBuffer->DataU(), lastBuffer->StrideU(),
+                lastBuffer->DataV(), lastBuffer->StrideV(),
+                compositeBuffer->MutableDataY(), compositeBuffer->StrideY(),
+                compositeBuffer->MutableDataU(), compositeBuffer->StrideU(),
+                compositeBuffer->MutableDataV(), compositeBuffer->StrideV(),
+                compositeBuffer->width(), compositeBuffer->height());
     }
 
+    std::vector<RegionJob> dirtyJobs;
+    m_regionStates.resize(nRegions);
+    for (i = 0; i < nRegions; ++i) {
+        if (dirty[i])
+            dirtyJobs.push_back(jobs[i]);
+
+        m_regionStates[i].generation = generations[i];
+        m_regionStates[i].x = jobs[i].dst_x;
+        m_regionStates[i].y = jobs[i].dst_y;
+        m_regionStates[i].width = jobs[i].dst_width;
+        m_regionStates[i].height = jobs[i].dst_height;
+    }
+    m_lastComposite = index;
+    m_fullRepaint = false;
+
+    ELOG_TRACE_T("Repaint %zu/%u regions%s", dirtyJobs.size(), nRegions, fullRepaint ? " and background" : "");
+
+    // Scale the regions first, the large ones in stripes, then split the
+    // composite into bands of about the same dirty area. Each band paints the
+    // regions in order, so overlapping ones stay on top of each other.
+    std::vector<SoftCompositionPool::Task> tasks;
+    for (auto& job : dirtyJobs) {
+        if (job.src_width != job.dst_width || job.src_height != job.dst_height) {
+            // Scaled right into the composite unless painted over by
+            // another region, as the regions are scaled concurrently.
+            bool overlapped = false;
+            for (auto& other : dirtyJobs) {
+                if (&other != &job && isOverlapped(job.dst_x, job.dst_y, job.dst_width, job.dst_height,
+                            other.dst_x, other.dst_y, other.dst_width, other.dst_height)) {
+                    overlapped = true;
+                    break;
+                }
+            }
+            if (!overlapped)
+                job.target = compositeBuffer;
+            tasks.push_back(boost::bind(SoftFrameGenerator::scale_region, this, &job));
+        } else {
+            job.buffer = job.frame->video_frame_buffer();
+            job.buffer_x = job.src_x;
+            job.buffer_y = job.src_y;
+        }
+    }
+    m_pool->run(tasks);
+    tasks.clear();
+
+    std::vector<uint32_t> rowPixels(m_size.height / 2, 0);
+    uint32_t dirtyPixels = 0;
+    for (auto& job : dirtyJobs) {
+        if (!job.buffer)
+            continue;
+        for (uint32_t y = job.dst_y / 2; y < (job.dst_y + job.dst_height) / 2 && y < rowPixels.size(); ++y)
+            rowPixels[y] += 2 * job.dst_width;
+        dirtyPixels += job.dst_width * job.dst_height;
+    }
+
+    uint32_t nBands = m_pool->getTaskCount(dirtyPixels);
+    if (nBands == 1)
+        rowPixels.assign(1, 0);
+    uint32_t top = 0;
+    uint32_t pixels = 0;
+    for (uint32_t y = 0; y < rowPixels.size(); ++y) {
+        pixels += rowPixels[y];
+        bool last = (y + 1 == rowPixels.size() || pixels >= dirtyPixels);
+        if (last || (uint64_t)pixels * nBands >= (uint64_t)dirtyPixels * (tasks.size() + 1)) {
+            uint32_t bottom = last ? m_size.height : 2 * (y + 1);
+            tasks.push_back(boost::bind(SoftFrameGenerator::layout_regions, this, compositeBuffer, boost::cref(dirtyJobs), top, bottom));
+            top = bottom;
+        }
+        if (last)
+            break;
+    }
+    m_pool->run(tasks);
+
     return compositeBuffer;
 }
 
@@ -586,6 +1168,9 @@ void SoftFrameGenerator::reconfigureIfNeeded()
         m_configureChanged = false;
     }
 
+    // The background shows through wherever a region goes away.
+    m_fullRepaint = true;
+
     ELOG_DEBUG_T("reconfigure");
 }
 
@@ -610,6 +1195,13 @@ SoftVideoCompositor::SoftVideoCompositor(uint32_t maxInput, VideoSize rootSize,
         input.reset(new SoftInput());
     }
 
+    m_pool = SoftCompositionPool::getInstance();
+
+    m_scaledFrameCaches.resize(m_maxInput);
+    for (auto& cache : m_scaledFrameCaches) {
+        cache.reset(new SoftScaledFrameCache(m_pool));
+    }
+
     m_avatarManager.reset(new AvatarManager(maxInput));
 
     m_generators.resize(2);
@@ -621,6 +1213,7 @@ SoftVideoCompositor::~SoftVideoCompositor()
 {
     m_generators.clear();
     m_avatarManager.reset();
+    m_scaledFrameCaches.clear();
     m_inputs.clear();
 }
 
@@ -652,6 +1245,7 @@ bool SoftVideoCompositor::activateInput(int input)
 void SoftVideoCompositor::deActivateInput(int input)
 {
     m_inputs[input]->setActive(false);
+    m_scaledFrameCaches[input]->clear();
 }
 
 bool SoftVideoCompositor::setAvatar(int input, const std::string& avatar)
@@ -700,20 +1294,30 @@ bool SoftVideoCompositor::removeOutput(owt_base::FrameDestination *dst)
     return false;
 }
 
-boost::shared_ptr<webrtc::VideoFrame> SoftVideoCompositor::getInputFrame(int index)
+boost::shared_ptr<webrtc::VideoFrame> SoftVideoCompositor::getInputFrame(int index, uint64_t *generation)
 {
     boost::shared_ptr<webrtc::VideoFrame> src;
 
     auto& input = m_inputs[index];
     if (input->isActive()) {
-        src = input->popInput();
+        src = input->popInput(generation);
     } else {
-        src = m_avatarManager->getAvatarFrame(index);
+        src = m_avatarManager->getAvatarFrame(index, generation);
     }
 
     return src;
 }
 
+rtc::scoped_refptr<webrtc::VideoFrameBuffer> SoftVideoCompositor::getScaledFrame(int index,
+        const boost::shared_ptr<webrtc::VideoFrame>& frame, uint64_t generation,
+        uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+        uint32_t dst_width, uint32_t dst_height,
+        rtc::scoped_refptr<webrtc::I420Buffer> target, uint32_t target_x, uint32_t target_y)
+{
+    return m_scaledFrameCaches[index]->getScaledFrame(frame, generation,
+            src_x, src_y, src_width, src_height, dst_width, dst_height, target, target_x, target_y);
+}
+
 void SoftVideoCompositor::drawText(const std::string& textSpec)
 {
     for (auto& generator : m_generators) {
@@ -728,4 +1332,18 @@ void SoftVideoCompositor::clearText()
     }
 }
 
+bool SoftVideoCompositor::getStats(VideoCompositorStats& stats)
+{
+    // The frames of all the generators, and the latency of the slowest.
+    memset(&stats, 0, sizeof(stats));
+    for (auto& generator : m_generators) {
+        VideoCompositorStats generatorStats;
+        generator->getStats(generatorStats);
+        stats.compositedFrames += generatorStats.compositedFrames;
+        stats.compositionTimeUs = std::max(stats.compositionTimeUs, generatorStats.compositionTimeUs);
+        stats.maxCompositionTimeUs = std::max(stats.maxCompositionTimeUs, generatorStats.maxCompositionTimeUs);
+    }
+    return true;
+}
+
 }
@@ -5,13 +5,17 @@
 #ifndef SoftVideoCompositor_h
 #define SoftVideoCompositor_h
 
+#include <atomic>
+#include <deque>
 #include <vector>
 
+#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
+#include <webrtc/base/refcount.h>
 #include <webrtc/system_wrappers/include/clock.h>
 #include <webrtc/api/video/video_frame.h>
 #include <webrtc/api/video/i420_buffer.h>
@@ -28,6 +32,66 @@
 namespace mcu {
 class SoftVideoCompositor;
 
+// Returns a process wide unique number identifying a composition input frame,
+// so that the generators can tell whether an input changed since the last tick.
+uint64_t nextFrameGeneration();
+
+/**
+ * Work stealing thread pool composing the frames of all the generators in
+ * the process. Each worker runs the tasks of its own queue and steals from
+ * the others when empty, the thread waiting for a batch of tasks helps too,
+ * with the tasks of its batch only: a task running a nested batch, e.g. a
+ * region scaled in stripes, never ends up running an unrelated task that
+ * may block on what the outer one holds.
+ */
+class SoftCompositionPool {
+    DECLARE_LOGGER();
+
+public:
+    typedef boost::function<void()> Task;
+
+    static boost::shared_ptr<SoftCompositionPool> getInstance();
+    ~SoftCompositionPool();
+
+    uint32_t size() { return m_workers.size(); }
+    // The number of tasks the composition of so many pixels should be split into.
+    uint32_t getTaskCount(uint32_t pixels);
+    // Runs the tasks on the pool and the calling thread, returns when all are done.
+    void run(const std::vector<Task>& tasks);
+
+private:
+    struct Batch {
+        uint32_t pending;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+    };
+
+    struct Item {
+        Task task;
+        Batch *batch;
+    };
+
+    struct Worker {
+        std::deque<Item> queue;
+        boost::mutex mutex;
+    };
+
+    SoftCompositionPool(uint32_t nThreads);
+
+    void workerLoop(uint32_t index);
+    // Only the items of batch if not null.
+    bool popItem(uint32_t index, Item *item, Batch *batch = NULL);
+    void execute(Item &item);
+
+    std::vector<boost::shared_ptr<Worker>> m_workers;
+    boost::thread_group m_threads;
+    uint32_t m_nextWorker;
+    int32_t m_queued;
+    bool m_running;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+};
+
 class AvatarManager {
     DECLARE_LOGGER();
 
@@ -38,7 +102,7 @@ public:
     bool setAvatar(uint8_t index, const std::string &url);
     bool unsetAvatar(uint8_t index);
 
-    boost::shared_ptr<webrtc::VideoFrame> getAvatarFrame(uint8_t index);
+    boost::shared_ptr<webrtc::VideoFrame> getAvatarFrame(uint8_t index, uint64_t *generation = NULL);
 
 protected:
     bool getImageSize(const std::string &url, uint32_t *pWidth, uint32_t *pHeight);
@@ -49,6 +113,7 @@ private:
 
     std::map<uint8_t, std::string> m_inputs;
     std::map<std::string, boost::shared_ptr<webrtc::VideoFrame>> m_frames;
+    std::map<std::string, uint64_t> m_generations;
 
     boost::shared_mutex m_mutex;
 };
@@ -64,16 +129,96 @@ public:
     bool isActive(void);
 
     void pushInput(webrtc::VideoFrame *videoFrame);
-    boost::shared_ptr<webrtc::VideoFrame> popInput();
+    boost::shared_ptr<webrtc::VideoFrame> popInput(uint64_t *generation = NULL);
 
 private:
     bool m_active;
     boost::shared_ptr<webrtc::VideoFrame> m_busyFrame;
+    uint64_t m_busyFrameGeneration;
     boost::shared_mutex m_mutex;
+};
 
-    boost::scoped_ptr<owt_base::I420BufferManager> m_bufferManager;
+/**
+ * Scaled copies of the current frame of an input, so that the generators
+ * and the layout regions showing the input at the same size scale it once.
+ * Entries are keyed by frame generation, source area and target size.
+ * An entry is reserved before being scaled without the lock held, the
+ * others asking for it in the meantime wait for it to be done.
+ * A frame only one region asked for last time is scaled right into the
+ * region's target instead, saving the copy out of the cache.
+ */
+class SoftScaledFrameCache {
+    DECLARE_LOGGER();
+
+    struct Scaling {
+        bool done;
+        boost::condition_variable cond;
+    };
+
+    struct Entry {
+        uint64_t generation;
+        uint32_t src_x;
+        uint32_t src_y;
+        uint32_t src_width;
+        uint32_t src_height;
+        uint32_t dst_width;
+        uint32_t dst_height;
+        uint32_t lastUsed;
+        // The regions that asked for it.
+        uint32_t consumers;
+        // Null if scaled into the target of its only consumer.
+        rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>> buffer;
+        // Of the entry being scaled, null once done.
+        boost::shared_ptr<Scaling> scaling;
+    };
+
+    // The src area of a frame scaled to the dst area of a buffer.
+    struct ScaleJob {
+        rtc::scoped_refptr<webrtc::VideoFrameBuffer> src;
+        uint32_t src_x;
+        uint32_t src_y;
+        uint32_t src_width;
+        uint32_t src_height;
+        rtc::scoped_refptr<webrtc::I420Buffer> dst;
+        uint32_t dst_x;
+        uint32_t dst_y;
+        uint32_t dst_width;
+        uint32_t dst_height;
+    };
+
+public:
+    SoftScaledFrameCache(boost::shared_ptr<SoftCompositionPool> pool);
+    ~SoftScaledFrameCache();
+
+    // Returns null if the frame was scaled into the area of the target at
+    // target_x, target_y, if any, or on failure.
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> getScaledFrame(
+            const boost::shared_ptr<webrtc::VideoFrame>& frame, uint64_t generation,
+            uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+            uint32_t dst_width, uint32_t dst_height,
+            rtc::scoped_refptr<webrtc::I420Buffer> target = NULL, uint32_t target_x = 0, uint32_t target_y = 0);
+    void clear();
 
-    boost::scoped_ptr<owt_base::FrameConverter> m_converter;
+private:
+    bool isSingleConsumer(uint64_t generation, uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+            uint32_t dst_width, uint32_t dst_height);
+    bool makeRoom(uint32_t width, uint32_t height, rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>> *reusable);
+    rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>> getFreeBuffer(uint32_t width, uint32_t height);
+    void scale(const boost::shared_ptr<webrtc::VideoFrame>& frame,
+            uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+            rtc::scoped_refptr<webrtc::I420Buffer> dst, uint32_t dst_x, uint32_t dst_y, uint32_t dst_width, uint32_t dst_height);
+    static void scaleStripe(const ScaleJob& job, uint32_t stripe_y, uint32_t stripe_height);
+
+    boost::shared_ptr<SoftCompositionPool> m_pool;
+    std::vector<Entry> m_entries;
+    // The last two generations asked for, the ones the generators may still need.
+    uint64_t m_latestGeneration;
+    uint64_t m_previousGeneration;
+    uint32_t m_useCounter;
+    uint64_t m_hits;
+    uint64_t m_misses;
+    uint64_t m_directScales;
+    boost::mutex m_mutex;
 };
 
 class SoftFrameGenerator : public JobTimerListener
@@ -89,6 +234,36 @@ class SoftFrameGenerator : public JobTimerListener
         owt_base::FrameDestination *dest;
     };
 
+    // What is painted in a layout region of the last composite.
+    struct RegionState {
+        uint64_t generation; // 0 if nothing
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // A region to be painted, the input frame scaled from the src to the dst area.
+    struct RegionJob {
+        int input;
+        uint64_t generation;
+        boost::shared_ptr<webrtc::VideoFrame> frame;
+        uint32_t src_x;
+        uint32_t src_y;
+        uint32_t src_width;
+        uint32_t src_height;
+        uint32_t dst_x;
+        uint32_t dst_y;
+        uint32_t dst_width;
+        uint32_t dst_height;
+        // What is copied to the dst area, the scaled frame if any.
+        rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer;
+        uint32_t buffer_x;
+        uint32_t buffer_y;
+        // The composite to scale right into, if no other dirty region overlaps.
+        rtc::scoped_refptr<webrtc::I420Buffer> target;
+    };
+
 public:
     SoftFrameGenerator(
             SoftVideoCompositor *owner,
@@ -110,14 +285,22 @@ public:
     void drawText(const std::string& textSpec);
     void clearText();
 
+    void getStats(VideoCompositorStats& stats);
+
     void onTimeout() override;
 
 protected:
     rtc::scoped_refptr<webrtc::VideoFrameBuffer> generateFrame();
     rtc::scoped_refptr<webrtc::VideoFrameBuffer> layout();
-    static void layout_regions(SoftFrameGenerator *t, rtc::scoped_refptr<webrtc::I420Buffer> compositeBuffer, const LayoutSolution &regions);
+    static void scale_region(SoftFrameGenerator *t, RegionJob *job);
+    static void layout_regions(SoftFrameGenerator *t, rtc::scoped_refptr<webrtc::I420Buffer> compositeBuffer, const std::vector<RegionJob> &jobs,
+            uint32_t top, uint32_t bottom);
+
+    bool getRegionJob(const InputRegion &inputRegion, uint64_t *generation, RegionJob *job);
+    int getCompositeBuffer();
 
     void reconfigureIfNeeded();
+    void updateCompositionStats(int64_t latencyUs);
 
 private:
     const webrtc::Clock *m_clock;
@@ -143,15 +326,29 @@ private:
     bool                        m_configureChanged;
     boost::shared_mutex         m_configMutex;
 
-    boost::scoped_ptr<owt_base::I420BufferManager> m_bufferManager;
+    // incremental composition, only the regions whose input changed are
+    // repainted onto the last composite
+    // Explicitly use a RefCountedObject to get access to HasOneRef,
+    // which tells whether the outputs still hold the buffer.
+    std::vector<rtc::scoped_refptr<rtc::RefCountedObject<webrtc::I420Buffer>>> m_compositeBuffers;
+    int m_lastComposite;
+    std::vector<RegionState> m_regionStates;
+    bool m_fullRepaint;
 
     boost::scoped_ptr<JobTimer> m_jobTimer;
 
     // parallel composition
-    uint32_t m_parallelNum;
-    boost::shared_ptr<boost::asio::io_service> m_srv;
-    boost::shared_ptr<boost::asio::io_service::work> m_srvWork;
-    boost::shared_ptr<boost::thread_group> m_thrGrp;
+    boost::shared_ptr<SoftCompositionPool> m_pool;
+
+    // composition latency, for getStats
+    std::atomic<uint32_t> m_compositedFrames;
+    std::atomic<uint32_t> m_compositionTimeUs;
+    std::atomic<uint32_t> m_maxCompositionTimeUs;
+    // and logged periodically
+    int64_t m_statsStartMs;
+    uint32_t m_statsFrames;
+    int64_t m_statsTotalLatencyUs;
+    int64_t m_statsMaxLatencyUs;
 
     boost::shared_ptr<owt_base::FFmpegDrawText> m_textDrawer;
 };
@@ -185,15 +382,24 @@ public:
     void drawText(const std::string& textSpec);
     void clearText();
 
+    bool getStats(VideoCompositorStats& stats) override;
+
 protected:
-    boost::shared_ptr<webrtc::VideoFrame> getInputFrame(int index);
+    boost::shared_ptr<webrtc::VideoFrame> getInputFrame(int index, uint64_t *generation = NULL);
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> getScaledFrame(int index,
+            const boost::shared_ptr<webrtc::VideoFrame>& frame, uint64_t generation,
+            uint32_t src_x, uint32_t src_y, uint32_t src_width, uint32_t src_height,
+            uint32_t dst_width, uint32_t dst_height,
+            rtc::scoped_refptr<webrtc::I420Buffer> target, uint32_t target_x, uint32_t target_y);
 
 private:
     uint32_t m_maxInput;
 
     std::vector<boost::shared_ptr<SoftFrameGenerator>> m_generators;
 
+    boost::shared_ptr<SoftCompositionPool> m_pool;
     std::vector<boost::shared_ptr<SoftInput>> m_inputs;
+    std::vector<boost::shared_ptr<SoftScaledFrameCache>> m_scaledFrameCaches;
     boost::scoped_ptr<AvatarManager> m_avatarManager;
 };
 
@@ -10,6 +10,12 @@
 
 namespace mcu {
 
+struct VideoCompositorStats {
+    uint32_t compositedFrames;
+    uint32_t compositionTimeUs;     // of the last composited frame
+    uint32_t maxCompositionTimeUs;
+};
+
 // VideoFrameCompositor accepts the raw I420VideoFrame from multiple inputs and
 // composites them into one I420VideoFrame with the given VideoLayout.
 // The composited I420VideoFrame will be handed over to one VideoFrameConsumer.
@@ -27,6 +33,8 @@ public:
 
     virtual void drawText(const std::string& textSpec) = 0;
     virtual void clearText() = 0;
+
+    virtual bool getStats(VideoCompositorStats& stats) { return false; }
 };
 
 // VideoFrameMixer accepts frames from multiple inputs and mixes them.
@@ -36,6 +44,7 @@ public:
     virtual bool addInput(int input, owt_base::FrameFormat, owt_base::FrameSource*, const std::string& avatar) = 0;
     virtual void removeInput(int input) = 0;
     virtual void setInputActive(int input, bool active) = 0;
+    virtual bool getInputStats(int input, owt_base::VideoDecoderStats& stats) = 0;
 
     virtual bool addOutput(int output,
             owt_base::FrameFormat,
@@ -49,8 +58,10 @@ public:
 
     //virtual void setBitrate(unsigned short kbps, int output) = 0;
     virtual void requestKeyFrame(int output) = 0;
+    virtual bool getOutputStats(int output, owt_base::VideoEncoderStats& stats) = 0;
 
     virtual void updateLayoutSolution(LayoutSolution& solution) = 0;
+    virtual bool getCompositorStats(VideoCompositorStats& stats) = 0;
 
     virtual void drawText(const std::string& textSpec) = 0;
     virtual void clearText() = 0;
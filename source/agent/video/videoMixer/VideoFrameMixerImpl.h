@@ -8,9 +8,11 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/shared_mutex.hpp>
+#include <atomic>
 #include <map>
 #include <MediaUtilities.h>
 #include <MediaFramePipeline.h>
+#include <MediaFrameMulticaster.h>
 
 #include "SoftVideoCompositor.h"
 
@@ -53,6 +55,49 @@ private:
     boost::shared_ptr<VideoFrameCompositor> m_compositor;
 };
 
+// Fans an encoded stream out to all the outputs asking for the same one.
+class CompositeOut : public owt_base::MediaFrameMulticaster
+{
+public:
+    CompositeOut(uint32_t bitrateKbps) : m_subscribers(0), m_bitrateKbps(bitrateKbps) { }
+
+    void addSubscriber(owt_base::FrameDestination* dest) {
+        addVideoDestination(dest);
+        ++m_subscribers;
+    }
+
+    uint32_t removeSubscriber(owt_base::FrameDestination* dest) {
+        removeVideoDestination(dest);
+        return --m_subscribers;
+    }
+
+    uint32_t subscribers() { return m_subscribers; }
+
+    // The bitrate the stream is encoded at, as last retuned.
+    uint32_t bitrateKbps() { return m_bitrateKbps; }
+
+    void setBitrate(uint32_t kbps) {
+        owt_base::FeedbackMsg msg = {owt_base::VIDEO_FEEDBACK, owt_base::SET_BITRATE};
+        msg.data.kbps = kbps;
+        m_bitrateKbps = kbps;
+        deliverFeedbackMsg(msg);
+    }
+
+    void onFeedback(const owt_base::FeedbackMsg& msg) {
+        // A subscriber can't throttle the stream the others get.
+        if (msg.type == owt_base::VIDEO_FEEDBACK && msg.cmd == owt_base::SET_BITRATE) {
+            if (m_subscribers == 1)
+                setBitrate(msg.data.kbps);
+            return;
+        }
+        owt_base::MediaFrameMulticaster::onFeedback(msg);
+    }
+
+private:
+    std::atomic<uint32_t> m_subscribers;
+    std::atomic<uint32_t> m_bitrateKbps;
+};
+
 class VideoFrameMixerImpl : public VideoFrameMixer {
 public:
     VideoFrameMixerImpl(uint32_t maxInput, owt_base::VideoSize rootSize, owt_base::YUVColor bgColor, bool useSimulcast, bool crop);
@@ -61,6 +106,7 @@ public:
     bool addInput(int input, owt_base::FrameFormat, owt_base::FrameSource*, const std::string& avatar);
     void removeInput(int input);
     void setInputActive(int input, bool active);
+    bool getInputStats(int input, owt_base::VideoDecoderStats& stats);
 
     bool addOutput(int output,
             owt_base::FrameFormat,
@@ -73,8 +119,10 @@ public:
     void removeOutput(int output);
     void setBitrate(unsigned short kbps, int output);
     void requestKeyFrame(int output);
+    bool getOutputStats(int output, owt_base::VideoEncoderStats& stats);
 
     void updateLayoutSolution(LayoutSolution& solution);
+    bool getCompositorStats(VideoCompositorStats& stats);
 
     void drawText(const std::string& textSpec);
     void clearText();
@@ -86,11 +134,30 @@ private:
         boost::shared_ptr<CompositeIn> compositorIn;
     };
 
-    struct Output {
+    // An encoded stream, shared by the outputs of the same spec. Its bitrate
+    // is the one of the fanOut, which follows the retunes.
+    struct Stream {
         boost::shared_ptr<owt_base::VideoFrameEncoder> encoder;
         int streamId;
+        owt_base::FrameFormat format;
+        owt_base::VideoCodecProfile profile;
+        owt_base::VideoSize size;
+        unsigned int framerateFPS;
+        unsigned int keyFrameIntervalSeconds;
+        boost::shared_ptr<CompositeOut> fanOut;
+    };
+
+    struct Output {
+        boost::shared_ptr<Stream> stream;
+        owt_base::FrameDestination* dest;
     };
 
+    // With m_outputMutex held.
+    boost::shared_ptr<Stream> findStream(owt_base::FrameFormat, const owt_base::VideoCodecProfile, const owt_base::VideoSize&,
+            unsigned int framerateFPS, unsigned int bitrateKbps, unsigned int keyFrameIntervalSeconds);
+    boost::shared_ptr<Stream> generateStream(owt_base::FrameFormat, const owt_base::VideoCodecProfile, const owt_base::VideoSize&,
+            unsigned int framerateFPS, unsigned int bitrateKbps, unsigned int keyFrameIntervalSeconds);
+
     std::map<int, Input> m_inputs;
     boost::shared_mutex m_inputMutex;
 
@@ -119,8 +186,11 @@ VideoFrameMixerImpl::~VideoFrameMixerImpl()
     {
         boost::unique_lock<boost::shared_mutex> lock(m_outputMutex);
         for (auto it = m_outputs.begin(); it != m_outputs.end(); ++it) {
-            m_compositor->removeOutput(it->second.encoder.get());
-            it->second.encoder->degenerateStream(it->second.streamId);
+            boost::shared_ptr<Stream> stream = it->second.stream;
+            if (stream->fanOut->removeSubscriber(it->second.dest) == 0) {
+                m_compositor->removeOutput(stream->encoder.get());
+                stream->encoder->degenerateStream(stream->streamId);
+            }
         }
         m_outputs.clear();
     }
@@ -155,10 +225,10 @@ inline bool VideoFrameMixerImpl::addInput(int input, owt_base::FrameFormat forma
 #endif
 
     if (!decoder && owt_base::VCMFrameDecoder::supportFormat(format))
-        decoder.reset(new owt_base::VCMFrameDecoder(format));
+        decoder.reset(new owt_base::VCMFrameDecoder(format, true));
 
     if (!decoder && owt_base::FFmpegFrameDecoder::supportFormat(format))
-        decoder.reset(new owt_base::FFmpegFrameDecoder());
+        decoder.reset(new owt_base::FFmpegFrameDecoder(true));
 
     if (!decoder)
         return false;
@@ -204,52 +274,124 @@ inline void VideoFrameMixerImpl::setInputActive(int input, bool active)
     }
 }
 
+inline bool VideoFrameMixerImpl::getInputStats(int input, owt_base::VideoDecoderStats& stats)
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_inputMutex);
+    auto it = m_inputs.find(input);
+    if (it != m_inputs.end())
+        return it->second.decoder->getStats(stats);
+    return false;
+}
+
 inline void VideoFrameMixerImpl::updateLayoutSolution(LayoutSolution& solution)
 {
     m_compositor->updateLayoutSolution(solution);
 }
 
+inline bool VideoFrameMixerImpl::getCompositorStats(VideoCompositorStats& stats)
+{
+    return m_compositor->getStats(stats);
+}
+
 inline void VideoFrameMixerImpl::setBitrate(unsigned short kbps, int output)
 {
-    boost::shared_lock<boost::shared_mutex> lock(m_outputMutex);
+    boost::upgrade_lock<boost::shared_mutex> lock(m_outputMutex);
     auto it = m_outputs.find(output);
-    if (it != m_outputs.end())
-        it->second.encoder->setBitrate(kbps, it->second.streamId);
+    if (it == m_outputs.end())
+        return;
+
+    boost::shared_ptr<Stream> stream = it->second.stream;
+    if (stream->fanOut->subscribers() == 1) {
+        stream->fanOut->setBitrate(kbps);
+        return;
+    }
+
+    // The other outputs of the stream keep their bitrate, this one moves to
+    // a stream of its own.
+    if (stream->fanOut->bitrateKbps() == kbps)
+        return;
+
+    boost::shared_ptr<Stream> retuned = findStream(stream->format, stream->profile, stream->size,
+            stream->framerateFPS, kbps, stream->keyFrameIntervalSeconds);
+    if (!retuned) {
+        retuned = generateStream(stream->format, stream->profile, stream->size,
+                stream->framerateFPS, kbps, stream->keyFrameIntervalSeconds);
+        if (!retuned)
+            return;
+    }
+
+    stream->fanOut->removeSubscriber(it->second.dest);
+    retuned->fanOut->addSubscriber(it->second.dest);
+
+    boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
+    it->second.stream = retuned;
 }
 
 inline void VideoFrameMixerImpl::requestKeyFrame(int output)
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_outputMutex);
+    auto it = m_outputs.find(output);
+    if (it != m_outputs.end()) {
+        // Coalesced with the requests of the other outputs of the stream.
+        owt_base::FeedbackMsg msg = {owt_base::VIDEO_FEEDBACK, owt_base::REQUEST_KEY_FRAME};
+        it->second.stream->fanOut->onFeedback(msg);
+    }
+}
+
+inline bool VideoFrameMixerImpl::getOutputStats(int output, owt_base::VideoEncoderStats& stats)
 {
     boost::shared_lock<boost::shared_mutex> lock(m_outputMutex);
     auto it = m_outputs.find(output);
     if (it != m_outputs.end())
-        it->second.encoder->requestKeyFrame(it->second.streamId);
+        return it->second.stream->encoder->getStreamStats(it->second.stream->streamId, stats);
+    return false;
 }
 
-inline bool VideoFrameMixerImpl::addOutput(int output,
-                                           owt_base::FrameFormat format,
-                                           const owt_base::VideoCodecProfile profile,
-                                           const owt_base::VideoSize& outputSize,
-                                           const unsigned int framerateFPS,
-                                           const unsigned int bitrateKbps,
-                                           const unsigned int keyFrameIntervalSeconds,
-                                           owt_base::FrameDestination* dest)
+inline boost::shared_ptr<VideoFrameMixerImpl::Stream> VideoFrameMixerImpl::findStream(owt_base::FrameFormat format,
+                                                                                  const owt_base::VideoCodecProfile profile,
+                                                                                  const owt_base::VideoSize& outputSize,
+                                                                                  unsigned int framerateFPS,
+                                                                                  unsigned int bitrateKbps,
+                                                                                  unsigned int keyFrameIntervalSeconds)
+{
+    for (auto it = m_outputs.begin(); it != m_outputs.end(); ++it) {
+        boost::shared_ptr<Stream> stream = it->second.stream;
+        if (stream->format == format
+                && stream->profile == profile
+                && stream->size.width == outputSize.width
+                && stream->size.height == outputSize.height
+                && stream->framerateFPS == framerateFPS
+                && stream->fanOut->bitrateKbps() == bitrateKbps
+                && stream->keyFrameIntervalSeconds == keyFrameIntervalSeconds)
+            return stream;
+    }
+    return boost::shared_ptr<Stream>();
+}
+
+inline boost::shared_ptr<VideoFrameMixerImpl::Stream> VideoFrameMixerImpl::generateStream(owt_base::FrameFormat format,
+                                                                                      const owt_base::VideoCodecProfile profile,
+                                                                                      const owt_base::VideoSize& outputSize,
+                                                                                      unsigned int framerateFPS,
+                                                                                      unsigned int bitrateKbps,
+                                                                                      unsigned int keyFrameIntervalSeconds)
 {
     boost::shared_ptr<owt_base::VideoFrameEncoder> encoder;
-    boost::upgrade_lock<boost::shared_mutex> lock(m_outputMutex);
+    boost::shared_ptr<CompositeOut> fanOut(new CompositeOut(bitrateKbps));
 
-    // find a reusable encoder.
+    // find a reusable encoder, it is fed at the frame rate of its first output.
     auto it = m_outputs.begin();
     for (; it != m_outputs.end(); ++it) {
-        if (it->second.encoder->canSimulcast(format, outputSize.width, outputSize.height))
+        if (it->second.stream->framerateFPS == framerateFPS
+                && it->second.stream->encoder->canSimulcast(format, outputSize.width, outputSize.height))
             break;
     }
 
     int32_t streamId = -1;
     if (it != m_outputs.end()) { // Found a reusable encoder
-        encoder = it->second.encoder;
-        streamId = encoder->generateStream(outputSize.width, outputSize.height, framerateFPS, bitrateKbps, keyFrameIntervalSeconds, dest);
+        encoder = it->second.stream->encoder;
+        streamId = encoder->generateStream(outputSize.width, outputSize.height, framerateFPS, bitrateKbps, keyFrameIntervalSeconds, fanOut.get());
         if (streamId < 0)
-            return false;
+            return boost::shared_ptr<Stream>();
     } else { // Never found a reusable encoder.
 #ifdef ENABLE_MSDK
         if (!encoder && owt_base::MsdkFrameEncoder::supportFormat(format))
@@ -265,18 +407,45 @@ inline bool VideoFrameMixerImpl::addOutput(int output,
             encoder.reset(new owt_base::VCMFrameEncoder(format, profile, m_useSimulcast));
 
         if (!encoder)
-            return false;
+            return boost::shared_ptr<Stream>();
 
-        streamId = encoder->generateStream(outputSize.width, outputSize.height, framerateFPS, bitrateKbps, keyFrameIntervalSeconds, dest);
+        streamId = encoder->generateStream(outputSize.width, outputSize.height, framerateFPS, bitrateKbps, keyFrameIntervalSeconds, fanOut.get());
         if (streamId < 0)
-            return false;
+            return boost::shared_ptr<Stream>();
 
         if (!m_compositor->addOutput(outputSize.width, outputSize.height, framerateFPS, encoder.get()))
+            return boost::shared_ptr<Stream>();
+    }
+
+    return boost::shared_ptr<Stream>(new Stream{.encoder = encoder, .streamId = streamId,
+            .format = format, .profile = profile, .size = outputSize,
+            .framerateFPS = framerateFPS, .keyFrameIntervalSeconds = keyFrameIntervalSeconds,
+            .fanOut = fanOut});
+}
+
+inline bool VideoFrameMixerImpl::addOutput(int output,
+                                           owt_base::FrameFormat format,
+                                           const owt_base::VideoCodecProfile profile,
+                                           const owt_base::VideoSize& outputSize,
+                                           const unsigned int framerateFPS,
+                                           const unsigned int bitrateKbps,
+                                           const unsigned int keyFrameIntervalSeconds,
+                                           owt_base::FrameDestination* dest)
+{
+    boost::upgrade_lock<boost::shared_mutex> lock(m_outputMutex);
+
+    // find an encoded stream of the same spec.
+    boost::shared_ptr<Stream> stream = findStream(format, profile, outputSize, framerateFPS, bitrateKbps, keyFrameIntervalSeconds);
+    if (!stream) {
+        stream = generateStream(format, profile, outputSize, framerateFPS, bitrateKbps, keyFrameIntervalSeconds);
+        if (!stream)
             return false;
     }
 
+    stream->fanOut->addSubscriber(dest);
+
     boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
-    Output out{.encoder = encoder, .streamId = streamId};
+    Output out{.stream = stream, .dest = dest};
     m_outputs[output] = out;
     return true;
 }
@@ -286,9 +455,12 @@ inline void VideoFrameMixerImpl::removeOutput(int32_t output)
     boost::upgrade_lock<boost::shared_mutex> lock(m_outputMutex);
     auto it = m_outputs.find(output);
     if (it != m_outputs.end()) {
-        it->second.encoder->degenerateStream(it->second.streamId);
-        if (it->second.encoder->isIdle()) {
-            m_compositor->removeOutput(it->second.encoder.get());
+        boost::shared_ptr<Stream> stream = it->second.stream;
+        if (stream->fanOut->removeSubscriber(it->second.dest) == 0) {
+            stream->encoder->degenerateStream(stream->streamId);
+            if (stream->encoder->isIdle()) {
+                m_compositor->removeOutput(stream->encoder.get());
+            }
         }
         boost::upgrade_to_unique_lock<boost::shared_mutex> ulock(lock);
         m_outputs.erase(output);
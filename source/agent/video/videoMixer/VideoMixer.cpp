@@ -115,6 +115,13 @@ void VideoMixer::setInputActive(const int inputIndex, bool active)
     }
 }
 
+bool VideoMixer::getInputStats(const int inputIndex, owt_base::VideoDecoderStats& stats)
+{
+    if (m_inputs.find(inputIndex) == m_inputs.end())
+        return false;
+    return m_frameMixer->getInputStats(inputIndex, stats);
+}
+
 bool VideoMixer::addOutput(
     const std::string& outStreamID
     , const std::string& codec
@@ -168,6 +175,21 @@ void VideoMixer::forceKeyFrame(const std::string& outStreamID)
     }
 }
 
+bool VideoMixer::getOutputStats(const std::string& outStreamID, owt_base::VideoEncoderStats& stats)
+{
+    int32_t index = -1;
+    boost::shared_lock<boost::shared_mutex> lock(m_outputsMutex);
+    auto it = m_outputs.find(outStreamID);
+    if (it != m_outputs.end()) {
+        index = it->second;
+    }
+    lock.unlock();
+
+    if (index == -1)
+        return false;
+    return m_frameMixer->getOutputStats(index, stats);
+}
+
 void VideoMixer::updateLayoutSolution(LayoutSolution& solution) {
     ELOG_DEBUG("updateLayoutSolution, size(%ld)", solution.size());
 
@@ -199,6 +221,11 @@ void VideoMixer::updateLayoutSolution(LayoutSolution& solution) {
     m_frameMixer->updateLayoutSolution(solution);
 }
 
+bool VideoMixer::getCompositorStats(VideoCompositorStats& stats)
+{
+    return m_frameMixer->getCompositorStats(stats);
+}
+
 void VideoMixer::drawText(const std::string& textSpec)
 {
     m_frameMixer->drawText(textSpec);
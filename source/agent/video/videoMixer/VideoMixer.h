@@ -17,6 +17,7 @@
 namespace mcu {
 
 class VideoFrameMixer;
+struct VideoCompositorStats;
 
 struct VideoMixerConfig {
     uint32_t maxInput;
@@ -41,6 +42,7 @@ public:
     bool addInput(const int inputIndex, const std::string& codec, owt_base::FrameSource* source, const std::string& avatar);
     void removeInput(const int inputIndex);
     void setInputActive(const int inputIndex, bool active);
+    bool getInputStats(const int inputIndex, owt_base::VideoDecoderStats& stats);
     bool addOutput(const std::string& outStreamID
             , const std::string& codec
             , const owt_base::VideoCodecProfile profile
@@ -51,9 +53,11 @@ public:
             , owt_base::FrameDestination* dest);
     void removeOutput(const std::string& outStreamID);
     void forceKeyFrame(const std::string& outStreamID);
+    bool getOutputStats(const std::string& outStreamID, owt_base::VideoEncoderStats& stats);
 
     // Update Layout solution
     void updateLayoutSolution(LayoutSolution& solution);
+    bool getCompositorStats(VideoCompositorStats& stats);
 
     void drawText(const std::string& textSpec);
     void clearText();
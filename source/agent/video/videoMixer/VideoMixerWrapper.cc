@@ -8,6 +8,7 @@
 
 #include "VideoMixerWrapper.h"
 #include "VideoLayout.h"
+#include "VideoFrameMixer.h"
 
 using namespace v8;
 
@@ -26,10 +27,13 @@ void VideoMixer::Init(Handle<Object> exports, Handle<Object> module) {
   NODE_SET_PROTOTYPE_METHOD(tpl, "addInput", addInput);
   NODE_SET_PROTOTYPE_METHOD(tpl, "removeInput", removeInput);
   NODE_SET_PROTOTYPE_METHOD(tpl, "setInputActive", setInputActive);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getInputStats", getInputStats);
   NODE_SET_PROTOTYPE_METHOD(tpl, "addOutput", addOutput);
   NODE_SET_PROTOTYPE_METHOD(tpl, "removeOutput", removeOutput);
   NODE_SET_PROTOTYPE_METHOD(tpl, "updateLayoutSolution", updateLayoutSolution);
   NODE_SET_PROTOTYPE_METHOD(tpl, "forceKeyFrame", forceKeyFrame);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getOutputStats", getOutputStats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getCompositorStats", getCompositorStats);
   NODE_SET_PROTOTYPE_METHOD(tpl, "drawText", drawText);
   NODE_SET_PROTOTYPE_METHOD(tpl, "clearText", clearText);
 
@@ -126,6 +130,33 @@ void VideoMixer::setInputActive(const v8::FunctionCallbackInfo<v8::Value>& args)
   me->setInputActive(inputIndex, active);
 }
 
+void VideoMixer::getInputStats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  VideoMixer* obj = ObjectWrap::Unwrap<VideoMixer>(args.Holder());
+  mcu::VideoMixer* me = obj->me;
+
+  int inputIndex = args[0]->Int32Value();
+
+  owt_base::VideoDecoderStats stats;
+  if (!me->getInputStats(inputIndex, stats))
+    return;
+
+  Local<Array> histogram = Array::New(isolate, owt_base::VideoDecoderStats::kHistogramBuckets);
+  for (uint32_t i = 0; i < owt_base::VideoDecoderStats::kHistogramBuckets; i++)
+    histogram->Set(i, Number::New(isolate, stats.decodeTimeHistogram[i]));
+
+  Local<Object> result = Object::New(isolate);
+  result->Set(String::NewFromUtf8(isolate, "decodedFrames"), Number::New(isolate, stats.decodedFrames));
+  result->Set(String::NewFromUtf8(isolate, "droppedFrames"), Number::New(isolate, stats.droppedFrames));
+  result->Set(String::NewFromUtf8(isolate, "decodeTimeUs"), Number::New(isolate, stats.decodeTimeUs));
+  result->Set(String::NewFromUtf8(isolate, "maxDecodeTimeUs"), Number::New(isolate, stats.maxDecodeTimeUs));
+  result->Set(String::NewFromUtf8(isolate, "decodeTimeHistogram"), histogram);
+
+  args.GetReturnValue().Set(result);
+}
+
 void VideoMixer::addOutput(const v8::FunctionCallbackInfo<v8::Value>& args) {
   Isolate* isolate = Isolate::GetCurrent();
   HandleScope scope(isolate);
@@ -252,6 +283,50 @@ void VideoMixer::forceKeyFrame(const v8::FunctionCallbackInfo<v8::Value>& args)
   me->forceKeyFrame(outStreamID);
 }
 
+void VideoMixer::getOutputStats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  VideoMixer* obj = ObjectWrap::Unwrap<VideoMixer>(args.Holder());
+  mcu::VideoMixer* me = obj->me;
+
+  String::Utf8Value param0(args[0]->ToString());
+  std::string outStreamID = std::string(*param0);
+
+  owt_base::VideoEncoderStats stats;
+  if (!me->getOutputStats(outStreamID, stats))
+    return;
+
+  Local<Object> result = Object::New(isolate);
+  result->Set(String::NewFromUtf8(isolate, "encodedFrames"), Number::New(isolate, stats.encodedFrames));
+  result->Set(String::NewFromUtf8(isolate, "skippedFrames"), Number::New(isolate, stats.skippedFrames));
+  result->Set(String::NewFromUtf8(isolate, "queueLatencyMs"), Number::New(isolate, stats.queueLatencyMs));
+  result->Set(String::NewFromUtf8(isolate, "maxQueueLatencyMs"), Number::New(isolate, stats.maxQueueLatencyMs));
+  result->Set(String::NewFromUtf8(isolate, "encodeTimeUs"), Number::New(isolate, stats.encodeTimeUs));
+  result->Set(String::NewFromUtf8(isolate, "maxEncodeTimeUs"), Number::New(isolate, stats.maxEncodeTimeUs));
+
+  args.GetReturnValue().Set(result);
+}
+
+void VideoMixer::getCompositorStats(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  VideoMixer* obj = ObjectWrap::Unwrap<VideoMixer>(args.Holder());
+  mcu::VideoMixer* me = obj->me;
+
+  mcu::VideoCompositorStats stats;
+  if (!me->getCompositorStats(stats))
+    return;
+
+  Local<Object> result = Object::New(isolate);
+  result->Set(String::NewFromUtf8(isolate, "compositedFrames"), Number::New(isolate, stats.compositedFrames));
+  result->Set(String::NewFromUtf8(isolate, "compositionTimeUs"), Number::New(isolate, stats.compositionTimeUs));
+  result->Set(String::NewFromUtf8(isolate, "maxCompositionTimeUs"), Number::New(isolate, stats.maxCompositionTimeUs));
+
+  args.GetReturnValue().Set(result);
+}
+
 void VideoMixer::drawText(const v8::FunctionCallbackInfo<v8::Value>& args) {
   Isolate* isolate = Isolate::GetCurrent();
   HandleScope scope(isolate);
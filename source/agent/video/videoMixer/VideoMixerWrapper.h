@@ -30,11 +30,14 @@ class VideoMixer : public node::ObjectWrap {
   static void addInput(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void removeInput(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void setInputActive(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void getInputStats(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void addOutput(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void removeOutput(const v8::FunctionCallbackInfo<v8::Value>& args);
 
   static void updateLayoutSolution(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void forceKeyFrame(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void getOutputStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void getCompositorStats(const v8::FunctionCallbackInfo<v8::Value>& args);
 
   static void drawText(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void clearText(const v8::FunctionCallbackInfo<v8::Value>& args);
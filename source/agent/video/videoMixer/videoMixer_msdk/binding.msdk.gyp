@@ -8,10 +8,12 @@
       '../VideoMixer.cpp',
       '../../../../core/owt_base/I420BufferManager.cpp',
       '../../../../core/owt_base/MediaFramePipeline.cpp',
+      '../../../../core/owt_base/MediaFrameMulticaster.cpp',
       '../../../../core/owt_base/FrameConverter.cpp',
       '../../../../core/owt_base/VCMFrameDecoder.cpp',
       '../../../../core/owt_base/VCMFrameEncoder.cpp',
       '../../../../core/owt_base/FFmpegFrameDecoder.cpp',
+      '../../../../core/owt_base/VideoDecodeStage.cpp',
       '../../../../core/owt_base/MsdkFrameDecoder.cpp',
       '../../../../core/owt_base/MsdkFrameEncoder.cpp',
       '../../../../core/owt_base/MsdkBase.cpp',
@@ -8,10 +8,12 @@
       '../VideoMixer.cpp',
       '../../../../core/owt_base/I420BufferManager.cpp',
       '../../../../core/owt_base/MediaFramePipeline.cpp',
+      '../../../../core/owt_base/MediaFrameMulticaster.cpp',
       '../../../../core/owt_base/FrameConverter.cpp',
       '../../../../core/owt_base/VCMFrameDecoder.cpp',
       '../../../../core/owt_base/VCMFrameEncoder.cpp',
       '../../../../core/owt_base/FFmpegFrameDecoder.cpp',
+      '../../../../core/owt_base/VideoDecodeStage.cpp',
       '../../../../core/owt_base/FFmpegDrawText.cpp',
       '../../../../core/owt_base/SVTHEVCEncoder.cpp',
     ],
@@ -44,5 +46,37 @@
       '<!@(pkg-config --libs libavfilter)',
       '-L$(CORE_HOME)/../../build/libdeps/build/lib', '-lSvtHevcEnc',
     ],
-  }]
+  },
+# not build test target
+#  {
+#    'target_name': 'SoftScaledFrameCacheTest',
+#    'type' : 'executable',
+#    'sources': [
+#      '../SoftScaledFrameCacheTest.cpp',
+#      '../SoftVideoCompositor.cpp',
+#      '../../../../core/owt_base/I420BufferManager.cpp',
+#      '../../../../core/owt_base/MediaFramePipeline.cpp',
+#      '../../../../core/owt_base/FrameConverter.cpp',
+#      '../../../../core/owt_base/FFmpegDrawText.cpp',
+#    ],
+#    'cflags_cc': ['-Wall', '-O$(OPTIMIZATION_LEVEL)', '-g', '-std=c++11', '-DWEBRTC_POSIX'],
+#    'cflags_cc!': ['-fno-exceptions'],
+#    'include_dirs': [ '../../src',
+#                      '$(CORE_HOME)/common',
+#                      '$(CORE_HOME)/owt_base',
+#                      '$(CORE_HOME)/../../third_party/webrtc/src',
+#                      '$(CORE_HOME)/../../third_party/webrtc/src/third_party/libyuv/include',
+#                      '$(CORE_HOME)/../../build/libdeps/build/include',
+#    ],
+#    'libraries': [
+#      '-lboost_system',
+#      '-lboost_thread',
+#      '-lboost_chrono',
+#      '-llog4cxx',
+#      '-L$(CORE_HOME)/../../third_party/webrtc', '-lwebrtc',
+#      '<!@(pkg-config --libs libavutil)',
+#      '<!@(pkg-config --libs libavfilter)',
+#    ],
+#  }
+  ]
 }
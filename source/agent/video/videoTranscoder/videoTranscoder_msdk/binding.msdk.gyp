@@ -11,6 +11,7 @@
       '../../../../core/owt_base/VCMFrameDecoder.cpp',
       '../../../../core/owt_base/VCMFrameEncoder.cpp',
       '../../../../core/owt_base/FFmpegFrameDecoder.cpp',
+      '../../../../core/owt_base/VideoDecodeStage.cpp',
       '../../../../core/owt_base/FFmpegDrawText.cpp',
       '../../../../core/owt_base/FrameProcesser.cpp',
       '../../../../core/owt_base/MsdkFrameDecoder.cpp',
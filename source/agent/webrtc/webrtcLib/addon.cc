@@ -7,10 +7,30 @@
 #include "IOThreadPool.h"
 #include "MediaStream.h"
 
+#include <WebRTCTaskRunner.h>
+
 #include <node.h>
 
 using namespace v8;
 
+void getProcessThreadStats(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  std::vector<owt_base::WebRTCProcessThreadStats> stats = owt_base::WebRTCProcessThreadPool::instance().getStats();
+
+  Local<Array> result = Array::New(isolate, stats.size());
+  for (size_t i = 0; i < stats.size(); ++i) {
+    Local<Object> thread = Object::New(isolate);
+    thread->Set(String::NewFromUtf8(isolate, "modules"), Number::New(isolate, stats[i].modules));
+    thread->Set(String::NewFromUtf8(isolate, "lastDelayMs"), Number::New(isolate, stats[i].lastDelayMs));
+    thread->Set(String::NewFromUtf8(isolate, "maxDelayMs"), Number::New(isolate, stats[i].maxDelayMs));
+    result->Set(i, thread);
+  }
+
+  args.GetReturnValue().Set(result);
+}
+
 void InitAll(Handle<Object> exports) {
   WebRtcConnection::Init(exports);
   MediaStream::Init(exports);
@@ -20,6 +40,7 @@ void InitAll(Handle<Object> exports) {
   AudioFramePacketizer::Init(exports);
   VideoFrameConstructor::Init(exports);
   VideoFramePacketizer::Init(exports);
+  NODE_SET_METHOD(exports, "getProcessThreadStats", getProcessThreadStats);
 }
 
 NODE_MODULE(addon, InitAll)
@@ -0,0 +1,518 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef IOScheduler_h
+#define IOScheduler_h
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace owt_base {
+
+struct IOStrandStats {
+    std::string name;
+    uint32_t pendingTasks;
+    uint32_t lastLatencyUs;
+    uint32_t maxLatencyUs;
+};
+
+struct IOSchedulerStats {
+    uint32_t threads;
+    uint32_t pendingTasks;
+    std::vector<IOStrandStats> strands;
+};
+
+class IOScheduler;
+
+/**
+ * An IOStrand is the per-object handle onto an IOScheduler.
+ * Handlers posted or wrapped through the same strand never run concurrently,
+ * so the owner keeps the single threaded semantics it used to get from a
+ * private io_service thread.
+ * Each strand has a queue of its own rather than an asio strand, whose
+ * implementations are shared between unrelated strands by hashing, so that
+ * a busy object never holds back the handlers of another one.
+ * The owner must drain() (or destroy) the strand before it goes away, after
+ * which none of the handlers wrapped or posted before will run anymore.
+ */
+class IOStrand {
+    struct Token {
+        std::promise<void> released;
+        ~Token() { released.set_value(); }
+    };
+
+    // The state shared with the handlers queued on the io_service, which
+    // may still be around when the IOStrand is gone.
+    struct Task {
+        std::function<void()> handler;
+        // By post(), accounted in the pending tasks.
+        bool posted;
+        uint32_t generation;
+    };
+
+    struct Core {
+        Core(IOScheduler& scheduler, boost::asio::io_service& ioService)
+            : scheduler(scheduler)
+            , ioService(ioService)
+            , scheduled(false)
+            , generation(0)
+            , pendingTasks(0)
+            , lastLatencyUs(0)
+            , maxLatencyUs(0)
+        {
+        }
+
+        IOScheduler& scheduler;
+        boost::asio::io_service& ioService;
+        boost::mutex mutex;
+        std::deque<Task> queue;
+        bool scheduled;
+        // Bumped by drain() from within the strand, the handlers of the
+        // previous generations are dropped instead of being run.
+        std::atomic<uint32_t> generation;
+
+        std::atomic<uint32_t> pendingTasks;
+        std::atomic<uint32_t> lastLatencyUs;
+        std::atomic<uint32_t> maxLatencyUs;
+    };
+
+    template<typename Handler>
+    class TrackedHandler {
+    public:
+        TrackedHandler(const Handler& handler, const boost::shared_ptr<Token>& token)
+            : m_handler(handler)
+            , m_token(token)
+        {
+        }
+
+        template<typename... Args>
+        void operator()(Args&&... args) { m_handler(std::forward<Args>(args)...); }
+
+    private:
+        Handler m_handler;
+        boost::shared_ptr<Token> m_token;
+    };
+
+    // Queues the completion of an async operation on the strand. The steps
+    // of a composed operation, e.g. async_write, are run on the strand too
+    // through the asio_handler_invoke hook, and complete right away there.
+    template<typename Handler>
+    class WrappedHandler {
+    public:
+        WrappedHandler(const boost::shared_ptr<Core>& core, const Handler& handler, uint32_t generation)
+            : m_core(core)
+            , m_handler(handler)
+            , m_generation(generation)
+        {
+        }
+
+        template<typename... Args>
+        void operator()(Args&&... args)
+        {
+            if (IOStrand::current() == m_core.get()) {
+                if (m_generation == m_core->generation)
+                    m_handler(std::forward<Args>(args)...);
+                return;
+            }
+            invoke(std::bind(m_handler, std::forward<Args>(args)...));
+        }
+
+        template<typename Function>
+        friend void asio_handler_invoke(Function& function, WrappedHandler* handler)
+        {
+            handler->invoke(function);
+        }
+
+        template<typename Function>
+        friend void asio_handler_invoke(const Function& function, WrappedHandler* handler)
+        {
+            handler->invoke(function);
+        }
+
+        friend void* asio_handler_allocate(std::size_t size, WrappedHandler* handler)
+        {
+            return boost_asio_handler_alloc_helpers::allocate(size, handler->m_handler);
+        }
+
+        friend void asio_handler_deallocate(void* pointer, std::size_t size, WrappedHandler* handler)
+        {
+            boost_asio_handler_alloc_helpers::deallocate(pointer, size, handler->m_handler);
+        }
+
+    private:
+        void invoke(const std::function<void()>& function)
+        {
+            IOStrand::enqueue(m_core, function, false, m_generation);
+        }
+
+        boost::shared_ptr<Core> m_core;
+        Handler m_handler;
+        uint32_t m_generation;
+    };
+
+    template<typename Handler>
+    class TimedTask {
+    public:
+        TimedTask(const Handler& handler, Core* core)
+            : m_handler(handler)
+            , m_core(core)
+            , m_queuedAt(std::chrono::steady_clock::now())
+        {
+        }
+
+        void operator()()
+        {
+            IOStrand::onTaskStart(*m_core, m_queuedAt);
+            m_handler();
+        }
+
+    private:
+        Handler m_handler;
+        // Alive as long as the task is queued.
+        Core* m_core;
+        std::chrono::steady_clock::time_point m_queuedAt;
+    };
+
+public:
+    IOStrand(const std::string& name);
+    IOStrand(const std::string& name, IOScheduler& scheduler);
+    ~IOStrand();
+
+    boost::asio::io_service& ioService() { return m_core->ioService; }
+
+    // Wraps a completion handler for an async operation issued on ioService().
+    template<typename Handler>
+    WrappedHandler<TrackedHandler<Handler>> wrap(const Handler& handler);
+
+    // Queues a task on the strand; its queueing latency is accounted in the stats.
+    template<typename Handler>
+    void post(const Handler& handler);
+
+    // Blocks until all the handlers wrapped or posted so far are gone.
+    // If called from within the strand itself, which can not wait for its
+    // own handler, the ones still queued are dropped and the async operations
+    // wrapped so far complete without running their handler.
+    void drain();
+
+    bool runningInThisThread() { return current() == m_core.get(); }
+
+    IOStrandStats getStats();
+
+private:
+    // Handlers run before giving the thread back to the other strands.
+    static const uint32_t kMaxBatch = 16;
+
+    static Core*& current();
+    static void enqueue(const boost::shared_ptr<Core>&, const std::function<void()>&, bool posted, uint32_t generation);
+    static void run(const boost::shared_ptr<Core>&);
+    static void onTaskStart(Core&, const std::chrono::steady_clock::time_point& queuedAt);
+    static void onTaskDropped(Core&, const Task&);
+
+    boost::shared_ptr<Token> token();
+
+    std::string m_name;
+    IOScheduler& m_scheduler;
+    boost::shared_ptr<Core> m_core;
+    boost::mutex m_drainMutex;
+    boost::mutex m_tokenMutex;
+    boost::shared_ptr<Token> m_token;
+};
+
+/**
+ * The IOScheduler is a fixed pool of worker threads running a single
+ * io_service, shared by all the media objects of the process instead of each
+ * of them spawning its own thread.
+ * instance() runs the sockets and timers, on core pinned threads, one per
+ * online core unless overridden with the OWT_IO_THREADS environment variable.
+ * compute() runs the CPU heavy jobs, e.g. the video encoders and decoders, so
+ * that they never delay the network handlers. Its size defaults to the number
+ * of online cores too, and can be overridden with OWT_COMPUTE_THREADS.
+ */
+class IOScheduler {
+public:
+    static IOScheduler& instance();
+    static IOScheduler& compute();
+
+    boost::asio::io_service& ioService() { return m_ioService; }
+    uint32_t threads() { return m_threads; }
+
+    IOSchedulerStats getStats();
+
+private:
+    friend class IOStrand;
+
+    IOScheduler(const char* name, const char* threadsEnv, bool pinned);
+    ~IOScheduler();
+
+    void run(uint32_t index, int cpu);
+    void addStrand(IOStrand*);
+    void removeStrand(IOStrand*);
+
+    std::string m_name;
+    uint32_t m_threads;
+    std::atomic<uint32_t> m_pendingTasks;
+
+    boost::asio::io_service m_ioService;
+    boost::scoped_ptr<boost::asio::io_service::work> m_work;
+    boost::thread_group m_workers;
+
+    boost::mutex m_strandsMutex;
+    std::list<IOStrand*> m_strands;
+};
+
+inline IOScheduler& IOScheduler::instance()
+{
+    static IOScheduler scheduler("io", "OWT_IO_THREADS", true);
+    return scheduler;
+}
+
+inline IOScheduler& IOScheduler::compute()
+{
+    static IOScheduler scheduler("cpu", "OWT_COMPUTE_THREADS", false);
+    return scheduler;
+}
+
+inline IOScheduler::IOScheduler(const char* name, const char* threadsEnv, bool pinned)
+    : m_name(name)
+    , m_threads(0)
+    , m_pendingTasks(0)
+{
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &allowed))
+                cpus.push_back(i);
+        }
+    }
+
+    const char* env = getenv(threadsEnv);
+    m_threads = env ? atoi(env) : 0;
+    if (m_threads == 0)
+        m_threads = cpus.size() ? cpus.size() : boost::thread::hardware_concurrency();
+    if (m_threads == 0)
+        m_threads = 1;
+
+    m_work.reset(new boost::asio::io_service::work(m_ioService));
+    for (uint32_t i = 0; i < m_threads; ++i)
+        m_workers.create_thread(boost::bind(&IOScheduler::run, this, i, (pinned && cpus.size()) ? cpus[i % cpus.size()] : -1));
+}
+
+inline IOScheduler::~IOScheduler()
+{
+    m_work.reset();
+    m_ioService.stop();
+    m_workers.join_all();
+}
+
+inline void IOScheduler::run(uint32_t index, int cpu)
+{
+    if (cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    }
+
+    char name[16];
+    snprintf(name, sizeof(name), "owt-%s-%u", m_name.c_str(), index);
+    pthread_setname_np(pthread_self(), name);
+
+    m_ioService.run();
+}
+
+inline void IOScheduler::addStrand(IOStrand* strand)
+{
+    boost::lock_guard<boost::mutex> lock(m_strandsMutex);
+    m_strands.push_back(strand);
+}
+
+inline void IOScheduler::removeStrand(IOStrand* strand)
+{
+    boost::lock_guard<boost::mutex> lock(m_strandsMutex);
+    m_strands.remove(strand);
+}
+
+inline IOSchedulerStats IOScheduler::getStats()
+{
+    IOSchedulerStats stats;
+    stats.threads = m_threads;
+    stats.pendingTasks = m_pendingTasks;
+
+    boost::lock_guard<boost::mutex> lock(m_strandsMutex);
+    for (auto it = m_strands.begin(); it != m_strands.end(); ++it)
+        stats.strands.push_back((*it)->getStats());
+    return stats;
+}
+
+inline IOStrand::IOStrand(const std::string& name)
+    : IOStrand(name, IOScheduler::instance())
+{
+}
+
+inline IOStrand::IOStrand(const std::string& name, IOScheduler& scheduler)
+    : m_name(name)
+    , m_scheduler(scheduler)
+    , m_core(new Core(scheduler, scheduler.ioService()))
+    , m_token(new Token)
+{
+    m_scheduler.addStrand(this);
+}
+
+inline IOStrand::~IOStrand()
+{
+    drain();
+    m_scheduler.removeStrand(this);
+}
+
+template<typename Handler>
+inline IOStrand::WrappedHandler<IOStrand::TrackedHandler<Handler>> IOStrand::wrap(const Handler& handler)
+{
+    return WrappedHandler<TrackedHandler<Handler>>(m_core, TrackedHandler<Handler>(handler, token()), m_core->generation);
+}
+
+template<typename Handler>
+inline void IOStrand::post(const Handler& handler)
+{
+    enqueue(m_core, TrackedHandler<TimedTask<Handler>>(TimedTask<Handler>(handler, m_core.get()), token()), true, m_core->generation);
+}
+
+inline IOStrand::Core*& IOStrand::current()
+{
+    static thread_local Core* core = nullptr;
+    return core;
+}
+
+inline void IOStrand::enqueue(const boost::shared_ptr<Core>& core, const std::function<void()>& handler, bool posted, uint32_t generation)
+{
+    boost::lock_guard<boost::mutex> lock(core->mutex);
+    if (generation != core->generation)
+        return;
+
+    if (posted) {
+        core->pendingTasks++;
+        core->scheduler.m_pendingTasks++;
+    }
+    Task task = { handler, posted, generation };
+    core->queue.push_back(task);
+    if (!core->scheduled) {
+        core->scheduled = true;
+        core->ioService.post(boost::bind(&IOStrand::run, core));
+    }
+}
+
+inline void IOStrand::run(const boost::shared_ptr<Core>& core)
+{
+    Core* previous = current();
+    current() = core.get();
+
+    for (uint32_t i = 0; i < kMaxBatch; ++i) {
+        Task task;
+        {
+            boost::lock_guard<boost::mutex> lock(core->mutex);
+            if (core->queue.empty())
+                break;
+            std::swap(task, core->queue.front());
+            core->queue.pop_front();
+            if (task.generation != core->generation) {
+                onTaskDropped(*core, task);
+                continue;
+            }
+        }
+        task.handler();
+    }
+
+    current() = previous;
+
+    boost::lock_guard<boost::mutex> lock(core->mutex);
+    if (core->queue.empty())
+        core->scheduled = false;
+    else
+        core->ioService.post(boost::bind(&IOStrand::run, core));
+}
+
+inline boost::shared_ptr<IOStrand::Token> IOStrand::token()
+{
+    boost::lock_guard<boost::mutex> lock(m_tokenMutex);
+    return m_token;
+}
+
+inline void IOStrand::drain()
+{
+    if (runningInThisThread()) {
+        // The caller is one of our own handlers, it can not wait for itself.
+        // None of the others may run once the owner is gone though.
+        std::deque<Task> dropped;
+        {
+            boost::lock_guard<boost::mutex> lock(m_core->mutex);
+            m_core->generation++;
+            dropped.swap(m_core->queue);
+            for (auto& task : dropped)
+                onTaskDropped(*m_core, task);
+        }
+        return;
+    }
+
+    // The handlers wrapped or posted meanwhile get the new token, only the
+    // ones holding the former are waited for.
+    boost::lock_guard<boost::mutex> drainLock(m_drainMutex);
+    boost::unique_lock<boost::mutex> lock(m_tokenMutex);
+    boost::shared_ptr<Token> previous;
+    previous.swap(m_token);
+    m_token.reset(new Token);
+    std::future<void> released = previous->released.get_future();
+    previous.reset();
+    lock.unlock();
+
+    released.wait();
+}
+
+inline void IOStrand::onTaskStart(Core& core, const std::chrono::steady_clock::time_point& queuedAt)
+{
+    uint32_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - queuedAt).count();
+
+    core.pendingTasks--;
+    core.scheduler.m_pendingTasks--;
+    core.lastLatencyUs = latencyUs;
+    if (latencyUs > core.maxLatencyUs)
+        core.maxLatencyUs = latencyUs;
+}
+
+inline void IOStrand::onTaskDropped(Core& core, const Task& task)
+{
+    if (task.posted) {
+        core.pendingTasks--;
+        core.scheduler.m_pendingTasks--;
+    }
+}
+
+inline IOStrandStats IOStrand::getStats()
+{
+    IOStrandStats stats;
+    stats.name = m_name;
+    stats.pendingTasks = m_core->pendingTasks;
+    stats.lastLatencyUs = m_core->lastLatencyUs;
+    stats.maxLatencyUs = m_core->maxLatencyUs;
+    return stats;
+}
+
+} /* namespace owt_base */
+
+#endif /* IOScheduler_h */
@@ -9,21 +9,28 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include "IOScheduler.h"
+
 class JobTimerListener {
 public:
     virtual void onTimeout() = 0;
 };
 
+/*
+ * JobTimer runs on a strand of a shared owt_base::IOScheduler rather than
+ * on a thread of its own. The timers doing media processing in their jobs,
+ * e.g. mixing or composing, should run on IOScheduler::compute().
+ */
 class JobTimer {
 public:
-    JobTimer(unsigned int frequency, JobTimerListener* listener)
+    JobTimer(unsigned int frequency, JobTimerListener* listener, owt_base::IOScheduler& scheduler = owt_base::IOScheduler::instance())
         : m_isClosing(false)
         , m_isRunning(false)
         , m_interval(1000 / frequency)
         , m_listener(listener)
+        , m_strand("JobTimer", scheduler)
     {
-        m_timer.reset(new boost::asio::deadline_timer(m_ioService, boost::posix_time::milliseconds(m_interval)));
-        m_timer->async_wait(boost::bind(&JobTimer::onTimeout, this, boost::asio::placeholders::error));
+        m_timer.reset(new boost::asio::deadline_timer(m_strand.ioService()));
         start();
     }
 
@@ -34,21 +41,23 @@ public:
 
     void start()
     {
+        boost::lock_guard<boost::mutex> lock(m_stateMutex);
         if (!m_isRunning) {
-            m_timingThread.reset(new boost::thread(boost::bind(&boost::asio::io_service::run, &m_ioService)));
+            m_isClosing = false;
+            m_timer->expires_from_now(boost::posix_time::milliseconds(m_interval));
+            m_timer->async_wait(m_strand.wrap(boost::bind(&JobTimer::onTimeout, this, boost::asio::placeholders::error)));
             m_isRunning = true;
         }
     }
 
     void stop()
     {
-        m_timer->cancel();
-
+        boost::lock_guard<boost::mutex> lock(m_stateMutex);
         if (m_isRunning) {
             m_isClosing = true;
-            m_timingThread->join();
+            m_strand.post(boost::bind(&JobTimer::cancel, this));
+            m_strand.drain();
             m_isRunning = false;
-            m_isClosing = false;
         }
     }
 
@@ -59,11 +68,17 @@ private:
             if (!m_isClosing) {
                 m_timer->expires_from_now(boost::posix_time::milliseconds(m_interval));
                 handleJob();
-                m_timer->async_wait(boost::bind(&JobTimer::onTimeout, this, boost::asio::placeholders::error));
+                m_timer->async_wait(m_strand.wrap(boost::bind(&JobTimer::onTimeout, this, boost::asio::placeholders::error)));
             }
         }
     }
 
+    void cancel()
+    {
+        boost::system::error_code ec;
+        m_timer->cancel(ec);
+    }
+
     void handleJob()
     {
         if (m_listener)
@@ -73,12 +88,12 @@ private:
 private:
     std::atomic<bool> m_isClosing;
     bool m_isRunning;
+    boost::mutex m_stateMutex;
 
     unsigned int m_interval;
     JobTimerListener* m_listener;
 
-    boost::scoped_ptr<boost::thread> m_timingThread;
-    boost::asio::io_service m_ioService;
+    owt_base::IOStrand m_strand;
     boost::scoped_ptr<boost::asio::deadline_timer> m_timer;
 };
 
@@ -3,8 +3,308 @@
 // SPDX-License-Identifier: Apache-2.0
 #include "AVStreamOut.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/uio.h>
+#include <unistd.h>
+
 namespace owt_base {
 
+static const int64_t KEY_FRAME_REQUEST_INTERVAL_MS = 1000;
+static const int64_t QUEUE_STATS_INTERVAL_MS = 10000;
+
+// What precedes the payload of a frame in the spill file.
+struct SpilledFrame {
+    int64_t timeStamp;
+    int64_t duration;
+    Frame frame;
+};
+
+DEFINE_LOGGER(MediaFrameQueue, "owt.MediaFrameQueue");
+
+MediaFrameQueue::MediaFrameQueue()
+    : m_queuedBytes(0)
+    , m_valid(true)
+    , m_startTimeOffset(currentTimeMs())
+    , m_maxBytes(0)
+    , m_maxMs(0)
+    , m_policy(OVERFLOW_DROP_GOP)
+    , m_waitKeyFrame(false)
+    , m_keyFrameRequestMs(0)
+    , m_spillFd(-1)
+    , m_spillReadOffset(0)
+    , m_spillWriteOffset(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+MediaFrameQueue::~MediaFrameQueue()
+{
+    if (m_spillFd >= 0)
+        ::close(m_spillFd);
+}
+
+void MediaFrameQueue::setLimits(uint64_t maxBytes, int64_t maxMs, OverflowPolicy policy, const std::string& spillPath)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_maxBytes = maxBytes;
+    m_maxMs = maxMs;
+    m_policy = policy;
+    m_spillPath = spillPath;
+}
+
+bool MediaFrameQueue::pushFrame(const owt_base::Frame& frame)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (!m_valid)
+        return true;
+
+    if (m_waitKeyFrame && isVideoFrame(frame)) {
+        if (!frame.additionalInfo.video.isKeyFrame) {
+            m_stats.droppedFrames++;
+
+            int64_t now = currentTimeMs();
+            if (now - m_keyFrameRequestMs < KEY_FRAME_REQUEST_INTERVAL_MS)
+                return true;
+            m_keyFrameRequestMs = now;
+            return false;
+        }
+
+        ELOG_DEBUG("Resume video at key frame");
+        m_waitKeyFrame = false;
+    }
+
+    boost::shared_ptr<MediaFrame> lastFrame;
+
+    // One allocation for the frame and its refcount, the payload is shared or comes from the FrameBufferPool.
+    boost::shared_ptr<MediaFrame> mediaFrame = boost::make_shared<MediaFrame>(frame, currentTimeMs() - m_startTimeOffset);
+    if (isAudioFrame(frame)) {
+        if (!m_lastAudioFrame) {
+            m_lastAudioFrame = mediaFrame;
+            return true;
+        }
+
+        m_lastAudioFrame->m_duration = mediaFrame->m_timeStamp - m_lastAudioFrame->m_timeStamp;
+        if (m_lastAudioFrame->m_duration <= 0) {
+            m_lastAudioFrame->m_duration = 1;
+            mediaFrame->m_timeStamp = m_lastAudioFrame->m_timeStamp + 1;
+        }
+
+        lastFrame = m_lastAudioFrame;
+        m_lastAudioFrame = mediaFrame;
+    } else {
+        if (!m_lastVideoFrame) {
+            m_lastVideoFrame = mediaFrame;
+            return true;
+        }
+
+        m_lastVideoFrame->m_duration = mediaFrame->m_timeStamp - m_lastVideoFrame->m_timeStamp;
+        if (m_lastVideoFrame->m_duration <= 0) {
+            m_lastVideoFrame->m_duration = 1;
+            mediaFrame->m_timeStamp = m_lastVideoFrame->m_timeStamp + 1;
+        }
+
+        lastFrame = m_lastVideoFrame;
+        m_lastVideoFrame = mediaFrame;
+    }
+
+    bool waitKeyFrame = m_waitKeyFrame;
+    enqueue(lastFrame);
+
+    if (m_policy == OVERFLOW_DROP_GOP && isOverLimits())
+        dropGops();
+
+    if (m_waitKeyFrame && !waitKeyFrame) {
+        m_keyFrameRequestMs = currentTimeMs();
+        return false;
+    }
+    return true;
+}
+
+void MediaFrameQueue::enqueue(boost::shared_ptr<MediaFrame> mediaFrame)
+{
+    bool wasEmpty = m_queue.empty() && m_spillReadOffset == m_spillWriteOffset;
+
+    // Once spilling, the frames keep going to disk until read back, to stay in order.
+    if (m_policy == OVERFLOW_SPILL && (m_spillReadOffset < m_spillWriteOffset || isOverLimits())) {
+        if (!spill(mediaFrame)) {
+            // Better a gap in the recording than no recording at all.
+            m_stats.droppedFrames++;
+            m_waitKeyFrame = true;
+            m_lastVideoFrame.reset();
+            return;
+        }
+    } else {
+        m_queue.push_back(mediaFrame);
+        m_queuedBytes += mediaFrame->m_frame.length;
+
+        if (m_queuedBytes > m_stats.highWaterBytes)
+            m_stats.highWaterBytes = m_queuedBytes;
+        int64_t queuedMs = m_queue.back()->m_timeStamp - m_queue.front()->m_timeStamp;
+        if (queuedMs > m_stats.highWaterMs)
+            m_stats.highWaterMs = queuedMs;
+    }
+
+    if (wasEmpty)
+        m_cond.notify_one();
+}
+
+bool MediaFrameQueue::isOverLimits()
+{
+    if (m_maxBytes > 0 && m_queuedBytes > m_maxBytes)
+        return true;
+    if (m_maxMs > 0 && m_queue.size() > 1 && m_queue.back()->m_timeStamp - m_queue.front()->m_timeStamp > m_maxMs)
+        return true;
+    return false;
+}
+
+void MediaFrameQueue::dropGops()
+{
+    // Keep the frames from the latest key frame on if that's enough.
+    size_t keyFrame = m_queue.size();
+    for (size_t i = m_queue.size(); i > 0; --i) {
+        const Frame& frame = m_queue[i - 1]->m_frame;
+        if (isVideoFrame(frame) && frame.additionalInfo.video.isKeyFrame) {
+            keyFrame = i - 1;
+            break;
+        }
+    }
+
+    size_t dropped = (keyFrame > 0 && keyFrame < m_queue.size()) ? keyFrame : 0;
+    for (size_t i = 0; i < dropped; ++i) {
+        m_queuedBytes -= m_queue.front()->m_frame.length;
+        m_queue.pop_front();
+    }
+
+    if (dropped == 0 || isOverLimits()) {
+        // Nothing worth keeping, start over at the next key frame.
+        dropped += m_queue.size();
+        m_queue.clear();
+        m_queuedBytes = 0;
+        m_waitKeyFrame = true;
+        m_lastVideoFrame.reset();
+    }
+
+    m_stats.droppedFrames += dropped;
+    ELOG_DEBUG("Queue over limits, dropped %zu frames%s", dropped, m_waitKeyFrame ? ", wait for key frame" : "");
+}
+
+bool MediaFrameQueue::spill(boost::shared_ptr<MediaFrame> mediaFrame)
+{
+    if (m_spillFd < 0) {
+        if (m_spillPath.empty())
+            return false;
+
+        m_spillFd = ::open(m_spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (m_spillFd < 0) {
+            ELOG_ERROR("Cannot open spill file %s, %s", m_spillPath.c_str(), strerror(errno));
+            m_spillPath.clear();
+            return false;
+        }
+        // Only reachable through the descriptor, gone with it.
+        unlink(m_spillPath.c_str());
+        ELOG_INFO("Queue over limits, spill frames to %s", m_spillPath.c_str());
+    }
+
+    SpilledFrame header = {mediaFrame->m_timeStamp, mediaFrame->m_duration, mediaFrame->m_frame};
+    struct iovec iov[2] = {
+        {&header, sizeof(header)},
+        {mediaFrame->m_frame.payload, mediaFrame->m_frame.length},
+    };
+    ssize_t size = sizeof(header) + mediaFrame->m_frame.length;
+    if (pwritev(m_spillFd, iov, 2, m_spillWriteOffset) != size) {
+        ELOG_WARN("Cannot spill frame, %s", strerror(errno));
+        return false;
+    }
+
+    m_spillWriteOffset += size;
+    return true;
+}
+
+boost::shared_ptr<MediaFrame> MediaFrameQueue::readSpilled(uint64_t offset, uint32_t *size)
+{
+    SpilledFrame header;
+    if (pread(m_spillFd, &header, sizeof(header), offset) != sizeof(header))
+        return NULL;
+
+    Frame& frame = header.frame;
+    boost::intrusive_ptr<FrameBuffer> buffer = FrameBuffer::create(frame.length + FRAME_BUFFER_PADDING);
+    if (pread(m_spillFd, buffer->data(), frame.length, offset + sizeof(header)) != (ssize_t)frame.length)
+        return NULL;
+    memset(buffer->data() + frame.length, 0, FRAME_BUFFER_PADDING);
+
+    frame.payload = buffer->data();
+    frame.buffer = buffer.get();
+    frame.padding = FRAME_BUFFER_PADDING;
+
+    boost::shared_ptr<MediaFrame> mediaFrame = boost::make_shared<MediaFrame>(frame, header.timeStamp);
+    mediaFrame->m_duration = header.duration;
+    *size = sizeof(header) + frame.length;
+    return mediaFrame;
+}
+
+boost::shared_ptr<MediaFrame> MediaFrameQueue::popFrame(int timeout)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    boost::shared_ptr<MediaFrame> mediaFrame;
+
+    if (!m_valid)
+        return NULL;
+
+    if (m_queue.empty() && m_spillReadOffset == m_spillWriteOffset && timeout > 0) {
+        m_cond.timed_wait(lock, boost::get_system_time() + boost::posix_time::milliseconds(timeout));
+    }
+
+    if (!m_queue.empty()) {
+        mediaFrame = m_queue.front();
+        m_queue.pop_front();
+        m_queuedBytes -= mediaFrame->m_frame.length;
+    } else if (m_spillReadOffset < m_spillWriteOffset) {
+        // Only this thread reads, and what is before the write offset is not written anymore.
+        uint64_t offset = m_spillReadOffset;
+        uint32_t size = 0;
+        lock.unlock();
+        mediaFrame = readSpilled(offset, &size);
+        lock.lock();
+
+        if (mediaFrame) {
+            m_spillReadOffset += size;
+        } else {
+            ELOG_ERROR("Cannot read spilled frame, drop %lu bytes of frames", m_spillWriteOffset - m_spillReadOffset);
+            m_spillReadOffset = m_spillWriteOffset;
+        }
+
+        if (m_spillReadOffset == m_spillWriteOffset) {
+            ELOG_DEBUG("All spilled frames read back");
+            m_spillReadOffset = m_spillWriteOffset = 0;
+            if (ftruncate(m_spillFd, 0))
+                ELOG_WARN("Cannot truncate spill file, %s", strerror(errno));
+        }
+    }
+
+    return mediaFrame;
+}
+
+void MediaFrameQueue::cancel()
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_valid = false;
+    m_cond.notify_all();
+}
+
+MediaFrameQueue::Stats MediaFrameQueue::getStats()
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    Stats stats = m_stats;
+    stats.spilledBytes = m_spillWriteOffset - m_spillReadOffset;
+
+    m_stats.highWaterBytes = m_queuedBytes;
+    m_stats.highWaterMs = m_queue.size() > 1 ? m_queue.back()->m_timeStamp - m_queue.front()->m_timeStamp : 0;
+    m_stats.droppedFrames = 0;
+    return stats;
+}
+
 inline AVCodecID frameFormat2AVCodecID(int frameFormat)
 {
     switch (frameFormat) {
@@ -46,6 +346,9 @@ AVStreamOut::AVStreamOut(const std::string& url, bool hasAudio, bool hasVideo, E
     , m_width(0)
     , m_height(0)
     , m_videoSourceChanged(true)
+    , m_maxQueueBytes(0)
+    , m_maxQueueMs(0)
+    , m_queueStatsMs(currentTimeMs())
     , m_context(NULL)
     , m_audioStream(NULL)
     , m_videoStream(NULL)
@@ -78,6 +381,15 @@ AVStreamOut::~AVStreamOut()
 {
 }
 
+void AVStreamOut::setQueueLimits(uint64_t maxBytes, int64_t maxMs)
+{
+    ELOG_INFO("Queue limits %lu bytes, %ld ms", maxBytes, maxMs);
+
+    m_maxQueueBytes = maxBytes;
+    m_maxQueueMs = maxMs;
+    m_frameQueue.setLimits(maxBytes, maxMs, getQueueOverflowPolicy(), m_url + ".spill");
+}
+
 void AVStreamOut::onFrame(const owt_base::Frame& frame)
 {
     if (isAudioFrame(frame)) {
@@ -123,7 +435,11 @@ void AVStreamOut::onFrame(const owt_base::Frame& frame)
             notifyAsyncEvent("fatal", "Invalid audio frame channels or sample rate");
             return;
         }
-        m_frameQueue.pushFrame(frame);
+        if (!m_frameQueue.pushFrame(frame)) {
+            ELOG_DEBUG("Request video key frame after dropping frames");
+            deliverFeedbackMsg(FeedbackMsg{.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME});
+        }
+        reportQueueStats();
     } else if (isVideoFrame(frame)) {
         if (!m_hasVideo) {
             ELOG_ERROR("Video is not enabled");
@@ -197,7 +513,11 @@ void AVStreamOut::onFrame(const owt_base::Frame& frame)
             return;
 #endif
 
-        m_frameQueue.pushFrame(frame);
+        if (!m_frameQueue.pushFrame(frame)) {
+            ELOG_DEBUG("Request video key frame after dropping frames");
+            deliverFeedbackMsg(FeedbackMsg{.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME});
+        }
+        reportQueueStats();
     } else {
         ELOG_WARN("Unsupported frame format: %s(%d)", getFormatStr(frame.format), frame.format);
         notifyAsyncEvent("fatal", "Unsupported frame format");
@@ -286,6 +606,33 @@ exit:
     ELOG_DEBUG("Thread exited!");
 }
 
+void AVStreamOut::reportQueueStats()
+{
+    // The audio and video frames may come from different threads, one of them reports.
+    int64_t now = currentTimeMs();
+    int64_t last = m_queueStatsMs;
+    if (now - last < QUEUE_STATS_INTERVAL_MS || !m_queueStatsMs.compare_exchange_strong(last, now))
+        return;
+
+    // Only worth telling when the output doesn't keep up.
+    MediaFrameQueue::Stats stats = m_frameQueue.getStats();
+    if ((m_maxQueueBytes == 0 || stats.highWaterBytes * 2 < m_maxQueueBytes)
+            && (m_maxQueueMs == 0 || stats.highWaterMs * 2 < m_maxQueueMs)
+            && stats.droppedFrames == 0
+            && stats.spilledBytes == 0) {
+        return;
+    }
+
+    std::ostringstream data;
+    data << "{\"highWaterBytes\":" << stats.highWaterBytes
+         << ",\"highWaterMs\":" << stats.highWaterMs
+         << ",\"spilledBytes\":" << stats.spilledBytes
+         << ",\"droppedFrames\":" << stats.droppedFrames << "}";
+
+    ELOG_INFO("Queue %s", data.str().c_str());
+    notifyAsyncEvent("queue", data.str());
+}
+
 bool AVStreamOut::connect()
 {
     const char *formatName = getFormatName(m_url);
@@ -450,6 +797,11 @@ bool AVStreamOut::writeHeader()
     return true;
 }
 
+static void releaseFrameBuffer(void *opaque, uint8_t *data)
+{
+    intrusive_ptr_release(static_cast<FrameBuffer*>(opaque));
+}
+
 bool AVStreamOut::writeFrame(AVStream *stream, boost::shared_ptr<MediaFrame> mediaFrame)
 {
     int ret;
@@ -466,6 +818,15 @@ bool AVStreamOut::writeFrame(AVStream *stream, boost::shared_ptr<MediaFrame> med
     pkt.duration =  (int64_t)(mediaFrame->m_duration / (av_q2d(stream->time_base) * 1000));
     pkt.stream_index = stream->index;
 
+    // Hand the payload over by reference, ffmpeg would copy it to queue the packet otherwise.
+    FrameBuffer *buffer = mediaFrame->m_frame.buffer;
+    if (buffer) {
+        intrusive_ptr_add_ref(buffer);
+        pkt.buf = av_buffer_create(pkt.data, pkt.size, releaseFrameBuffer, buffer, AV_BUFFER_FLAG_READONLY);
+        if (!pkt.buf)
+            intrusive_ptr_release(buffer);
+    }
+
     if (isVideoFrame(mediaFrame->m_frame)) {
         if (m_lastKeyFrameTimestamp == 0)
             m_lastKeyFrameTimestamp = currentTimeMs();
@@ -494,6 +855,7 @@ bool AVStreamOut::writeFrame(AVStream *stream, boost::shared_ptr<MediaFrame> med
     ret = av_interleaved_write_frame(m_context, &pkt);
     if (ret < 0)
         ELOG_ERROR("Cannot write frame, %s", ff_err2str(ret));
+    av_packet_unref(&pkt);
 
     return ret >= 0 ? true : false;
 }
@@ -5,7 +5,10 @@
 #ifndef AVStreamOut_h
 #define AVStreamOut_h
 
-#include <queue>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -34,11 +37,13 @@ public:
     MediaFrame(const owt_base::Frame& frame, int64_t timeStamp = 0)
         : m_timeStamp(timeStamp)
         , m_duration(0)
+        , m_payload(frame)
     {
         m_frame = frame;
+        m_frame.buffer = m_payload.buffer();
         if (frame.length > 0) {
-            uint8_t *payload = frame.payload;
-            uint32_t length = frame.length;
+            uint8_t *payload = m_payload.data();
+            uint32_t length = m_payload.length();
 
             if (isAudioFrame(frame) && frame.additionalInfo.audio.isRtpPacket) {
                 RTPHeader* rtp = reinterpret_cast<RTPHeader*>(payload);
@@ -50,111 +55,66 @@ public:
                 m_frame.length = length;
             }
 
-            m_frame.payload = (uint8_t *)malloc(length);
-            memcpy(m_frame.payload, payload, length);
+            m_frame.payload = payload;
         } else {
             m_frame.payload = NULL;
         }
     }
 
-    ~MediaFrame()
-    {
-        if (m_frame.payload) {
-            free(m_frame.payload);
-            m_frame.payload = NULL;
-        }
-    }
-
     int64_t m_timeStamp;
     int64_t m_duration;
     owt_base::Frame m_frame;
+
+private:
+    // Keeps m_frame.payload alive, shared with the producer when possible.
+    owt_base::FramePayload m_payload;
 };
 
+/**
+ * The frames waiting for the sending thread. Past the limits in bytes or in
+ * milliseconds, if any, a live output drops whole GOPs and resumes at a key
+ * frame, and a file output spills the frames to disk and reads them back
+ * once the writing caught up, so that a stalled sink can't exhaust the memory.
+ */
 class MediaFrameQueue {
-public:
-    MediaFrameQueue()
-        : m_valid(true)
-        , m_startTimeOffset(currentTimeMs())
-    {
-    }
-
-    virtual ~MediaFrameQueue()
-    {
-    }
-
-    void pushFrame(const owt_base::Frame& frame)
-    {
-        boost::mutex::scoped_lock lock(m_mutex);
-        if (!m_valid)
-            return;
-
-        boost::shared_ptr<MediaFrame> lastFrame;
-
-        boost::shared_ptr<MediaFrame> mediaFrame(new MediaFrame(frame, currentTimeMs() - m_startTimeOffset));
-        if (isAudioFrame(frame)) {
-            if (!m_lastAudioFrame) {
-                m_lastAudioFrame = mediaFrame;
-                return;
-            }
-
-            m_lastAudioFrame->m_duration = mediaFrame->m_timeStamp - m_lastAudioFrame->m_timeStamp;
-            if (m_lastAudioFrame->m_duration <= 0) {
-                m_lastAudioFrame->m_duration = 1;
-                mediaFrame->m_timeStamp = m_lastAudioFrame->m_timeStamp + 1;
-            }
-
-            lastFrame = m_lastAudioFrame;
-            m_lastAudioFrame = mediaFrame;
-        } else {
-            if (!m_lastVideoFrame) {
-                m_lastVideoFrame = mediaFrame;
-                return;
-            }
-
-            m_lastVideoFrame->m_duration = mediaFrame->m_timeStamp - m_lastVideoFrame->m_timeStamp;
-            if (m_lastVideoFrame->m_duration <= 0) {
-                m_lastVideoFrame->m_duration = 1;
-                mediaFrame->m_timeStamp = m_lastVideoFrame->m_timeStamp + 1;
-            }
-
-            lastFrame = m_lastVideoFrame;
-            m_lastVideoFrame = mediaFrame;
-        }
-
-        m_queue.push(lastFrame);
-        if (m_queue.size() == 1)
-            m_cond.notify_one();
-    }
+    DECLARE_LOGGER();
 
-    boost::shared_ptr<MediaFrame> popFrame(int timeout = 0)
-    {
-        boost::mutex::scoped_lock lock(m_mutex);
-        boost::shared_ptr<MediaFrame> mediaFrame;
+public:
+    enum OverflowPolicy {
+        OVERFLOW_DROP_GOP,
+        OVERFLOW_SPILL,
+    };
 
-        if (!m_valid)
-            return NULL;
+    struct Stats {
+        // The most queued in memory since the last getStats
+        uint64_t highWaterBytes;
+        int64_t highWaterMs;
+        uint64_t spilledBytes;
+        uint32_t droppedFrames;
+    };
 
-        if (m_queue.size() == 0 && timeout > 0) {
-            m_cond.timed_wait(lock, boost::get_system_time() + boost::posix_time::milliseconds(timeout));
-        }
+    MediaFrameQueue();
+    virtual ~MediaFrameQueue();
 
-        if (m_queue.size() > 0) {
-            mediaFrame = m_queue.front();
-            m_queue.pop();
-        }
+    // 0 for no limit. OVERFLOW_SPILL writes to spillPath, removed right away.
+    void setLimits(uint64_t maxBytes, int64_t maxMs, OverflowPolicy policy, const std::string& spillPath = "");
 
-        return mediaFrame;
-    }
+    // Returns false if the video is dropped until a key frame, which should be requested.
+    bool pushFrame(const owt_base::Frame& frame);
+    boost::shared_ptr<MediaFrame> popFrame(int timeout = 0);
+    void cancel();
 
-    void cancel()
-    {
-        boost::mutex::scoped_lock lock(m_mutex);
-        m_valid = false;
-        m_cond.notify_all();
-    }
+    Stats getStats();
 
 private:
-    std::queue<boost::shared_ptr<MediaFrame>> m_queue;
+    void enqueue(boost::shared_ptr<MediaFrame> mediaFrame);
+    bool isOverLimits();
+    void dropGops();
+    bool spill(boost::shared_ptr<MediaFrame> mediaFrame);
+    boost::shared_ptr<MediaFrame> readSpilled(uint64_t offset, uint32_t *size);
+
+    std::deque<boost::shared_ptr<MediaFrame>> m_queue;
+    uint64_t m_queuedBytes;
     boost::mutex m_mutex;
     boost::condition_variable m_cond;
 
@@ -163,6 +123,21 @@ private:
 
     bool m_valid;
     int64_t m_startTimeOffset;
+
+    uint64_t m_maxBytes;
+    int64_t m_maxMs;
+    OverflowPolicy m_policy;
+
+    bool m_waitKeyFrame;
+    int64_t m_keyFrameRequestMs;
+
+    std::string m_spillPath;
+    int m_spillFd;
+    // The spilled frames are those between the offsets, the older ones read first.
+    uint64_t m_spillReadOffset;
+    uint64_t m_spillWriteOffset;
+
+    Stats m_stats;
 };
 
 class AVStreamOut : public owt_base::FrameDestination, public EventRegistry {
@@ -183,12 +158,16 @@ public:
     virtual void onFrame(const Frame&);
     virtual void onVideoSourceChanged(void) {deliverFeedbackMsg(FeedbackMsg{.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME });}
 
+    // Bounds the frames waiting to be sent, 0 for no limit.
+    void setQueueLimits(uint64_t maxBytes, int64_t maxMs);
+
 protected:
     virtual bool isAudioFormatSupported(FrameFormat format) = 0;
     virtual bool isVideoFormatSupported(FrameFormat format) = 0;
     virtual const char *getFormatName(std::string& url) = 0;
     virtual uint32_t getKeyFrameInterval(void) = 0;
     virtual uint32_t getReconnectCount(void) = 0;
+    virtual MediaFrameQueue::OverflowPolicy getQueueOverflowPolicy(void) = 0;
 
     virtual bool writeHeader(void);
     virtual bool getHeaderOpt(std::string& url, AVDictionary **options) = 0;
@@ -221,6 +200,8 @@ protected:
     bool writeFrame(AVStream *stream, boost::shared_ptr<MediaFrame> mediaFrame);
 
     void sendLoop(void);
+    // Called by the producers, so that a writer stuck in writeFrame is reported.
+    void reportQueueStats(void);
 
     void setVideoSourceChanged() {m_videoSourceChanged = true;};
 
@@ -246,6 +227,9 @@ private:
 
     boost::shared_ptr<owt_base::MediaFrame> m_videoKeyFrame;
     MediaFrameQueue m_frameQueue;
+    uint64_t m_maxQueueBytes;
+    int64_t m_maxQueueMs;
+    std::atomic<int64_t> m_queueStatsMs;
 
     AVFormatContext *m_context;
     AVStream *m_audioStream;
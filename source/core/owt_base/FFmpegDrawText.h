@@ -35,6 +35,7 @@ public:
     int drawFrame(Frame&);
     int setText(std::string arg);
     void enable(bool enabled) {m_enabled = enabled;}
+    bool isEnabled() {return m_enabled;}
 
 protected:
     bool init(int width, int height);
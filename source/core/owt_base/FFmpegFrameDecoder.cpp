@@ -4,8 +4,21 @@
 
 #include "FFmpegFrameDecoder.h"
 
+#include <boost/bind.hpp>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
 namespace owt_base {
 
+// The decoded frames are delivered by reference, so besides the frames the
+// decoder keeps the pool must cover the ones held downstream, e.g. the latest
+// frame of a mixer input and the ones being composed. Buffers are allocated
+// on demand, the limit only bounds the pool.
+static const uint32_t MAX_DECODER_FRAMES = 50;
+static const uint32_t MAX_DOWNSTREAM_FRAMES = 8;
+
 DEFINE_LOGGER(FFmpegFrameDecoder, "owt.FFmpegFrameDecoder");
 
 int FFmpegFrameDecoder::AVGetBuffer(AVCodecContext *s, AVFrame *frame, int flags)
@@ -57,14 +70,19 @@ void FFmpegFrameDecoder::AVFreeBuffer(void* opaque, uint8_t* data)
     return;
 }
 
-FFmpegFrameDecoder::FFmpegFrameDecoder()
+FFmpegFrameDecoder::FFmpegFrameDecoder(bool asyncDecode)
     : m_decCtx(NULL)
     , m_decFrame(NULL)
 {
+    m_decodeStage.reset(new VideoDecodeStage(asyncDecode,
+            boost::bind(&FFmpegFrameDecoder::decodeFrame, this, _1),
+            boost::bind(&FFmpegFrameDecoder::requestKeyFrame, this)));
 }
 
 FFmpegFrameDecoder::~FFmpegFrameDecoder()
 {
+    m_decodeStage.reset();
+
     if (m_decFrame) {
         av_frame_free(&m_decFrame);
         m_decFrame = NULL;
@@ -120,7 +138,14 @@ bool FFmpegFrameDecoder::init(FrameFormat format)
 
     m_decCtx->get_buffer2 = AVGetBuffer;
     m_decCtx->opaque = this;
-    ret = avcodec_open2(m_decCtx, dec , NULL);
+
+    // Frame threading would delay each frame by a frame per thread and call
+    // get_buffer2 from the codec threads, slices are decoded in parallel only.
+    AVDictionary *opts = NULL;
+    av_dict_set(&opts, "threads", "auto", 0);
+    av_dict_set(&opts, "thread_type", "slice", 0);
+    ret = avcodec_open2(m_decCtx, dec , &opts);
+    av_dict_free(&opts);
     if (ret < 0) {
         ELOG_ERROR_T("Could not open ffmpeg decoder context, %s", ff_err2str(ret));
         return false;
@@ -134,17 +159,48 @@ bool FFmpegFrameDecoder::init(FrameFormat format)
 
     memset(&m_packet, 0, sizeof(m_packet));
 
-    m_bufferManager.reset(new I420BufferManager(50));
+    m_bufferManager.reset(new I420BufferManager(MAX_DECODER_FRAMES + MAX_DOWNSTREAM_FRAMES));
 
     return true;
 }
 
+void FFmpegFrameDecoder::requestKeyFrame()
+{
+    FeedbackMsg msg {.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME};
+    deliverFeedbackMsg(msg);
+}
+
 void FFmpegFrameDecoder::onFrame(const Frame& frame)
+{
+    if (!m_decCtx)
+        return;
+
+    m_decodeStage->onFrame(frame);
+}
+
+bool FFmpegFrameDecoder::getStats(VideoDecoderStats& stats)
+{
+    m_decodeStage->getStats(stats);
+    return true;
+}
+
+void FFmpegFrameDecoder::decodeFrame(const Frame& frame)
 {
     int ret;
 
     av_init_packet(&m_packet);
-    m_packet.data = frame.payload;
+    // The padding of a shared buffer may be read by the other consumers at
+    // the same time, decode from a copy of it then.
+    if (frame.padding >= AV_INPUT_BUFFER_PADDING_SIZE && !(frame.buffer && frame.buffer->isShared())) {
+        memset(frame.payload + frame.length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        m_packet.data = frame.payload;
+    } else {
+        if (m_paddedBuffer.size() < frame.length + AV_INPUT_BUFFER_PADDING_SIZE)
+            m_paddedBuffer.resize(frame.length + AV_INPUT_BUFFER_PADDING_SIZE);
+        memcpy(m_paddedBuffer.data(), frame.payload, frame.length);
+        memset(m_paddedBuffer.data() + frame.length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        m_packet.data = m_paddedBuffer.data();
+    }
     m_packet.size = frame.length;
 
     ret = avcodec_send_packet(m_decCtx, &m_packet);
@@ -153,19 +209,19 @@ void FFmpegFrameDecoder::onFrame(const Frame& frame)
         return;
     }
 
-    ret = avcodec_receive_frame(m_decCtx, m_decFrame);
-    if (ret == AVERROR(EAGAIN)) {
-        ELOG_DEBUG_T("Retry receive frame, %s", ff_err2str(ret));
-        return;
-    }else if (ret < 0) {
-        ELOG_ERROR_T("Error while receive frame, %s", ff_err2str(ret));
-        return;
-    }
+    // A packet may complete more than one frame.
+    while (true) {
+        ret = avcodec_receive_frame(m_decCtx, m_decFrame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return;
+        } else if (ret < 0) {
+            ELOG_ERROR_T("Error while receive frame, %s", ff_err2str(ret));
+            return;
+        }
 
-    webrtc::VideoFrame *video_frame = static_cast<webrtc::VideoFrame*>(
-            av_buffer_get_opaque(m_decFrame->buf[0]));
+        webrtc::VideoFrame *video_frame = static_cast<webrtc::VideoFrame*>(
+                av_buffer_get_opaque(m_decFrame->buf[0]));
 
-    {
         Frame frame;
         memset(&frame, 0, sizeof(frame));
         frame.format = FRAME_FORMAT_I420;
@@ -5,12 +5,15 @@
 #ifndef FFmpegFrameDecoder_h
 #define FFmpegFrameDecoder_h
 
+#include <vector>
+
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <logger.h>
 
 #include "MediaFramePipeline.h"
 #include "I420BufferManager.h"
+#include "VideoDecodeStage.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -22,25 +25,32 @@ class FFmpegFrameDecoder : public VideoFrameDecoder {
     DECLARE_LOGGER();
 
 public:
-    FFmpegFrameDecoder();
+    FFmpegFrameDecoder(bool asyncDecode = false);
     ~FFmpegFrameDecoder();
 
     static bool supportFormat(FrameFormat format) {return true;}
 
     void onFrame(const Frame&);
     bool init(FrameFormat);
+    bool getStats(VideoDecoderStats& stats);
 
 protected:
     static int AVGetBuffer(AVCodecContext *s, AVFrame *frame, int flags);
     static void AVFreeBuffer(void* opaque, uint8_t* data);
 
 private:
+    void decodeFrame(const Frame&);
+    void requestKeyFrame();
+
     AVCodecContext *m_decCtx;
     AVFrame *m_decFrame;
 
     AVPacket m_packet;
+    // The frames without room for the padding are copied in here.
+    std::vector<uint8_t> m_paddedBuffer;
 
     boost::scoped_ptr<owt_base::I420BufferManager> m_bufferManager;
+    boost::scoped_ptr<VideoDecodeStage> m_decodeStage;
 
     char m_errbuff[500];
     char *ff_err2str(int errRet);
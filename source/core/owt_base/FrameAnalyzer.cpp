@@ -88,7 +88,7 @@ bool FrameAnalyzer::init(FrameFormat format, const uint32_t width, const uint32_
     if (m_outFrameRate != 0) {
         m_clock = Clock::GetRealTimeClock();
 
-        m_jobTimer.reset(new JobTimer(m_outFrameRate, this));
+        m_jobTimer.reset(new JobTimer(m_outFrameRate, this, owt_base::IOScheduler::compute()));
         m_jobTimer->start();
     }
 
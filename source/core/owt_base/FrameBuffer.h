@@ -0,0 +1,175 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef FrameBuffer_h
+#define FrameBuffer_h
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <boost/intrusive_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace owt_base {
+
+// Zeroed bytes following each message handed out in a FrameBuffer by the
+// receivers, so that the decoders reading past the end of the bitstream,
+// e.g. ffmpeg, can take the payload in place.
+static const uint32_t FRAME_BUFFER_PADDING = 64;
+
+/**
+ * Recycles the memory of the FrameBuffers of common sizes, from 1KB to 1MB in
+ * power of two classes, so that the producers and consumers creating one per
+ * frame, e.g. the recorders copying every frame, don't go through malloc and
+ * fresh pages each time. Up to 4MB worth of free blocks are kept per class.
+ */
+class FrameBufferPool {
+public:
+    static FrameBufferPool& instance()
+    {
+        // Never destroyed, buffers may be released during the static destructions.
+        static FrameBufferPool* pool = new FrameBufferPool();
+        return *pool;
+    }
+
+    // The class of a block of so many bytes, -1 if not pooled.
+    static int sizeClass(uint32_t size)
+    {
+        for (uint32_t bits = kMinClassBits; bits <= kMaxClassBits; ++bits) {
+            if (size <= (1u << bits))
+                return bits - kMinClassBits;
+        }
+        return -1;
+    }
+
+    static uint32_t classSize(int sizeClass) { return 1u << (sizeClass + kMinClassBits); }
+
+    void* get(int sizeClass)
+    {
+        SizeClass& c = m_classes[sizeClass];
+        boost::mutex::scoped_lock lock(c.mutex);
+        if (c.free.empty())
+            return nullptr;
+        void* memory = c.free.back();
+        c.free.pop_back();
+        return memory;
+    }
+
+    // Returns false if the class is full and the block should be freed.
+    bool put(int sizeClass, void* memory)
+    {
+        SizeClass& c = m_classes[sizeClass];
+        boost::mutex::scoped_lock lock(c.mutex);
+        if (c.free.size() >= std::max<uint32_t>(2, kMaxPooledBytesPerClass / classSize(sizeClass)))
+            return false;
+        c.free.push_back(memory);
+        return true;
+    }
+
+private:
+    static const uint32_t kMinClassBits = 10;
+    static const uint32_t kMaxClassBits = 20;
+    static const uint32_t kMaxPooledBytesPerClass = 4 << 20;
+
+    struct SizeClass {
+        boost::mutex mutex;
+        std::vector<void*> free;
+    };
+
+    FrameBufferPool() { }
+
+    SizeClass m_classes[kMaxClassBits - kMinClassBits + 1];
+};
+
+/**
+ * A refcounted memory block carrying a media payload. Producers that own
+ * such a block hand it out along with the Frame so that consumers outliving
+ * onFrame can keep a reference instead of copying the payload.
+ * The contents must not be modified once the buffer has been handed out.
+ */
+class FrameBuffer {
+public:
+    static boost::intrusive_ptr<FrameBuffer> create(uint32_t capacity);
+    static boost::intrusive_ptr<FrameBuffer> copyOf(const uint8_t* data, uint32_t length);
+
+    uint8_t* data() { return m_data; }
+    const uint8_t* data() const { return m_data; }
+    uint32_t capacity() const { return m_capacity; }
+
+    // Whether anybody else than the caller holds a reference.
+    bool isShared() const { return m_refs.load(std::memory_order_acquire) > 1; }
+
+    bool contains(const uint8_t* p, uint32_t length) const
+    {
+        return p >= m_data && p + length <= m_data + m_capacity;
+    }
+
+private:
+    // The payload starts right after the header, on a cache line boundary.
+    static const uint32_t kHeaderSize = 64;
+
+    FrameBuffer(uint32_t capacity, int sizeClass)
+        : m_refs(0)
+        , m_capacity(capacity)
+        , m_sizeClass(sizeClass)
+        , m_data(reinterpret_cast<uint8_t*>(this) + kHeaderSize)
+    {
+    }
+    ~FrameBuffer() { }
+
+    friend void intrusive_ptr_add_ref(FrameBuffer*);
+    friend void intrusive_ptr_release(FrameBuffer*);
+
+    std::atomic<uint32_t> m_refs;
+    uint32_t m_capacity;
+    // Of the FrameBufferPool, -1 if the memory is not pooled.
+    int m_sizeClass;
+    uint8_t* m_data;
+};
+
+inline boost::intrusive_ptr<FrameBuffer> FrameBuffer::create(uint32_t capacity)
+{
+    int sizeClass = FrameBufferPool::sizeClass(kHeaderSize + capacity);
+    void* memory = nullptr;
+    if (sizeClass >= 0)
+        memory = FrameBufferPool::instance().get(sizeClass);
+    if (!memory) {
+        uint32_t size = sizeClass >= 0 ? FrameBufferPool::classSize(sizeClass) : kHeaderSize + capacity;
+        if (posix_memalign(&memory, kHeaderSize, size))
+            throw std::bad_alloc();
+    }
+    return boost::intrusive_ptr<FrameBuffer>(new (memory) FrameBuffer(capacity, sizeClass));
+}
+
+inline boost::intrusive_ptr<FrameBuffer> FrameBuffer::copyOf(const uint8_t* data, uint32_t length)
+{
+    boost::intrusive_ptr<FrameBuffer> buffer = create(length);
+    if (length > 0)
+        memcpy(buffer->data(), data, length);
+    return buffer;
+}
+
+inline void intrusive_ptr_add_ref(FrameBuffer* buffer)
+{
+    buffer->m_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(FrameBuffer* buffer)
+{
+    if (buffer->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        int sizeClass = buffer->m_sizeClass;
+        buffer->~FrameBuffer();
+        if (sizeClass < 0 || !FrameBufferPool::instance().put(sizeClass, buffer))
+            free(buffer);
+    }
+}
+
+} /* namespace owt_base */
+
+#endif /* FrameBuffer_h */
@@ -0,0 +1,245 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "FrameFragmentation.h"
+
+#include <chrono>
+
+namespace owt_base {
+
+static const uint32_t FRAGMENT_CHUNK_SIZE = FRAGMENT_DATAGRAM_SIZE - 4 - 1 - sizeof(FragmentHeader);
+static const uint32_t MAX_MESSAGE_LENGTH = 16 * 1024 * 1024;
+static const uint32_t MAX_PENDING_MESSAGES = 32;
+static const uint32_t MAX_NACKED_FRAGMENTS = (FRAGMENT_DATAGRAM_SIZE - 4 - 1 - 6) / 2;
+static const int64_t NACK_DELAY_MS = 20;
+static const int64_t REASSEMBLY_TIMEOUT_MS = 200;
+
+static int64_t steadyTimeMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DEFINE_LOGGER(FrameFragmenter, "owt.FrameFragmenter");
+
+FrameFragmenter::FrameFragmenter(RawTransportInterface* transport)
+    : m_transport(transport)
+    , m_frameSeq(0)
+    , m_keyFrameSeq(0)
+    , m_keyFrameFragments(0)
+{
+}
+
+FrameFragmenter::~FrameFragmenter()
+{
+}
+
+void FrameFragmenter::send(const char* header, int headerLength, const FramePayload& payload, TransportDataType type)
+{
+    if (4 + headerLength + payload.length() <= FRAGMENT_DATAGRAM_SIZE
+            || (uint32_t)headerLength >= FRAGMENT_CHUNK_SIZE) {
+        m_transport->sendData(header, headerLength, payload, type);
+        return;
+    }
+
+    uint32_t firstChunk = FRAGMENT_CHUNK_SIZE - headerLength;
+    uint32_t count = 1;
+    if (payload.length() > firstChunk)
+        count += (payload.length() - firstChunk + FRAGMENT_CHUNK_SIZE - 1) / FRAGMENT_CHUNK_SIZE;
+    if (count > 0xFFFF) {
+        ELOG_WARN("Frame too large to be fragmented, length:%u", payload.length());
+        return;
+    }
+
+    std::vector<char> messageHeader(header, header + headerLength);
+    uint32_t frameSeq = m_frameSeq++;
+    bool isKeyFrame = (type == TRANSPORT_VIDEO_KEY_FRAME);
+    uint8_t flags = isKeyFrame ? FRAGMENT_FLAG_KEY_FRAME : 0;
+
+    if (isKeyFrame) {
+        boost::lock_guard<boost::mutex> lock(m_keyFrameMutex);
+        m_keyFrameSeq = frameSeq;
+        m_keyFrameFragments = count;
+        m_keyFrameHeader = messageHeader;
+        m_keyFramePayload = payload;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+        sendFragment(frameSeq, messageHeader, payload, i, count, flags, i == 0 ? type : TRANSPORT_CONTINUATION);
+}
+
+void FrameFragmenter::sendFragment(uint32_t frameSeq, const std::vector<char>& header, const FramePayload& payload, uint16_t index, uint16_t count, uint8_t flags, TransportDataType type)
+{
+    uint32_t firstChunk = FRAGMENT_CHUNK_SIZE - header.size();
+    uint32_t payloadOffset = index == 0 ? 0 : firstChunk + (index - 1) * FRAGMENT_CHUNK_SIZE;
+    uint32_t chunk = std::min(index == 0 ? firstChunk : FRAGMENT_CHUNK_SIZE, payload.length() - payloadOffset);
+
+    char buffer[FRAGMENT_DATAGRAM_SIZE];
+    FragmentHeader* fragment = reinterpret_cast<FragmentHeader*>(buffer + 1);
+    buffer[0] = TDT_MEDIA_FRAGMENT;
+    fragment->frameSeq = frameSeq;
+    fragment->messageLength = header.size() + payload.length();
+    fragment->offset = index == 0 ? 0 : header.size() + payloadOffset;
+    fragment->index = index;
+    fragment->count = count;
+    fragment->flags = flags;
+
+    int length = 1 + sizeof(FragmentHeader);
+    if (index == 0) {
+        memcpy(buffer + length, header.data(), header.size());
+        length += header.size();
+    }
+
+    m_transport->sendData(buffer, length, payload.slice(payloadOffset, chunk), type);
+}
+
+void FrameFragmenter::onNack(const char* buf, int len)
+{
+    if (len < 6)
+        return;
+
+    uint32_t frameSeq = *reinterpret_cast<const uint32_t*>(buf);
+    uint16_t n = *reinterpret_cast<const uint16_t*>(buf + 4);
+    if (len < 6 + n * 2)
+        return;
+
+    boost::lock_guard<boost::mutex> lock(m_keyFrameMutex);
+    if (frameSeq != m_keyFrameSeq || m_keyFramePayload.length() == 0) {
+        ELOG_DEBUG("Ignore NACK of frame %u, last key frame %u", frameSeq, m_keyFrameSeq);
+        return;
+    }
+
+    // Sent as plain data, neither to be dropped nor taken as a new key frame
+    // by the send queue.
+    ELOG_DEBUG("Retransmit %u fragments of key frame %u", n, frameSeq);
+    const uint16_t* indexes = reinterpret_cast<const uint16_t*>(buf + 6);
+    for (uint16_t i = 0; i < n; ++i) {
+        if (indexes[i] < m_keyFrameFragments)
+            sendFragment(frameSeq, m_keyFrameHeader, m_keyFramePayload, indexes[i], m_keyFrameFragments, FRAGMENT_FLAG_KEY_FRAME, TRANSPORT_DATA);
+    }
+}
+
+DEFINE_LOGGER(FrameReassembler, "owt.FrameReassembler");
+
+FrameReassembler::FrameReassembler(RawTransportInterface* transport, bool nack)
+    : m_transport(transport)
+    , m_nack(nack)
+{
+}
+
+FrameReassembler::~FrameReassembler()
+{
+}
+
+boost::intrusive_ptr<FrameBuffer> FrameReassembler::onFragment(const char* buf, int len, uint32_t* messageLength)
+{
+    boost::intrusive_ptr<FrameBuffer> message;
+    int64_t nowMs = steadyTimeMs();
+
+    if (len < (int)sizeof(FragmentHeader))
+        return message;
+
+    // The fragmenter cuts the messages in FRAGMENT_CHUNK_SIZE chunks, only
+    // the last one may be shorter, so the fragments can't overlap nor leave holes.
+    const FragmentHeader* fragment = reinterpret_cast<const FragmentHeader*>(buf);
+    uint32_t chunk = len - sizeof(FragmentHeader);
+    uint64_t offset = (uint64_t)fragment->index * FRAGMENT_CHUNK_SIZE;
+    bool isLast = (fragment->index + 1 == fragment->count);
+    if (fragment->messageLength > MAX_MESSAGE_LENGTH
+            || fragment->index >= fragment->count
+            || fragment->count != (fragment->messageLength + FRAGMENT_CHUNK_SIZE - 1) / FRAGMENT_CHUNK_SIZE
+            || fragment->offset != offset
+            || chunk > fragment->messageLength
+            || fragment->offset > fragment->messageLength - chunk
+            || (isLast ? fragment->offset + chunk != fragment->messageLength : chunk != FRAGMENT_CHUNK_SIZE)) {
+        ELOG_WARN("Invalid fragment %u/%u of frame %u", fragment->index, fragment->count, fragment->frameSeq);
+        return message;
+    }
+
+    auto it = m_pending.find(fragment->frameSeq);
+    if (it != m_pending.end()
+            && (it->second.messageLength != fragment->messageLength || it->second.received.size() != fragment->count)) {
+        m_pending.erase(it);
+        it = m_pending.end();
+    }
+
+    if (it == m_pending.end()) {
+        if (m_pending.size() >= MAX_PENDING_MESSAGES) {
+            ELOG_DEBUG("Too many incomplete frames, drop frame %u", m_pending.begin()->first);
+            m_pending.erase(m_pending.begin());
+        }
+
+        Reassembly reassembly;
+        reassembly.buffer = FrameBuffer::create(fragment->messageLength + FRAME_BUFFER_PADDING);
+        memset(reassembly.buffer->data() + fragment->messageLength, 0, FRAME_BUFFER_PADDING);
+        reassembly.messageLength = fragment->messageLength;
+        reassembly.received.resize(fragment->count, false);
+        reassembly.receivedCount = 0;
+        reassembly.flags = fragment->flags;
+        reassembly.firstArrivalMs = nowMs;
+        reassembly.nacked = false;
+        it = m_pending.insert(std::make_pair(fragment->frameSeq, reassembly)).first;
+    }
+
+    Reassembly& reassembly = it->second;
+    if (reassembly.received[fragment->index])
+        return message;
+
+    memcpy(reassembly.buffer->data() + fragment->offset, buf + sizeof(FragmentHeader), chunk);
+    reassembly.received[fragment->index] = true;
+    reassembly.receivedCount++;
+
+    if (reassembly.receivedCount == reassembly.received.size()) {
+        message = reassembly.buffer;
+        *messageLength = reassembly.messageLength;
+        m_pending.erase(it);
+    }
+
+    return message;
+}
+
+void FrameReassembler::onTimer()
+{
+    if (!m_pending.empty())
+        checkPending(steadyTimeMs());
+}
+
+void FrameReassembler::checkPending(int64_t nowMs)
+{
+    auto it = m_pending.begin();
+    while (it != m_pending.end()) {
+        int64_t age = nowMs - it->second.firstArrivalMs;
+        if (age > REASSEMBLY_TIMEOUT_MS) {
+            ELOG_DEBUG("Frame %u incomplete after %ldms, %u/%zu fragments received", it->first, age, it->second.receivedCount, it->second.received.size());
+            it = m_pending.erase(it);
+            continue;
+        }
+
+        if (m_nack && age > NACK_DELAY_MS && !it->second.nacked && (it->second.flags & FRAGMENT_FLAG_KEY_FRAME)) {
+            sendNack(it->first, it->second);
+            it->second.nacked = true;
+        }
+        ++it;
+    }
+}
+
+void FrameReassembler::sendNack(uint32_t frameSeq, const Reassembly& reassembly)
+{
+    char buffer[FRAGMENT_DATAGRAM_SIZE];
+    uint16_t* indexes = reinterpret_cast<uint16_t*>(buffer + 7);
+    uint16_t n = 0;
+
+    for (size_t i = 0; i < reassembly.received.size() && n < MAX_NACKED_FRAGMENTS; ++i) {
+        if (!reassembly.received[i])
+            indexes[n++] = i;
+    }
+
+    buffer[0] = TDT_FRAGMENT_NACK;
+    *reinterpret_cast<uint32_t*>(buffer + 1) = frameSeq;
+    *reinterpret_cast<uint16_t*>(buffer + 5) = n;
+
+    ELOG_DEBUG("NACK %u fragments of key frame %u", n, frameSeq);
+    m_transport->sendData(buffer, 7 + n * 2);
+}
+
+} /* namespace owt_base */
@@ -0,0 +1,108 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef FrameFragmentation_h
+#define FrameFragmentation_h
+
+#include <map>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <logger.h>
+
+#include "MediaFramePipeline.h"
+#include "RawTransport.h"
+
+namespace owt_base {
+
+// Largest datagram sent by the fragmenter, including the RawTransport length prefix.
+static const uint32_t FRAGMENT_DATAGRAM_SIZE = 1400;
+// How often FrameReassembler::onTimer() should be called.
+static const uint32_t FRAME_REASSEMBLY_TIMER_MS = 10;
+
+struct FragmentHeader {
+    uint32_t frameSeq;
+    uint32_t messageLength;
+    uint32_t offset;
+    uint16_t index;
+    uint16_t count;
+    uint8_t  flags;
+} __attribute__((packed));
+
+enum FragmentFlags {
+    FRAGMENT_FLAG_KEY_FRAME = 0x01,
+};
+
+/**
+ * Splits the messages sent over a UDP RawTransport into datagrams no larger
+ * than FRAGMENT_DATAGRAM_SIZE. Each fragment is sent as
+ * [TDT_MEDIA_FRAGMENT][FragmentHeader][chunk of the message].
+ * The fragments of the last key frame are kept to answer the NACKs of the
+ * receiving FrameReassembler.
+ */
+class FrameFragmenter {
+    DECLARE_LOGGER();
+public:
+    FrameFragmenter(RawTransportInterface* transport);
+    ~FrameFragmenter();
+
+    // Sends header + payload as is if it fits in a datagram, fragmented otherwise.
+    void send(const char* header, int headerLength, const FramePayload& payload, TransportDataType type);
+    // Handles the body of a TDT_FRAGMENT_NACK message.
+    void onNack(const char* buf, int len);
+
+private:
+    void sendFragment(uint32_t frameSeq, const std::vector<char>& header, const FramePayload& payload, uint16_t index, uint16_t count, uint8_t flags, TransportDataType type);
+
+    RawTransportInterface* m_transport;
+    uint32_t m_frameSeq;
+
+    boost::mutex m_keyFrameMutex;
+    uint32_t m_keyFrameSeq;
+    uint16_t m_keyFrameFragments;
+    std::vector<char> m_keyFrameHeader;
+    FramePayload m_keyFramePayload;
+};
+
+/**
+ * Collects the fragments produced by a FrameFragmenter and hands out each
+ * message once complete, in a single FrameBuffer. Incomplete messages are
+ * dropped after REASSEMBLY_TIMEOUT_MS; for key frames the missing fragments
+ * are NACKed once before that when nack is enabled. Both are done by
+ * onTimer(), so that they happen even if no more fragments arrive.
+ * Not thread safe, it's expected to run on the transport's receiving strand.
+ */
+class FrameReassembler {
+    DECLARE_LOGGER();
+public:
+    FrameReassembler(RawTransportInterface* transport, bool nack = true);
+    ~FrameReassembler();
+
+    // Returns the message buffer when buf completes it, null otherwise.
+    boost::intrusive_ptr<FrameBuffer> onFragment(const char* buf, int len, uint32_t* messageLength);
+    // Expires and NACKs the incomplete messages, every FRAME_REASSEMBLY_TIMER_MS.
+    void onTimer();
+
+private:
+    struct Reassembly {
+        boost::intrusive_ptr<FrameBuffer> buffer;
+        uint32_t messageLength;
+        std::vector<bool> received;
+        uint16_t receivedCount;
+        uint8_t flags;
+        int64_t firstArrivalMs;
+        bool nacked;
+    };
+
+    void checkPending(int64_t nowMs);
+    void sendNack(uint32_t frameSeq, const Reassembly& reassembly);
+
+    RawTransportInterface* m_transport;
+    bool m_nack;
+    std::map<uint32_t/*frameSeq*/, Reassembly> m_pending;
+};
+
+} /* namespace owt_base */
+
+#endif /* FrameFragmentation_h */
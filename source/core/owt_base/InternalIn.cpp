@@ -8,10 +8,14 @@ namespace owt_base {
 
 InternalIn::InternalIn(const std::string& protocol, unsigned int minPort, unsigned int maxPort)
 {
-    if (protocol == "tcp")
+    if (protocol == "tcp") {
         m_transport.reset(new owt_base::RawTransport<TCP>(this));
-    else
-        m_transport.reset(new owt_base::RawTransport<UDP>(this, 64 * 1024));
+    } else {
+        // Nothing larger than a fragment is sent over UDP, see FrameFragmenter.
+        m_transport.reset(new owt_base::RawTransport<UDP>(this, FRAGMENT_DATAGRAM_SIZE));
+        m_reassembler.reset(new FrameReassembler(m_transport.get()));
+        m_transport->setTimerInterval(FRAME_REASSEMBLY_TIMER_MS);
+    }
 
     if (minPort > 0 && minPort <= maxPort) {
         m_transport->listenTo(minPort, maxPort);
@@ -39,14 +43,36 @@ void InternalIn::onFeedback(const FeedbackMsg& msg)
 }
 
 void InternalIn::onTransportData(char* buf, int len)
+{
+    onTransportBuffer(nullptr, buf, len);
+}
+
+void InternalIn::onTransportTimer()
+{
+    if (m_reassembler)
+        m_reassembler->onTimer();
+}
+
+void InternalIn::onTransportBuffer(FrameBuffer* owner, char* buf, int len)
 {
     Frame* frame = nullptr;
     switch (buf[0]) {
         case TDT_MEDIA_FRAME:
             frame = reinterpret_cast<Frame*>(buf + 1);
             frame->payload = reinterpret_cast<uint8_t*>(buf + 1 + sizeof(Frame));
+            // The payload was received in place, consumers may share the transport buffer.
+            frame->buffer = owner;
+            frame->padding = owner ? FRAME_BUFFER_PADDING : 0;
             deliverFrame(*frame);
             break;
+        case TDT_MEDIA_FRAGMENT:
+            if (m_reassembler) {
+                uint32_t messageLength = 0;
+                boost::intrusive_ptr<FrameBuffer> message = m_reassembler->onFragment(buf + 1, len - 1, &messageLength);
+                if (message)
+                    onTransportBuffer(message.get(), reinterpret_cast<char*>(message->data()), messageLength);
+            }
+            break;
         default:
             break;
     }
@@ -5,6 +5,7 @@
 #ifndef InternalIn_h
 #define InternalIn_h
 
+#include "FrameFragmentation.h"
 #include "MediaFramePipeline.h"
 #include "RawTransport.h"
 
@@ -22,11 +23,15 @@ public:
 
     // Implements RawTransportListener.
     void onTransportData(char* buf, int len);
+    void onTransportBuffer(FrameBuffer* owner, char* buf, int len);
     void onTransportError() { }
     void onTransportConnected() { }
+    void onTransportTimer();
 
 private:
     boost::shared_ptr<owt_base::RawTransportInterface> m_transport;
+    // Only for UDP, where large frames come in fragments.
+    boost::scoped_ptr<FrameReassembler> m_reassembler;
 };
 
 } /* namespace owt_base */
@@ -6,12 +6,19 @@
 
 namespace owt_base {
 
+// Past these bounds the queued video delta frames get dropped.
+static const uint32_t SEND_QUEUE_MAX_BYTES = 8 * 1024 * 1024;
+static const uint32_t SEND_QUEUE_MAX_DELAY_MS = 500;
+
 InternalOut::InternalOut(const std::string& protocol, const std::string& dest_ip, unsigned int dest_port)
 {
-    if (protocol == "tcp")
+    if (protocol == "tcp") {
         m_transport.reset(new owt_base::RawTransport<TCP>(this));
-    else
+    } else {
         m_transport.reset(new owt_base::RawTransport<UDP>(this));
+        m_fragmenter.reset(new FrameFragmenter(m_transport.get()));
+    }
+    m_transport->setSendQueueLimits(SEND_QUEUE_MAX_BYTES, SEND_QUEUE_MAX_DELAY_MS);
 
     m_transport->createConnection(dest_ip, dest_port);
 }
@@ -25,10 +32,22 @@ void InternalOut::onFrame(const Frame& frame)
 {
     char sendBuffer[sizeof(Frame) + 1];
     size_t header_len = sizeof(Frame);
+    TransportDataType type = TRANSPORT_DATA;
+    if (isVideoFrame(frame))
+        type = frame.additionalInfo.video.isKeyFrame ? TRANSPORT_VIDEO_KEY_FRAME : TRANSPORT_VIDEO_DELTA_FRAME;
 
     sendBuffer[0] = TDT_MEDIA_FRAME;
     memcpy(&sendBuffer[1], reinterpret_cast<char*>(const_cast<Frame*>(&frame)), header_len);
-    m_transport->sendData(sendBuffer, header_len + 1, reinterpret_cast<char*>(const_cast<uint8_t*>(frame.payload)), frame.length);
+    // Shares the payload with the producer when it comes in a FrameBuffer.
+    if (m_fragmenter)
+        m_fragmenter->send(sendBuffer, header_len + 1, FramePayload(frame), type);
+    else
+        m_transport->sendData(sendBuffer, header_len + 1, FramePayload(frame), type);
+}
+
+void InternalOut::onTransportKeyFrameNeeded()
+{
+    deliverFeedbackMsg(FeedbackMsg(VIDEO_FEEDBACK, REQUEST_KEY_FRAME));
 }
 
 void InternalOut::onTransportData(char* buf, int len)
@@ -36,6 +55,11 @@ void InternalOut::onTransportData(char* buf, int len)
     switch (buf[0]) {
         case TDT_FEEDBACK_MSG:
             deliverFeedbackMsg(*(reinterpret_cast<FeedbackMsg*>(buf + 1)));
+            break;
+        case TDT_FRAGMENT_NACK:
+            if (m_fragmenter)
+                m_fragmenter->onNack(buf + 1, len - 1);
+            break;
         default:
             break;
     }
@@ -5,6 +5,7 @@
 #ifndef InternalOut_h
 #define InternalOut_h
 
+#include "FrameFragmentation.h"
 #include "MediaFramePipeline.h"
 #include "RawTransport.h"
 
@@ -20,9 +21,15 @@ public:
     void onTransportData(char*, int len);
     void onTransportError() { }
     void onTransportConnected() { }
+    void onTransportKeyFrameNeeded();
+
+    TransportQueueStats getSendQueueStats() { return m_transport->getSendQueueStats(); }
+    void setSendQueueLimits(uint32_t maxBytes, uint32_t maxDelayMs) { m_transport->setSendQueueLimits(maxBytes, maxDelayMs); }
 
 private:
     boost::shared_ptr<owt_base::RawTransportInterface> m_transport;
+    // Only for UDP, where frames larger than a datagram are fragmented.
+    boost::scoped_ptr<FrameFragmenter> m_fragmenter;
 };
 
 } /* namespace owt_base */
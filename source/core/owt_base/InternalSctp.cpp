@@ -47,6 +47,8 @@ void InternalSctp::onTransportData(char* buf, int len)
         case TDT_MEDIA_FRAME:
             frame = reinterpret_cast<Frame*>(buf + 1);
             frame->payload = reinterpret_cast<uint8_t*>(buf + 1 + sizeof(Frame));
+            frame->buffer = nullptr;
+            frame->padding = 0;
             deliverFrame(*frame);
             break;
         case TDT_FEEDBACK_MSG:
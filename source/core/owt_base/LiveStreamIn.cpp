@@ -9,7 +9,7 @@
 #include <sstream>
 #include <sys/time.h>
 
-#include "MediaUtilities.h"
+#include "NaluScanner.h"
 
 static inline int64_t timeRescale(uint32_t time, AVRational in, AVRational out)
 {
@@ -24,42 +24,41 @@ static inline void notifyAsyncEvent(EventRegistry* handle, const std::string& ev
 
 namespace owt_base {
 
+#define MAX_NALS_PER_SCAN 64
+
 static int filterNALs(uint8_t *data, int size, const std::vector<int> &remove_types, const std::vector<int> &pass_types)
 {
-    int remove_nals_size = 0;
-
-    int nalu_found_length = 0;
-    uint8_t* buffer_start = data;
-    int buffer_length = size;
-    int nalu_start_offset = 0;
-    int nalu_end_offset = 0;
-    int sc_len = 0;
-    int nalu_type;
+    NaluPosition nalus[MAX_NALS_PER_SCAN];
+    int scanned = 0;
+    int filtered_size = 0;
+    int count;
 
     if (remove_types.size() > 0 && pass_types.size() > 0)
         return -1;
 
-    while (buffer_length > 0) {
-        nalu_found_length = findNALU(buffer_start, buffer_length, &nalu_start_offset, &nalu_end_offset, &sc_len);
-        if (nalu_found_length < 0) {
-            /* Error, should never happen */
-            break;
-        }
+    do {
+        count = scanNalus(data + scanned, size - scanned, nalus, MAX_NALS_PER_SCAN);
+        for (int i = 0; i < count; i++) {
+            // A NAL goes with the bytes between the previous one and its start code
+            int begin = (i == 0) ? scanned : scanned + nalus[i - 1].payloadOffset + nalus[i - 1].length;
+            int end = scanned + nalus[i].payloadOffset + nalus[i].length;
+            int nalu_type = h264NaluType(nalus[i]);
 
-        nalu_type = buffer_start[nalu_start_offset] & 0x1F;
-        if ((remove_types.size() > 0 && find(remove_types.begin(), remove_types.end(), nalu_type) != remove_types.end())
-                || (pass_types.size() > 0 && find(pass_types.begin(), pass_types.end(), nalu_type) == pass_types.end())) {
-            memmove(buffer_start, buffer_start + nalu_start_offset + nalu_found_length, buffer_length - nalu_start_offset - nalu_found_length);
-            buffer_length -= nalu_start_offset + nalu_found_length;
+            if ((remove_types.size() > 0 && find(remove_types.begin(), remove_types.end(), nalu_type) != remove_types.end())
+                    || (pass_types.size() > 0 && find(pass_types.begin(), pass_types.end(), nalu_type) == pass_types.end())) {
+                continue;
+            }
 
-            remove_nals_size += nalu_start_offset + nalu_found_length;
-            continue;
+            if (begin != filtered_size)
+                memmove(data + filtered_size, data + begin, end - begin);
+            filtered_size += end - begin;
         }
 
-        buffer_start += (nalu_start_offset + nalu_found_length);
-        buffer_length -= (nalu_start_offset + nalu_found_length);
-    }
-    return size - remove_nals_size;
+        if (count > 0)
+            scanned += nalus[count - 1].payloadOffset + nalus[count - 1].length;
+    } while (count == MAX_NALS_PER_SCAN);
+
+    return scanned > 0 ? filtered_size : size;
 }
 
 FramePacket::FramePacket (AVPacket *packet)
@@ -1240,6 +1239,8 @@ void LiveStreamIn::deliverVideoFrame(AVPacket *pkt)
     frame.format = m_videoFormat;
     frame.payload = reinterpret_cast<uint8_t*>(pkt->data);
     frame.length = pkt->size;
+    // Packets of libavformat are padded.
+    frame.padding = AV_INPUT_BUFFER_PADDING_SIZE;
     frame.timeStamp = timeRescale(pkt->dts, m_msTimeBase, m_videoTimeBase);
     frame.additionalInfo.video.width = m_videoWidth;
     frame.additionalInfo.video.height = m_videoHeight;
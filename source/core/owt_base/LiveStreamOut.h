@@ -54,6 +54,7 @@ protected:
 
     uint32_t getKeyFrameInterval(void) override {return 2000;}
     uint32_t getReconnectCount(void) override {return 1;}
+    MediaFrameQueue::OverflowPolicy getQueueOverflowPolicy(void) override {return MediaFrameQueue::OVERFLOW_DROP_GOP;}
 
 private:
     StreamingOptions m_options;
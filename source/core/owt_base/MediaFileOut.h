@@ -28,6 +28,7 @@ protected:
 
     uint32_t getKeyFrameInterval(void) override {return 120000;} //120s
     uint32_t getReconnectCount(void) override {return 0;}
+    MediaFrameQueue::OverflowPolicy getQueueOverflowPolicy(void) override {return MediaFrameQueue::OVERFLOW_SPILL;}
 };
 
 } /* namespace owt_base */
@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <string>
 
+#include "FrameBuffer.h"
+
 namespace owt_base {
 
 enum FrameFormat {
@@ -79,6 +81,77 @@ struct Frame {
     uint32_t        length;
     uint32_t        timeStamp;
     MediaSpecInfo   additionalInfo;
+    // Optional refcounted owner of payload, only guaranteed to be alive during onFrame.
+    // Consumers keeping the payload beyond that should hold it through a FramePayload.
+    FrameBuffer*    buffer;
+    // The number of bytes after the payload reserved for it, which the consumers
+    // may overwrite during onFrame, e.g. to zero the padding of a decoder, unless
+    // the buffer is shared with consumers holding it beyond onFrame.
+    uint32_t        padding;
+};
+
+/**
+ * A reference to the payload of a Frame that can outlive onFrame. It shares
+ * the producer's FrameBuffer when there is one, and falls back to copying
+ * the payload for producers passing a plain pointer. Copies come with
+ * FRAME_BUFFER_PADDING zeroed bytes of padding.
+ */
+class FramePayload {
+public:
+    FramePayload()
+        : m_data(nullptr)
+        , m_length(0)
+        , m_padding(0)
+    {
+    }
+
+    explicit FramePayload(const Frame& frame)
+        : FramePayload(frame.buffer, frame.payload, frame.length, frame.padding)
+    {
+    }
+
+    FramePayload(FrameBuffer* owner, uint8_t* data, uint32_t length, uint32_t padding = 0)
+        : m_data(data)
+        , m_length(length)
+        , m_padding(0)
+    {
+        // Don't pin a large receive buffer for a small payload, e.g. an audio frame.
+        if (owner
+                && owner->contains(data, length)
+                && length >= owner->capacity() / 4) {
+            m_buffer = owner;
+            if (owner->contains(data, length + padding))
+                m_padding = padding;
+        } else if (length > 0) {
+            m_buffer = FrameBuffer::create(length + FRAME_BUFFER_PADDING);
+            memcpy(m_buffer->data(), data, length);
+            memset(m_buffer->data() + length, 0, FRAME_BUFFER_PADDING);
+            m_data = m_buffer->data();
+            m_padding = FRAME_BUFFER_PADDING;
+        }
+    }
+
+    uint8_t* data() const { return m_data; }
+    uint32_t length() const { return m_length; }
+    uint32_t padding() const { return m_padding; }
+    FrameBuffer* buffer() const { return m_buffer.get(); }
+
+    // A reference to a part of this payload, sharing the same buffer.
+    FramePayload slice(uint32_t offset, uint32_t length) const
+    {
+        FramePayload part(*this);
+        part.m_data = m_data + offset;
+        part.m_length = length;
+        // What follows a part in the middle is the rest of the payload.
+        part.m_padding = (offset + length == m_length) ? m_padding : 0;
+        return part;
+    }
+
+private:
+    boost::intrusive_ptr<FrameBuffer> m_buffer;
+    uint8_t* m_data;
+    uint32_t m_length;
+    uint32_t m_padding;
 };
 
 inline FrameFormat getFormat(const std::string& codec) {
@@ -270,10 +343,21 @@ private:
     boost::shared_mutex m_video_src_mutex;
 };
 
+struct VideoDecoderStats {
+    static const uint32_t kHistogramBuckets = 7;
+
+    uint32_t decodedFrames;
+    uint32_t droppedFrames;     // flushed when falling behind, or waiting for a key frame
+    uint32_t decodeTimeUs;      // of the last decoded frame
+    uint32_t maxDecodeTimeUs;
+    uint32_t decodeTimeHistogram[kHistogramBuckets]; // <2, <5, <10, <20, <40, <80, >=80ms
+};
+
 class VideoFrameDecoder : public FrameSource, public FrameDestination {
 public:
     virtual ~VideoFrameDecoder() { }
     virtual bool init(FrameFormat) = 0;
+    virtual bool getStats(VideoDecoderStats& stats) { return false; }
 };
 
 class VideoFrameProcesser : public FrameSource, public FrameDestination {
@@ -290,6 +374,15 @@ public:
     virtual bool init(FrameFormat format, const uint32_t width, const uint32_t height, const uint32_t frameRate, const std::string& pluginName) = 0;
 };
 
+struct VideoEncoderStats {
+    uint32_t encodedFrames;
+    uint32_t skippedFrames;     // replaced by a newer frame before being encoded
+    uint32_t queueLatencyMs;    // of the last encoded frame
+    uint32_t maxQueueLatencyMs;
+    uint32_t encodeTimeUs;      // of the last encoded frame
+    uint32_t maxEncodeTimeUs;
+};
+
 class VideoFrameEncoder : public FrameDestination {
 public:
     virtual ~VideoFrameEncoder() { }
@@ -302,6 +395,7 @@ public:
     virtual void degenerateStream(int32_t streamId) = 0;
     virtual void setBitrate(unsigned short kbps, int32_t streamId) = 0;
     virtual void requestKeyFrame(int32_t streamId) = 0;
+    virtual bool getStreamStats(int32_t streamId, VideoEncoderStats& stats) { return false; }
 };
 
 }
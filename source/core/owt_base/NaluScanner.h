@@ -0,0 +1,95 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef NaluScanner_h
+#define NaluScanner_h
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace owt_base {
+
+// A NAL of an Annex-B H.264/H.265 bitstream.
+struct NaluPosition {
+    int offset;         // of the start code, 3 or 4 bytes
+    int payloadOffset;  // of the NAL header
+    int length;         // from the NAL header up to the next start code
+    uint8_t header;     // first byte of the NAL header, 0 if the NAL is empty
+};
+
+inline uint8_t h264NaluType(const NaluPosition& nalu) { return nalu.header & 0x1F; }
+inline uint8_t h265NaluType(const NaluPosition& nalu) { return (nalu.header >> 1) & 0x3F; }
+
+// Returns the position of the next 00 00 01 from buf + from, or size if none.
+inline int findStartCode(const uint8_t* buf, int size, int from)
+{
+    int i = from + 2;
+
+    // The 01 whose two previous bytes are 00, a whole vector at a time.
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    for (; i + 32 <= size; i += 32) {
+        __m256i ones = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i)), one);
+        __m256i zeros1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i - 1)), zero);
+        __m256i zeros2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i - 2)), zero);
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(ones, _mm256_and_si256(zeros1, zeros2)));
+        if (mask)
+            return i + __builtin_ctz(mask) - 2;
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= size; i += 16) {
+        __m128i ones = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i)), one);
+        __m128i zeros1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i - 1)), zero);
+        __m128i zeros2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i - 2)), zero);
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(ones, _mm_and_si128(zeros1, zeros2)));
+        if (mask)
+            return i + __builtin_ctz(mask) - 2;
+    }
+#endif
+
+    for (; i < size; i++) {
+        if (buf[i] == 1 && buf[i - 1] == 0 && buf[i - 2] == 0)
+            return i - 2;
+    }
+    return size;
+}
+
+/*
+ * Locates the NALs of an Annex-B bitstream, the same way as consecutive
+ * findNALU calls do: the bytes before the first start code are skipped, and
+ * a zero before a 00 00 01 makes it a 4 bytes start code. Returns the number
+ * of NALs found, at most maxNalus. If there are more, scanning again from the
+ * end of the last one returned gives the next ones.
+ */
+inline int scanNalus(const uint8_t* buf, int size, NaluPosition* nalus, int maxNalus)
+{
+    int count = 0;
+    int startCode = findStartCode(buf, size, 0);
+
+    while (startCode < size && count < maxNalus) {
+        NaluPosition& nalu = nalus[count++];
+        nalu.offset = (startCode > 0 && buf[startCode - 1] == 0) ? startCode - 1 : startCode;
+        nalu.payloadOffset = startCode + 3;
+
+        startCode = findStartCode(buf, size, nalu.payloadOffset);
+        int end = size;
+        if (startCode < size)
+            end = (buf[startCode - 1] == 0) ? startCode - 1 : startCode;
+        nalu.length = end - nalu.payloadOffset;
+        nalu.header = nalu.length > 0 ? buf[nalu.payloadOffset] : 0;
+    }
+    return count;
+}
+
+}
+
+#endif // NaluScanner_h
@@ -0,0 +1,146 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Measure the NAL scanning of 4K H.264 key frames by scanNalus against the
+// findNALU loop it replaces
+//
+// Usage: NaluScannerBenchmark [frames] [frameSize] [slices]
+//
+// The frames are made of AUD, SPS, PPS and SEI NALs followed by IDR slices
+// of random bytes, with the emulation prevention bytes a real bitstream
+// would have. The vector path is chosen at build time, build it with -mavx2
+// to measure the AVX2 one.
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdlib.h>
+
+#include "MediaUtilities.h"
+#include "NaluScanner.h"
+
+using namespace std;
+using namespace owt_base;
+
+static const int kMaxBatch = 64;
+// Distinct frames scanned in turn, more than the last level cache holds.
+static const int kFrameCount = 16;
+
+static const char* scannerPath()
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+static void appendNalu(vector<uint8_t>& frame, uint8_t header, size_t size, mt19937& random)
+{
+    const uint8_t startCode[] = {0, 0, 0, 1};
+    frame.insert(frame.end(), startCode, startCode + sizeof(startCode));
+    frame.push_back(header);
+
+    // No 00 00 0x with x <= 3 in the payload, as the encoder inserts a 03.
+    int zeros = 0;
+    for (size_t i = 0; i < size; i++) {
+        uint8_t byte = random() & 0xff;
+        if (zeros >= 2 && byte <= 3) {
+            frame.push_back(3);
+            zeros = 0;
+        }
+        frame.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+    // The payload of a NAL never ends with a zero.
+    if (frame.back() == 0)
+        frame.back() = 0x80;
+}
+
+static vector<uint8_t> createKeyFrame(size_t frameSize, int slices, mt19937& random)
+{
+    vector<uint8_t> frame;
+    appendNalu(frame, 0x09, 1, random);
+    appendNalu(frame, 0x67, 24, random);
+    appendNalu(frame, 0x68, 4, random);
+    appendNalu(frame, 0x06, 32, random);
+    for (int i = 0; i < slices; i++)
+        appendNalu(frame, 0x65, frameSize / slices, random);
+    return frame;
+}
+
+static int findNalusReference(uint8_t* buf, int size)
+{
+    int count = 0;
+    int scanned = 0;
+    while (scanned < size) {
+        int start, end, scLen;
+        int length = findNALU(buf + scanned, size - scanned, &start, &end, &scLen);
+        if (length < 0)
+            break;
+        count++;
+        scanned += start + length;
+    }
+    return count;
+}
+
+static int scanNalusBatched(const uint8_t* buf, int size)
+{
+    NaluPosition nalus[kMaxBatch];
+    int total = 0;
+    int scanned = 0;
+    int count;
+    do {
+        count = scanNalus(buf + scanned, size - scanned, nalus, kMaxBatch);
+        total += count;
+        if (count > 0)
+            scanned += nalus[count - 1].payloadOffset + nalus[count - 1].length;
+    } while (count == kMaxBatch);
+    return total;
+}
+
+template <typename ScanFunc>
+static double runCase(const char* name, vector<vector<uint8_t>>& frames, uint32_t iterations, int expectedNalus, ScanFunc scan)
+{
+    uint64_t bytes = 0;
+    uint64_t nalus = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        vector<uint8_t>& frame = frames[i % frames.size()];
+        nalus += scan(frame.data(), frame.size());
+        bytes += frame.size();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (nalus != (uint64_t)expectedNalus * iterations)
+        cout << name << ": found " << nalus << " NALs, expected " << (uint64_t)expectedNalus * iterations << endl;
+    cout << name << ": " << iterations << " frames in " << elapsed << "s, "
+         << (uint64_t)(iterations / elapsed) << " frames/s, "
+         << (uint64_t)(bytes / elapsed / 1000000) << " MB/s" << endl;
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t frameSize = argc > 2 ? atoi(argv[2]) : 1000000;
+    int slices = argc > 3 ? atoi(argv[3]) : 8;
+
+    // A 4K key frame is about 1MB at the 16Mbps calcBitrate gives it.
+    mt19937 random(1);
+    vector<vector<uint8_t>> frames;
+    for (int i = 0; i < kFrameCount; i++)
+        frames.push_back(createKeyFrame(frameSize, slices, random));
+    int expectedNalus = 4 + slices;
+
+    cout << scannerPath() << " scanner, key frames of " << frames[0].size() << " bytes, " << expectedNalus << " NALs" << endl;
+    double reference = runCase("findNALU", frames, iterations, expectedNalus, findNalusReference);
+    double scanner = runCase("scanNalus", frames, iterations, expectedNalus, scanNalusBatched);
+    cout << "speedup " << reference / scanner << "x" << endl;
+    cout << "finish benchmark" << endl;
+    return 0;
+}
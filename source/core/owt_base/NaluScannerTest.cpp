@@ -0,0 +1,169 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Fuzz scanNalus against the findNALU loop it replaces, on random bitstreams
+// full of start codes, at random alignments and in batches of any size.
+// findStartCode is checked against a byte by byte search from every offset.
+//
+// Usage: NaluScannerTest [iterations] [seed]
+//
+// The vector path is chosen at build time, build it with -mavx2 and with
+// -mno-sse2 as well to cover the AVX2 and the scalar paths.
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <cassert>
+#include <string.h>
+#include <stdlib.h>
+
+#include "MediaUtilities.h"
+#include "NaluScanner.h"
+
+using namespace std;
+using namespace owt_base;
+
+static const int kMaxBatch = 64;
+
+static const char* scannerPath()
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+// The NALs as VideoFramePacketizer used to locate them.
+static vector<NaluPosition> findNalusReference(uint8_t* buf, int size)
+{
+    vector<NaluPosition> nalus;
+    int scanned = 0;
+    while (scanned < size) {
+        int start, end, scLen;
+        int length = findNALU(buf + scanned, size - scanned, &start, &end, &scLen);
+        if (length < 0)
+            break;
+        NaluPosition nalu;
+        nalu.offset = scanned + start - scLen;
+        nalu.payloadOffset = scanned + start;
+        nalu.length = length;
+        nalu.header = length > 0 ? buf[nalu.payloadOffset] : 0;
+        nalus.push_back(nalu);
+        scanned += start + length;
+    }
+    return nalus;
+}
+
+// The NALs as the scanner users locate them, maxNalus at a time.
+static vector<NaluPosition> scanNalusBatched(const uint8_t* buf, int size, int maxNalus)
+{
+    vector<NaluPosition> nalus;
+    NaluPosition batch[kMaxBatch];
+    int scanned = 0;
+    int count;
+    do {
+        count = scanNalus(buf + scanned, size - scanned, batch, maxNalus);
+        for (int i = 0; i < count; i++) {
+            NaluPosition nalu = batch[i];
+            nalu.offset += scanned;
+            nalu.payloadOffset += scanned;
+            nalus.push_back(nalu);
+        }
+        if (count > 0)
+            scanned += batch[count - 1].payloadOffset + batch[count - 1].length;
+    } while (count == maxNalus);
+    return nalus;
+}
+
+static int findStartCodeReference(const uint8_t* buf, int size, int from)
+{
+    for (int i = from; i + 2 < size; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1)
+            return i;
+    }
+    return size;
+}
+
+static bool sameNalus(const vector<NaluPosition>& a, const vector<NaluPosition>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].offset != b[i].offset || a[i].payloadOffset != b[i].payloadOffset
+                || a[i].length != b[i].length || a[i].header != b[i].header)
+            return false;
+    }
+    return true;
+}
+
+static void dump(const char* what, const uint8_t* buf, int size, const vector<NaluPosition>& expected, const vector<NaluPosition>& got)
+{
+    cout << what << " mismatch on " << size << " bytes:" << hex << setfill('0');
+    for (int i = 0; i < size; i++)
+        cout << " " << setw(2) << (int)buf[i];
+    cout << dec << endl;
+    for (auto& nalu : expected)
+        cout << "  expected " << nalu.offset << "/" << nalu.payloadOffset << "/" << nalu.length << "/" << (int)nalu.header << endl;
+    for (auto& nalu : got)
+        cout << "  got      " << nalu.offset << "/" << nalu.payloadOffset << "/" << nalu.length << "/" << (int)nalu.header << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    uint32_t seed = argc > 2 ? atoi(argv[2]) : 1;
+    mt19937 random(seed);
+    uint32_t mismatches = 0;
+    uint64_t naluCount = 0;
+
+    for (uint32_t n = 0; n < iterations && mismatches < 10; n++) {
+        // Mostly short streams, crossing a few vectors, and some longer ones.
+        int size = (n % 16 == 0) ? random() % 4096 : random() % 160;
+        int align = random() % 32;
+        // Zeros and ones make most of the bytes, for the start codes to be
+        // close, back to back and preceded by runs of zeros.
+        uint32_t zeros = 30 + random() % 50;
+        uint32_t ones = 5 + random() % 30;
+
+        // Sized to the stream for the sanitizers to catch any overread.
+        vector<uint8_t> storage(align + size);
+        uint8_t* buf = storage.data() + align;
+        for (int i = 0; i < size; i++) {
+            uint32_t r = random() % 100;
+            buf[i] = r < zeros ? 0 : (r < zeros + ones ? 1 : random() & 0xff);
+        }
+
+        vector<NaluPosition> expected = findNalusReference(buf, size);
+        naluCount += expected.size();
+        int batches[] = {1, 2, 3, kMaxBatch};
+        for (int maxNalus : batches) {
+            vector<NaluPosition> got = scanNalusBatched(buf, size, maxNalus);
+            if (!sameNalus(expected, got)) {
+                dump("scanNalus", buf, size, expected, got);
+                mismatches++;
+                break;
+            }
+        }
+
+        for (int from = 0; from <= size; from++) {
+            int expectedStart = findStartCodeReference(buf, size, from);
+            int gotStart = findStartCode(buf, size, from);
+            if (expectedStart != gotStart) {
+                cout << "findStartCode from " << from << " expected " << expectedStart << " got " << gotStart << endl;
+                dump("findStartCode", buf, size, vector<NaluPosition>(), vector<NaluPosition>());
+                mismatches++;
+                break;
+            }
+        }
+    }
+
+    cout << scannerPath() << " scanner, " << iterations << " streams, " << naluCount << " NALs, mismatches " << mismatches << endl;
+    assert(mismatches == 0);
+    cout << "finish test" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
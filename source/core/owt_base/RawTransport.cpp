@@ -4,7 +4,9 @@
 
 #include "RawTransport.h"
 
+#include <chrono>
 #include <netinet/in.h>
+#include <sys/socket.h>
 
 namespace owt_base {
 
@@ -13,14 +15,40 @@ using boost::asio::ip::tcp;
 
 DEFINE_TEMPLATE_LOGGER(template<Protocol prot>, RawTransport<prot>, "owt.RawTransport");
 
+// Default number of datagrams per recvmmsg/sendmmsg call.
+static const uint32_t UDP_BATCH_SIZE = 32;
+static const uint32_t MAX_UDP_BATCH_SIZE = 64;
+// Upper bound of the memory received into by a single recvmmsg call.
+static const uint32_t UDP_RECEIVE_BUDGET = 256 * 1024;
+// Minimum interval between two key frame requests caused by send queue overflows.
+static const int64_t KEY_FRAME_REQUEST_INTERVAL_MS = 1000;
+
+static int64_t steadyTimeMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 template<Protocol prot>
 RawTransport<prot>::RawTransport(RawTransportListener* listener, size_t initialBufferSize, bool tag)
     : m_isClosing(false)
     , m_tag(tag)
     , m_bufferSize(initialBufferSize)
+    , m_maxQueueBytes(0)
+    , m_maxQueueDelayMs(0)
+    , m_queuedBytes(0)
+    , m_waitingKeyFrame(false)
+    , m_droppingFrame(false)
+    , m_lastKeyFrameRequestMs(0)
+    , m_sendScheduled(false)
+    , m_sendingCount(0)
+    , m_batchSize(UDP_BATCH_SIZE)
+    , m_strand(prot == UDP ? "RawTransport<UDP>" : "RawTransport<TCP>")
+    , m_timerIntervalMs(0)
+    , m_timerGeneration(0)
     , m_listener(listener)
     , m_receivedBytes(0)
 {
+    memset(&m_queueStats, 0, sizeof(m_queueStats));
 }
 
 template<Protocol prot>
@@ -36,31 +64,39 @@ void RawTransport<prot>::close()
     if (m_isClosing)
         return;
 
-    // We need to wait for the work thread to finish its job.
+    // Close the sockets on the strand and wait for all the pending handlers
+    // (which are now aborted) to finish their job.
     m_isClosing = true;
-    m_ioService.stop();
-    m_workThread.join();
+    m_strand.post(boost::bind(&RawTransport::closeSockets, this));
+    m_strand.drain();
+    ELOG_DEBUG("Closed");
+}
 
+template<Protocol prot>
+void RawTransport<prot>::closeSockets()
+{
     boost::system::error_code ec;
+    if (m_timer)
+        m_timer->cancel(ec);
+
     switch (prot) {
     case TCP:
         if (m_socket.tcp.acceptor)
-            m_socket.tcp.acceptor->close();
+            m_socket.tcp.acceptor->close(ec);
         if (m_socket.tcp.socket) {
             m_socket.tcp.socket->shutdown(tcp::socket::shutdown_both, ec);
-            m_socket.tcp.socket->close();
+            m_socket.tcp.socket->close(ec);
         }
         break;
     case UDP:
         if (m_socket.udp.socket) {
             m_socket.udp.socket->shutdown(udp::socket::shutdown_both, ec);
-            m_socket.udp.socket->close();
+            m_socket.udp.socket->close(ec);
         }
         break;
     default:
         break;
     }
-    ELOG_DEBUG("Closed");
 }
 
 template<Protocol prot>
@@ -71,15 +107,15 @@ void RawTransport<prot>::createConnection(const std::string& ip, uint32_t port)
         if (m_socket.tcp.socket) {
             ELOG_WARN("TCP transport existed, ignoring the connection request for ip %s port %d\n", ip.c_str(), port);
         } else {
-            m_socket.tcp.socket.reset(new tcp::socket(m_ioService));
-            tcp::resolver resolver(m_ioService);
+            m_socket.tcp.socket.reset(new tcp::socket(m_strand.ioService()));
+            tcp::resolver resolver(m_strand.ioService());
             tcp::resolver::query query(ip.c_str(), boost::to_string(port).c_str());
             tcp::resolver::iterator iterator = resolver.resolve(query);
             // TODO: Accept IPv6.
             m_socket.tcp.socket->open(boost::asio::ip::tcp::v4());
             m_socket.tcp.socket->async_connect(*iterator,
-                boost::bind(&RawTransport::connectHandler, this,
-                    boost::asio::placeholders::error));
+                m_strand.wrap(boost::bind(&RawTransport::connectHandler, this,
+                    boost::asio::placeholders::error)));
         }
         break;
     }
@@ -87,25 +123,22 @@ void RawTransport<prot>::createConnection(const std::string& ip, uint32_t port)
         if (m_socket.udp.socket) {
             ELOG_WARN("UDP transport existed, ignoring the connection request for ip %s port %d\n", ip.c_str(), port);
         } else {
-            m_socket.udp.socket.reset(new udp::socket(m_ioService));
-            udp::resolver resolver(m_ioService);
+            m_socket.udp.socket.reset(new udp::socket(m_strand.ioService()));
+            udp::resolver resolver(m_strand.ioService());
             udp::resolver::query query(udp::v4(), ip.c_str(), boost::to_string(port).c_str());
             udp::resolver::iterator iterator = resolver.resolve(query);
 
             m_socket.udp.remoteEndpoint = *iterator;
 
             m_socket.udp.socket->async_connect(*iterator,
-                boost::bind(&RawTransport::connectHandler, this,
-                    boost::asio::placeholders::error));
+                m_strand.wrap(boost::bind(&RawTransport::connectHandler, this,
+                    boost::asio::placeholders::error)));
         }
         break;
     }
     default:
         break;
     }
-
-    if (m_workThread.get_id() == boost::thread::id()) // Not-A-Thread
-        m_workThread = boost::thread(boost::bind(&boost::asio::io_service::run, &m_ioService));
 }
 
 template<Protocol prot>
@@ -179,11 +212,11 @@ void RawTransport<prot>::listenTo(uint32_t port)
         if (m_socket.tcp.socket) {
             ELOG_WARN("TCP transport existed, ignoring the listening request for port %d\n", port);
         } else {
-            m_socket.tcp.socket.reset(new tcp::socket(m_ioService));
-            m_socket.tcp.acceptor.reset(new tcp::acceptor(m_ioService, tcp::endpoint(tcp::v4(), port)));
+            m_socket.tcp.socket.reset(new tcp::socket(m_strand.ioService()));
+            m_socket.tcp.acceptor.reset(new tcp::acceptor(m_strand.ioService(), tcp::endpoint(tcp::v4(), port)));
             m_socket.tcp.acceptor->async_accept(*(m_socket.tcp.socket.get()),
-                boost::bind(&RawTransport::acceptHandler, this,
-                    boost::asio::placeholders::error));
+                m_strand.wrap(boost::bind(&RawTransport::acceptHandler, this,
+                    boost::asio::placeholders::error)));
             ELOG_DEBUG("TCP transport listening on %s:%d", m_socket.tcp.acceptor->local_endpoint().address().to_string().c_str(), m_socket.tcp.acceptor->local_endpoint().port());
         }
         break;
@@ -192,7 +225,7 @@ void RawTransport<prot>::listenTo(uint32_t port)
         if (m_socket.udp.socket) {
             ELOG_WARN("UDP transport existed, ignoring the listening request for port %d\n", port);
         } else {
-            m_socket.udp.socket.reset(new udp::socket(m_ioService, udp::endpoint(udp::v4(), port)));
+            m_socket.udp.socket.reset(new udp::socket(m_strand.ioService(), udp::endpoint(udp::v4(), port)));
             receiveData();
         }
         break;
@@ -200,9 +233,6 @@ void RawTransport<prot>::listenTo(uint32_t port)
     default:
         break;
     }
-
-    if (m_workThread.get_id() == boost::thread::id()) // Not-A-Thread
-        m_workThread = boost::thread(boost::bind(&boost::asio::io_service::run, &m_ioService));
 }
 
 template<Protocol prot>
@@ -213,7 +243,7 @@ void RawTransport<prot>::listenTo(uint32_t minPort, uint32_t maxPort)
         if (m_socket.tcp.socket) {
             ELOG_WARN("TCP transport existed, ignoring the listening request for minPort %d, maxPort %d\n", minPort, maxPort);
         } else {
-            m_socket.tcp.socket.reset(new tcp::socket(m_ioService));
+            m_socket.tcp.socket.reset(new tcp::socket(m_strand.ioService()));
 
             // find port in range
             uint32_t portRange = maxPort - minPort + 1;
@@ -221,7 +251,7 @@ void RawTransport<prot>::listenTo(uint32_t minPort, uint32_t maxPort)
             boost::system::error_code ec;
 
             for (uint32_t i = 0; i < portRange; i++) {
-                m_socket.tcp.acceptor.reset(new tcp::acceptor(m_ioService));
+                m_socket.tcp.acceptor.reset(new tcp::acceptor(m_strand.ioService()));
                 m_socket.tcp.acceptor->open(tcp::v4());
                 m_socket.tcp.acceptor->bind(tcp::endpoint(tcp::v4(), port), ec);
 
@@ -247,8 +277,8 @@ void RawTransport<prot>::listenTo(uint32_t minPort, uint32_t maxPort)
             if (!ec) {
                 ELOG_DEBUG("TCP transport listening on %s:%d(range:%d ~ %d)", m_socket.tcp.acceptor->local_endpoint().address().to_string().c_str(), m_socket.tcp.acceptor->local_endpoint().port(), minPort, maxPort);
                 m_socket.tcp.acceptor->async_accept(*(m_socket.tcp.socket.get()),
-                boost::bind(&RawTransport::acceptHandler, this,
-                    boost::asio::placeholders::error));
+                m_strand.wrap(boost::bind(&RawTransport::acceptHandler, this,
+                    boost::asio::placeholders::error)));
             } else {
                 ELOG_ERROR("Error(%s) in listening on port range %d ~ %d, last try on %d", ec.message().c_str(), minPort, maxPort, m_socket.tcp.acceptor->local_endpoint().port());
             }
@@ -260,7 +290,7 @@ void RawTransport<prot>::listenTo(uint32_t minPort, uint32_t maxPort)
             ELOG_WARN("UDP transport existed, ignoring the listening request for minPort %d, maxPort %d\n", minPort, maxPort);
         } else {
             ELOG_WARN("UDP transport does not support listening in specific range.");
-            m_socket.udp.socket.reset(new udp::socket(m_ioService, udp::endpoint(udp::v4(), 0)));
+            m_socket.udp.socket.reset(new udp::socket(m_strand.ioService(), udp::endpoint(udp::v4(), 0)));
             receiveData();
         }
         break;
@@ -268,9 +298,6 @@ void RawTransport<prot>::listenTo(uint32_t minPort, uint32_t maxPort)
     default:
         break;
     }
-
-    if (m_workThread.get_id() == boost::thread::id()) // Not-A-Thread
-        m_workThread = boost::thread(boost::bind(&boost::asio::io_service::run, &m_ioService));
 }
 
 template<Protocol prot>
@@ -305,7 +332,7 @@ void RawTransport<prot>::readHandler(const boost::system::error_code& ec, std::s
 
     if (!ec || ec == boost::asio::error::message_size) {
         if (!m_tag) {
-            m_listener->onTransportData(m_receiveData.buffer.get(), bytes);
+            deliverData(receiveBuffer(), bytes);
             receiveData();
             return;
         }
@@ -320,39 +347,27 @@ void RawTransport<prot>::readHandler(const boost::system::error_code& ec, std::s
             if (4 > m_receivedBytes) {
                 ELOG_DEBUG("Incomplete header, continue receiving %u bytes", 4 - m_receivedBytes);
                 m_socket.tcp.socket->async_read_some(boost::asio::buffer(m_readHeader + m_receivedBytes, 4 - m_receivedBytes),
-                        boost::bind(&RawTransport::readHandler, this,
+                        m_strand.wrap(boost::bind(&RawTransport::readHandler, this,
                             boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
+                            boost::asio::placeholders::bytes_transferred)));
             } else {
                 payloadlen = ntohl(*(reinterpret_cast<uint32_t*>(m_readHeader)));
                 if (payloadlen > m_bufferSize) {
                     m_bufferSize = ((payloadlen * BUFFER_EXPANSION_MULTIPLIER + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT) * BUFFER_ALIGNMENT;
                     ELOG_DEBUG("Increasing the buffer size: %zu", m_bufferSize);
-                    m_receiveData.buffer.reset(new char[m_bufferSize]);
+                    m_receiveBuffer = FrameBuffer::create(m_bufferSize + FRAME_BUFFER_PADDING);
                 }
                 ELOG_DEBUG("readHandler(%zu):[%x,%x,%x,%x], payloadlen:%u", bytes, m_readHeader[0], m_readHeader[1], (unsigned char)m_readHeader[2], (unsigned char)m_readHeader[3], payloadlen);
 
                 m_receivedBytes = 0;
-                m_socket.tcp.socket->async_read_some(boost::asio::buffer(m_receiveData.buffer.get(), payloadlen),
-                    boost::bind(&RawTransport::readPacketHandler, this,
+                m_socket.tcp.socket->async_read_some(boost::asio::buffer(receiveBuffer(), payloadlen),
+                    m_strand.wrap(boost::bind(&RawTransport::readPacketHandler, this,
                         boost::asio::placeholders::error,
-                        boost::asio::placeholders::bytes_transferred));
+                        boost::asio::placeholders::bytes_transferred)));
             }
             break;
         case UDP:
-            assert(m_socket.udp.socket);
-
-            payloadlen = ntohl(*(reinterpret_cast<uint32_t*>(m_receiveData.buffer.get())));
-            if (bytes != payloadlen + 4) {
-                // FIXME: Make UDP work with large packets.
-                ELOG_WARN("Packet incomplete. with payloadlen:%u, bytes:%zu", payloadlen, bytes);
-            } else {
-                unsigned char *p = reinterpret_cast<unsigned char*>(&(m_receiveData.buffer.get())[4]);
-                ELOG_DEBUG("readHandler(%zu): [%x,%x,%x,%x,%x,%x,%x,%x,%x,%x,%x,%x,%x,%x,%x,%x...%x,%x,%x,%x]", bytes, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15], p[payloadlen-4], p[payloadlen-3], p[payloadlen-2], p[payloadlen-1]);
-                m_listener->onTransportData(m_receiveData.buffer.get() + 4, payloadlen);
-            }
-
-            receiveData();
+            ELOG_WARN("Should not run into readHandler under udp mode");
             break;
         default:
             break;
@@ -379,13 +394,13 @@ void RawTransport<prot>::readPacketHandler(const boost::system::error_code& ec,
             if (expectedLen > m_receivedBytes) {
                 ELOG_DEBUG("Expect to receive %u bytes, but actually received %zu bytes.", expectedLen, bytes);
                 ELOG_DEBUG("Continue receiving %u bytes.", expectedLen - m_receivedBytes);
-                m_socket.tcp.socket->async_read_some(boost::asio::buffer(m_receiveData.buffer.get() + m_receivedBytes, expectedLen - m_receivedBytes),
-                        boost::bind(&RawTransport::readPacketHandler, this,
+                m_socket.tcp.socket->async_read_some(boost::asio::buffer(receiveBuffer() + m_receivedBytes, expectedLen - m_receivedBytes),
+                        m_strand.wrap(boost::bind(&RawTransport::readPacketHandler, this,
                             boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
+                            boost::asio::placeholders::bytes_transferred)));
             } else {
                 m_receivedBytes = 0;
-                m_listener->onTransportData(m_receiveData.buffer.get(), expectedLen);
+                deliverData(receiveBuffer(), expectedLen);
                 receiveData();
             }
             break;
@@ -402,39 +417,49 @@ void RawTransport<prot>::readPacketHandler(const boost::system::error_code& ec,
     }
 }
 
+// Upper bound of the buffers gathered into a single writev on TCP.
+static const size_t MAX_GATHERED_BUFFERS = 64;
+
 template<Protocol prot>
 void RawTransport<prot>::doSend()
 {
     if (m_isClosing)
         return;
 
-    TransportData& data = m_sendQueue.front();
+    if (prot == UDP) {
+        doSendBatch();
+        return;
+    }
+
+    m_sendBuffers.clear();
+
+    // Queued elements stay in place until writeHandler pops them, and the
+    // deque doesn't move them when new ones are pushed at the back.
+    boost::unique_lock<boost::mutex> lock(m_sendQueueMutex);
+    assert(m_sendScheduled && m_sendingCount == 0);
+    if (m_sendQueue.empty()) {
+        m_sendScheduled = false;
+        return;
+    }
+    for (auto it = m_sendQueue.begin(); it != m_sendQueue.end(); ++it) {
+        if (m_sendingCount > 0 && m_sendBuffers.size() + 2 > MAX_GATHERED_BUFFERS)
+            break;
+
+        m_sendBuffers.push_back(boost::asio::buffer(it->buffer.get(), it->length));
+        if (it->payload.length() > 0)
+            m_sendBuffers.push_back(boost::asio::buffer(it->payload.data(), it->payload.length()));
+        ++m_sendingCount;
+    }
+    lock.unlock();
 
     switch (prot) {
     case TCP:
-        ELOG_DEBUG("Port#%d to send(%d)", m_socket.tcp.socket->local_endpoint().port(), data.length);
+        ELOG_DEBUG("Port#%d to send(%zu items)", m_socket.tcp.socket->local_endpoint().port(), m_sendingCount);
         assert(m_socket.tcp.socket);
-        boost::asio::async_write(*(m_socket.tcp.socket), boost::asio::buffer(data.buffer.get(), data.length),
-            boost::bind(&RawTransport::writeHandler, this,
+        boost::asio::async_write(*(m_socket.tcp.socket), m_sendBuffers,
+            m_strand.wrap(boost::bind(&RawTransport::writeHandler, this,
                 boost::asio::placeholders::error,
-                boost::asio::placeholders::bytes_transferred));
-        break;
-    case UDP:
-        assert(m_socket.udp.socket);
-        if (!m_socket.udp.connected) {
-            boost::system::error_code ignored_error;
-            m_socket.udp.socket->async_send(boost::asio::buffer(data.buffer.get(), data.length),
-                boost::bind(&RawTransport::writeHandler, this,
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
-        } else {
-            boost::system::error_code ignored_error;
-            m_socket.udp.socket->async_send_to(boost::asio::buffer(data.buffer.get(), data.length),
-                m_socket.udp.remoteEndpoint,
-                boost::bind(&RawTransport::writeHandler, this,
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
-        }
+                boost::asio::placeholders::bytes_transferred)));
         break;
     default:
         break;
@@ -453,12 +478,15 @@ void RawTransport<prot>::writeHandler(const boost::system::error_code& ec, std::
 
     ELOG_DEBUG("writeHandler(%zu)", bytes);
 
-    boost::lock_guard<boost::mutex> lock(m_sendQueueMutex);
-    assert(m_sendQueue.size() > 0);
-    m_sendQueue.pop();
+    boost::unique_lock<boost::mutex> lock(m_sendQueueMutex);
+    popSent(m_sendingCount);
 
-    if (m_sendQueue.size() > 0)
+    if (m_sendQueue.size() > 0) {
+        lock.unlock();
         doSend();
+    } else {
+        m_sendScheduled = false;
+    }
 }
 
 template<Protocol prot>
@@ -508,71 +536,405 @@ void RawTransport<prot>::sendData(const char* buf, int len)
         memcpy(data.buffer.get(), buf, len);
         data.length = len;
     }
+    data.type = TRANSPORT_DATA;
 
-    boost::lock_guard<boost::mutex> lock(m_sendQueueMutex);
-    m_sendQueue.push(data);
-    if (m_sendQueue.size() == 1)
-        doSend();
+    enqueue(data);
 }
 
 template<Protocol prot>
 void RawTransport<prot>::sendData(const char* header, int headerLength, const char* payload, int payloadLength)
+{
+    sendData(header, headerLength, FramePayload(nullptr, reinterpret_cast<uint8_t*>(const_cast<char*>(payload)), payloadLength));
+}
+
+template<Protocol prot>
+void RawTransport<prot>::sendData(const char* header, int headerLength, const FramePayload& payload, TransportDataType type)
 {
     TransportData data;
-    if (m_tag) {
-        data.buffer.reset(new char[headerLength + payloadLength + 4]);
-        *(reinterpret_cast<uint32_t*>(data.buffer.get())) = htonl(headerLength + payloadLength);
-        memcpy(data.buffer.get() + 4, header, headerLength);
-        memcpy(data.buffer.get() + 4 + headerLength, payload, payloadLength);
-        data.length = headerLength + payloadLength + 4;
-    } else {
-        data.buffer.reset(new char[headerLength + payloadLength]);
-        memcpy(data.buffer.get(), header, headerLength);
-        memcpy(data.buffer.get() + headerLength, payload, payloadLength);
-        data.length = headerLength + payloadLength;
+    int prefixLength = m_tag ? 4 : 0;
+
+    data.buffer.reset(new char[prefixLength + headerLength]);
+    if (m_tag)
+        *(reinterpret_cast<uint32_t*>(data.buffer.get())) = htonl(headerLength + payload.length());
+    memcpy(data.buffer.get() + prefixLength, header, headerLength);
+    data.length = prefixLength + headerLength;
+    data.payload = payload;
+    data.type = type;
+
+    enqueue(data);
+}
+
+template<Protocol prot>
+void RawTransport<prot>::enqueue(const TransportData& data)
+{
+    uint32_t bytes = data.length + data.payload.length();
+    int64_t nowMs = steadyTimeMs();
+    bool keyFrameNeeded = false;
+
+    boost::unique_lock<boost::mutex> lock(m_sendQueueMutex);
+    if (data.type != TRANSPORT_CONTINUATION) {
+        // The receiver can not decode it after the dropped ones anyway.
+        m_droppingFrame = (data.type == TRANSPORT_VIDEO_DELTA_FRAME && m_waitingKeyFrame);
+        if (data.type == TRANSPORT_VIDEO_KEY_FRAME)
+            m_waitingKeyFrame = false;
+    }
+    if (m_droppingFrame) {
+        m_queueStats.droppedMessages++;
+        m_queueStats.droppedBytes += bytes;
+        return;
     }
 
+    m_sendQueue.push_back(data);
+    m_sendQueue.back().enqueuedMs = nowMs;
+    m_queuedBytes += bytes;
+    if (m_queuedBytes > m_queueStats.maxQueuedBytes)
+        m_queueStats.maxQueuedBytes = m_queuedBytes;
+
+    if (isOverflowing(nowMs))
+        keyFrameNeeded = dropFrames(nowMs);
+
+    if (!m_sendScheduled) {
+        m_sendScheduled = true;
+        m_strand.post(boost::bind(&RawTransport::doSend, this));
+    }
+    lock.unlock();
+
+    if (keyFrameNeeded)
+        m_strand.post(boost::bind(&RawTransport::notifyKeyFrameNeeded, this));
+}
+
+template<Protocol prot>
+bool RawTransport<prot>::isOverflowing(int64_t nowMs)
+{
+    if (m_maxQueueBytes > 0 && m_queuedBytes > m_maxQueueBytes)
+        return true;
+    if (m_maxQueueDelayMs > 0 && !m_sendQueue.empty() && nowMs - m_sendQueue.front().enqueuedMs > m_maxQueueDelayMs)
+        return true;
+    return false;
+}
+
+// Drops the queued video delta frames superseded by the last queued key
+// frame first, and all of them if that is not enough. Returns whether the
+// receiver needs a new key frame. Called with m_sendQueueMutex held.
+template<Protocol prot>
+bool RawTransport<prot>::dropFrames(int64_t nowMs)
+{
+    size_t lastKeyFrame = m_sendingCount;
+    for (size_t i = m_sendingCount; i < m_sendQueue.size(); ++i) {
+        if (m_sendQueue[i].type == TRANSPORT_VIDEO_KEY_FRAME)
+            lastKeyFrame = i;
+    }
+
+    size_t dropped = dropDeltaFrames(lastKeyFrame);
+    if (!isOverflowing(nowMs)) {
+        ELOG_DEBUG("Send queue overflow, dropped %zu messages before a key frame", dropped);
+        return false;
+    }
+
+    dropped = dropDeltaFrames(m_sendQueue.size());
+    ELOG_DEBUG("Send queue overflow, dropped %zu messages, %zu queued, %u bytes", dropped, m_sendQueue.size(), m_queuedBytes);
+    if (dropped == 0)
+        return false;
+
+    // Until the next key frame, the delta frames are dropped as they come.
+    m_waitingKeyFrame = true;
+    if (m_lastKeyFrameRequestMs && nowMs - m_lastKeyFrameRequestMs < KEY_FRAME_REQUEST_INTERVAL_MS)
+        return false;
+
+    m_lastKeyFrameRequestMs = nowMs;
+    m_queueStats.keyFrameRequests++;
+    return true;
+}
+
+// Removes the delta frames starting before end, with their continuations,
+// except the ones being sent, even partly.
+template<Protocol prot>
+size_t RawTransport<prot>::dropDeltaFrames(size_t end)
+{
+    size_t kept = m_sendingCount;
+    size_t size = m_sendQueue.size();
+    bool dropping = false;
+    for (size_t i = m_sendingCount; i < size; ++i) {
+        TransportData& data = m_sendQueue[i];
+        if (data.type != TRANSPORT_CONTINUATION)
+            dropping = (i < end && data.type == TRANSPORT_VIDEO_DELTA_FRAME);
+        if (dropping) {
+            m_queuedBytes -= data.length + data.payload.length();
+            m_queueStats.droppedMessages++;
+            m_queueStats.droppedBytes += data.length + data.payload.length();
+            // The continuations yet to be enqueued go with it.
+            if (i == size - 1)
+                m_droppingFrame = true;
+            continue;
+        }
+        if (kept != i)
+            m_sendQueue[kept] = data;
+        ++kept;
+    }
+    m_sendQueue.erase(m_sendQueue.begin() + kept, m_sendQueue.end());
+    return size - kept;
+}
+
+template<Protocol prot>
+void RawTransport<prot>::popSent(size_t count)
+{
+    assert(m_sendQueue.size() >= count);
+    for (size_t i = 0; i < count; ++i) {
+        m_queuedBytes -= m_sendQueue.front().length + m_sendQueue.front().payload.length();
+        m_sendQueue.pop_front();
+    }
+    m_sendingCount = 0;
+}
+
+template<Protocol prot>
+void RawTransport<prot>::notifyKeyFrameNeeded()
+{
+    if (m_isClosing)
+        return;
+
+    ELOG_INFO("Request key frame after dropping video frames from the send queue");
+    m_listener->onTransportKeyFrameNeeded();
+}
+
+template<Protocol prot>
+void RawTransport<prot>::setSendQueueLimits(uint32_t maxBytes, uint32_t maxDelayMs)
+{
     boost::lock_guard<boost::mutex> lock(m_sendQueueMutex);
-    m_sendQueue.push(data);
-    if (m_sendQueue.size() == 1)
-        doSend();
+    m_maxQueueBytes = maxBytes;
+    m_maxQueueDelayMs = maxDelayMs;
+}
+
+template<Protocol prot>
+void RawTransport<prot>::setTimerInterval(uint32_t intervalMs)
+{
+    m_strand.post(boost::bind(&RawTransport::startTimer, this, intervalMs));
+}
+
+template<Protocol prot>
+void RawTransport<prot>::startTimer(uint32_t intervalMs)
+{
+    if (m_isClosing)
+        return;
+
+    boost::system::error_code ec;
+    if (!m_timer)
+        m_timer.reset(new boost::asio::deadline_timer(m_strand.ioService()));
+    m_timer->cancel(ec);
+
+    m_timerIntervalMs = intervalMs;
+    m_timerGeneration++;
+    if (m_timerIntervalMs) {
+        m_timer->expires_from_now(boost::posix_time::milliseconds(m_timerIntervalMs));
+        m_timer->async_wait(m_strand.wrap(boost::bind(&RawTransport::timerHandler, this, boost::asio::placeholders::error, m_timerGeneration)));
+    }
+}
+
+template<Protocol prot>
+void RawTransport<prot>::timerHandler(const boost::system::error_code& ec, uint32_t generation)
+{
+    if (ec || m_isClosing || generation != m_timerGeneration)
+        return;
+
+    m_listener->onTransportTimer();
+
+    m_timer->expires_from_now(boost::posix_time::milliseconds(m_timerIntervalMs));
+    m_timer->async_wait(m_strand.wrap(boost::bind(&RawTransport::timerHandler, this, boost::asio::placeholders::error, generation)));
+}
+
+template<Protocol prot>
+TransportQueueStats RawTransport<prot>::getSendQueueStats()
+{
+    boost::lock_guard<boost::mutex> lock(m_sendQueueMutex);
+    TransportQueueStats stats = m_queueStats;
+    stats.queuedMessages = m_sendQueue.size();
+    stats.queuedBytes = m_queuedBytes;
+    stats.queuedDelayMs = m_sendQueue.empty() ? 0 : steadyTimeMs() - m_sendQueue.front().enqueuedMs;
+    return stats;
+}
+
+template<Protocol prot>
+void RawTransport<prot>::readBatchHandler(const boost::system::error_code& ec)
+{
+    if (m_isClosing)
+        return;
+
+    if (ec) {
+        ELOG_DEBUG("Error receiving UDP data: %s", ec.message().c_str());
+        // Notify the listener about the socket error if the listener is not closing me.
+        m_listener->onTransportError();
+        return;
+    }
+
+    // Each datagram is followed by the padding, which is not received into.
+    size_t slotSize = m_bufferSize + FRAME_BUFFER_PADDING;
+    uint32_t slots = std::min(std::min(m_batchSize, MAX_UDP_BATCH_SIZE), std::max<uint32_t>(1, UDP_RECEIVE_BUDGET / slotSize));
+    if (!m_receiveBuffer || m_receiveBuffer->capacity() < slots * slotSize)
+        m_receiveBuffer = FrameBuffer::create(slots * slotSize);
+
+    struct mmsghdr msgs[MAX_UDP_BATCH_SIZE];
+    struct iovec iovs[MAX_UDP_BATCH_SIZE];
+    struct sockaddr_storage addrs[MAX_UDP_BATCH_SIZE];
+    memset(msgs, 0, sizeof(struct mmsghdr) * slots);
+    for (uint32_t i = 0; i < slots; ++i) {
+        iovs[i].iov_base = receiveBuffer() + i * slotSize;
+        iovs[i].iov_len = m_bufferSize;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+
+    int received = recvmmsg(m_socket.udp.socket->native_handle(), msgs, slots, MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            ELOG_WARN("recvmmsg error: %s", strerror(errno));
+        receiveData();
+        return;
+    }
+
+    ELOG_TRACE("recvmmsg got %d datagrams", received);
+    for (int i = 0; i < received; ++i) {
+        if (!m_socket.udp.connected && !m_socket.udp.hasPeer && msgs[i].msg_hdr.msg_namelen <= sizeof(addrs[i])) {
+            // Learn where to send the feedback to.
+            memcpy(m_socket.udp.remoteEndpoint.data(), &addrs[i], msgs[i].msg_hdr.msg_namelen);
+            m_socket.udp.remoteEndpoint.resize(msgs[i].msg_hdr.msg_namelen);
+            m_socket.udp.hasPeer = true;
+        }
+
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            ELOG_WARN("Datagram larger than the receive buffer %zu, dropped", m_bufferSize);
+            continue;
+        }
+        onDatagram(receiveBuffer() + i * slotSize, msgs[i].msg_len);
+    }
+
+    // Receive into a fresh buffer if the listener kept a reference to this one.
+    if (m_receiveBuffer->isShared())
+        m_receiveBuffer.reset();
+
+    receiveData();
+}
+
+template<Protocol prot>
+void RawTransport<prot>::onDatagram(char* buf, std::size_t bytes)
+{
+    memset(buf + bytes, 0, FRAME_BUFFER_PADDING);
+
+    if (!m_tag) {
+        m_listener->onTransportBuffer(m_receiveBuffer.get(), buf, bytes);
+        return;
+    }
+
+    uint32_t payloadlen = bytes >= 4 ? ntohl(*(reinterpret_cast<uint32_t*>(buf))) : 0;
+    if (bytes < 4 || bytes != payloadlen + 4) {
+        // Messages larger than a datagram are fragmented by the upper layer, see FrameFragmenter.
+        ELOG_WARN("Packet incomplete. with payloadlen:%u, bytes:%zu", payloadlen, bytes);
+        return;
+    }
+
+    m_listener->onTransportBuffer(m_receiveBuffer.get(), buf + 4, payloadlen);
+}
+
+template<Protocol prot>
+void RawTransport<prot>::doSendBatch()
+{
+    struct mmsghdr msgs[MAX_UDP_BATCH_SIZE];
+    struct iovec iovs[MAX_UDP_BATCH_SIZE * 2];
+    uint32_t count = 0;
+    uint32_t batchSize = std::min(m_batchSize, MAX_UDP_BATCH_SIZE);
+
+    // Only a listening socket needs the destination, a connected one already has it.
+    bool toPeer = !m_socket.udp.connected && m_socket.udp.hasPeer;
+
+    boost::unique_lock<boost::mutex> lock(m_sendQueueMutex);
+    assert(m_sendScheduled && m_sendingCount == 0);
+    if (m_sendQueue.empty()) {
+        m_sendScheduled = false;
+        return;
+    }
+    for (auto it = m_sendQueue.begin(); it != m_sendQueue.end() && count < batchSize; ++it, ++count) {
+        struct iovec* iov = &iovs[count * 2];
+        iov[0].iov_base = it->buffer.get();
+        iov[0].iov_len = it->length;
+        iov[1].iov_base = it->payload.data();
+        iov[1].iov_len = it->payload.length();
+
+        memset(&msgs[count], 0, sizeof(msgs[count]));
+        msgs[count].msg_hdr.msg_iov = iov;
+        msgs[count].msg_hdr.msg_iovlen = it->payload.length() > 0 ? 2 : 1;
+        if (toPeer) {
+            msgs[count].msg_hdr.msg_name = m_socket.udp.remoteEndpoint.data();
+            msgs[count].msg_hdr.msg_namelen = m_socket.udp.remoteEndpoint.size();
+        }
+    }
+    // Keeps them from being dropped while the kernel reads them.
+    m_sendingCount = count;
+    lock.unlock();
+
+    int sent = sendmmsg(m_socket.udp.socket->native_handle(), msgs, count, MSG_DONTWAIT);
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            // Try again once the socket is writable.
+            lock.lock();
+            m_sendingCount = 0;
+            lock.unlock();
+            m_socket.udp.socket->async_send(boost::asio::null_buffers(),
+                m_strand.wrap(boost::bind(&RawTransport::writeHandler, this,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred)));
+            return;
+        }
+        // Drop the datagram which can not be sent at all, e.g. no peer yet.
+        ELOG_WARN("sendmmsg error: %s", strerror(errno));
+        sent = 1;
+    }
+
+    ELOG_TRACE("sendmmsg sent %d/%u datagrams", sent, count);
+    lock.lock();
+    popSent(sent);
+    if (m_sendQueue.size() > 0)
+        m_strand.post(boost::bind(&RawTransport::doSend, this));
+    else
+        m_sendScheduled = false;
+}
+
+template<Protocol prot>
+void RawTransport<prot>::deliverData(char* buf, int len)
+{
+    memset(buf + len, 0, FRAME_BUFFER_PADDING);
+    m_listener->onTransportBuffer(m_receiveBuffer.get(), buf, len);
+    // Receive into a fresh buffer if the listener kept a reference to this one.
+    if (m_receiveBuffer->isShared())
+        m_receiveBuffer.reset();
 }
 
 template<Protocol prot>
 void RawTransport<prot>::receiveData()
 {
-    if (!m_receiveData.buffer)
-        m_receiveData.buffer.reset(new char[m_bufferSize]);
+    if (!m_receiveBuffer)
+        m_receiveBuffer = FrameBuffer::create(m_bufferSize + FRAME_BUFFER_PADDING);
 
     switch (prot) {
     case TCP:
         assert(m_socket.tcp.socket);
         if (m_tag) {
             m_socket.tcp.socket->async_read_some(boost::asio::buffer(m_readHeader, 4),
-                boost::bind(&RawTransport::readHandler, this,
+                m_strand.wrap(boost::bind(&RawTransport::readHandler, this,
                     boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+                    boost::asio::placeholders::bytes_transferred)));
         } else {
-            m_socket.tcp.socket->async_read_some(boost::asio::buffer(m_receiveData.buffer.get(), m_bufferSize),
-                boost::bind(&RawTransport::readHandler, this,
+            m_socket.tcp.socket->async_read_some(boost::asio::buffer(receiveBuffer(), m_bufferSize),
+                m_strand.wrap(boost::bind(&RawTransport::readHandler, this,
                     boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+                    boost::asio::placeholders::bytes_transferred)));
         }
         break;
     case UDP:
         assert(m_socket.udp.socket);
-        if (!m_socket.udp.connected) {
-            m_socket.udp.socket->async_receive(boost::asio::buffer(m_receiveData.buffer.get(), m_bufferSize),
-                boost::bind(&RawTransport::readHandler, this,
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
-        } else {
-            m_socket.udp.socket->async_receive_from(boost::asio::buffer(m_receiveData.buffer.get(), m_bufferSize),
-                m_socket.udp.remoteEndpoint,
-                boost::bind(&RawTransport::readHandler, this,
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
-        }
+        // Wait for the socket to be readable, then drain it with recvmmsg.
+        m_socket.udp.socket->async_receive(boost::asio::null_buffers(),
+            m_strand.wrap(boost::bind(&RawTransport::readBatchHandler, this,
+                boost::asio::placeholders::error)));
         break;
     default:
         break;
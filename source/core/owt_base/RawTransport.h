@@ -10,25 +10,61 @@
 #include <boost/shared_array.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <IOScheduler.h>
+#include <deque>
 #include <logger.h>
-#include <queue>
+#include <vector>
+
+#include "FrameBuffer.h"
+#include "MediaFramePipeline.h"
 
 namespace owt_base {
 
 const char TDT_FEEDBACK_MSG = 0x5A;
 const char TDT_MEDIA_FRAME = 0x8F;
+const char TDT_MEDIA_FRAGMENT = 0x3C;
+const char TDT_FRAGMENT_NACK = 0x4B;
 
 enum Protocol {
     TCP = 0,
     UDP
 };
 
+// What a message handed to sendData() carries. When the send queue
+// overflows the video delta frames are dropped, everything else is kept.
+// A frame sent as several messages has the first one typed as the frame and
+// the next ones as TRANSPORT_CONTINUATION, so that it is dropped as a whole.
+enum TransportDataType {
+    TRANSPORT_DATA = 0,
+    TRANSPORT_VIDEO_KEY_FRAME,
+    TRANSPORT_VIDEO_DELTA_FRAME,
+    TRANSPORT_CONTINUATION
+};
+
+struct TransportQueueStats {
+    uint32_t queuedMessages;
+    uint32_t queuedBytes;
+    uint32_t queuedDelayMs;
+    uint32_t maxQueuedBytes;
+    uint64_t droppedMessages;
+    uint64_t droppedBytes;
+    uint32_t keyFrameRequests;
+};
+
 class RawTransportListener {
 public:
     virtual ~RawTransportListener() { }
     virtual void onTransportData(char*, int len) = 0;
+    // Same as onTransportData(), also passing the refcounted buffer holding
+    // the data which the listener may keep a reference to. The data is
+    // followed by FRAME_BUFFER_PADDING zeroed bytes in the buffer.
+    virtual void onTransportBuffer(FrameBuffer*, char* buf, int len) { onTransportData(buf, len); }
     virtual void onTransportError() = 0;
     virtual void onTransportConnected() = 0;
+    // Video delta frames were dropped from the send queue, a key frame is needed to recover.
+    virtual void onTransportKeyFrameNeeded() { }
+    // Called periodically on the strand delivering the data, see setTimerInterval().
+    virtual void onTransportTimer() { }
 };
 
 class RawTransportInterface {
@@ -39,8 +75,17 @@ public:
     virtual void listenTo(uint32_t minPort, uint32_t maxPort) = 0;
     virtual void sendData(const char*, int len) = 0;
     virtual void sendData(const char* header, int headerLength, const char* payload, int payloadLength) = 0;
+    // Sends header and payload without concatenating them, the payload is referenced until it's written.
+    virtual void sendData(const char* header, int headerLength, const FramePayload& payload, TransportDataType type = TRANSPORT_DATA) = 0;
     virtual void close() = 0;
 
+    // Bounds the send queue by its size and by the age of its oldest message, 0 means unbounded.
+    virtual void setSendQueueLimits(uint32_t maxBytes, uint32_t maxDelayMs) = 0;
+    virtual TransportQueueStats getSendQueueStats() = 0;
+
+    // Calls the listener's onTransportTimer() every intervalMs, 0 stops the timer.
+    virtual void setTimerInterval(uint32_t intervalMs) = 0;
+
     virtual unsigned short getListeningPort() = 0;
 };
 
@@ -56,20 +101,48 @@ public:
     void listenTo(uint32_t minPort, uint32_t maxPort);
     void sendData(const char*, int len);
     void sendData(const char* header, int headerLength, const char* payload, int payloadLength);
+    void sendData(const char* header, int headerLength, const FramePayload& payload, TransportDataType type = TRANSPORT_DATA);
     void close();
 
+    void setSendQueueLimits(uint32_t maxBytes, uint32_t maxDelayMs);
+    TransportQueueStats getSendQueueStats();
+
+    void setTimerInterval(uint32_t intervalMs);
+
     unsigned short getListeningPort();
 
+    // Maximum number of datagrams received or sent per system call in UDP mode.
+    void setBatchSize(uint32_t batchSize) { m_batchSize = batchSize > 0 ? batchSize : 1; }
+
 private:
+    // The length prefix and the header are copied into buffer, the payload if
+    // any is referenced and gathered with them when written.
     typedef struct {
         boost::shared_array<char> buffer;
         int length;
+        FramePayload payload;
+        TransportDataType type;
+        int64_t enqueuedMs;
     } TransportData;
 
     void doSend();
+    void enqueue(const TransportData&);
+    bool isOverflowing(int64_t nowMs);
+    bool dropFrames(int64_t nowMs);
+    size_t dropDeltaFrames(size_t end);
+    void popSent(size_t count);
+    void notifyKeyFrameNeeded();
+    void closeSockets();
+    void startTimer(uint32_t intervalMs);
+    void timerHandler(const boost::system::error_code&, uint32_t generation);
     void receiveData();
+    void deliverData(char* buf, int len);
+    char* receiveBuffer() { return reinterpret_cast<char*>(m_receiveBuffer->data()); }
     void readHandler(const boost::system::error_code&, std::size_t);
     void readPacketHandler(const boost::system::error_code&, std::size_t);
+    void readBatchHandler(const boost::system::error_code&);
+    void onDatagram(char* buf, std::size_t bytes);
+    void doSendBatch();
     void writeHandler(const boost::system::error_code&, std::size_t);
     void connectHandler(const boost::system::error_code&);
     void acceptHandler(const boost::system::error_code&);
@@ -79,32 +152,44 @@ private:
     bool m_tag;
     char m_readHeader[4];
     size_t m_bufferSize;
-    TransportData m_receiveData;
-    std::queue<TransportData> m_sendQueue;
+    boost::intrusive_ptr<FrameBuffer> m_receiveBuffer;
+    std::deque<TransportData> m_sendQueue;
     boost::mutex m_sendQueueMutex;
-
-    // We need to ensure the order of the object destructions. In this case the
-    // io_service object must be destructed after the socket objects, because in
-    // the destructor of the socket objects it will tell the io_service to do
-    // something like closing the descriptor, etc. In other words, the sockets
-    // depend on io_service.
-    // We ensure the order based on the C++ standard that the non-static members
-    // are destructed in the reverse order they were created, so DON'T change
-    // the order of the member declarations here.
-    // Alternatively, we may make the io_service object reference counted but it
-    // introduces unnecessary complexity.
-    boost::asio::io_service m_ioService;
-    boost::thread m_workThread;
+    // Guarded by m_sendQueueMutex.
+    uint32_t m_maxQueueBytes;
+    uint32_t m_maxQueueDelayMs;
+    uint32_t m_queuedBytes;
+    bool m_waitingKeyFrame;
+    // Whether the continuations of the last frame enqueued are to be dropped.
+    bool m_droppingFrame;
+    int64_t m_lastKeyFrameRequestMs;
+    // Set from posting a doSend until the queue is found empty, a write
+    // pending in between, so that a single send is ever in progress.
+    bool m_sendScheduled;
+    TransportQueueStats m_queueStats;
+    // Accessed only on the strand: what the pending write consists of.
+    // m_sendingCount is also read under m_sendQueueMutex, the first
+    // m_sendingCount queued messages are never dropped.
+    std::vector<boost::asio::const_buffer> m_sendBuffers;
+    size_t m_sendingCount;
+    uint32_t m_batchSize;
+
+    // All the socket operations and their completion handlers run on this
+    // strand of the shared IOScheduler. It is declared before the sockets so
+    // that it outlives them.
+    IOStrand m_strand;
     struct Socket {
         Socket() { }
         ~Socket() { }
 
         struct UDPSocket {
-            UDPSocket() : connected(false) { }
+            UDPSocket() : connected(false), hasPeer(false) { }
             ~UDPSocket() { }
 
             boost::scoped_ptr<boost::asio::ip::udp::socket> socket;
             bool connected;
+            // Whether a listening socket has learned its remote endpoint from the received datagrams.
+            bool hasPeer;
             boost::asio::ip::udp::endpoint remoteEndpoint;
         } udp;
         struct TCPSocket {
@@ -115,6 +200,11 @@ private:
             boost::scoped_ptr<boost::asio::ip::tcp::acceptor> acceptor;
         } tcp;
     } m_socket;
+    // Accessed only on the strand.
+    boost::scoped_ptr<boost::asio::deadline_timer> m_timer;
+    uint32_t m_timerIntervalMs;
+    // Of the current series of waits, a restarted timer ignores the former.
+    uint32_t m_timerGeneration;
 
     RawTransportListener* m_listener;
     uint32_t m_receivedBytes;
@@ -0,0 +1,110 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Measure the UDP RawTransport throughput with and without recvmmsg/sendmmsg batching
+//
+// Usage: RawTransportBenchmark [packets] [packetSize]
+//
+// The throughput is reported per CPU second spent by the process, sending
+// and receiving included. The IOScheduler runs on a single thread unless
+// OWT_IO_THREADS says otherwise, so that is the throughput of one core.
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "RawTransport.h"
+
+
+using namespace std;
+
+// Gives up waiting for the packets after this long without any progress.
+static const int64_t STALL_TIMEOUT_MS = 1000;
+
+static double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+class UdpPeer : public owt_base::RawTransportListener {
+public:
+    UdpPeer(uint32_t batchSize, size_t bufferSize) : m_recvCount(0) {
+        m_transport.reset(new owt_base::RawTransport<owt_base::UDP>(this, bufferSize));
+        m_transport->setBatchSize(batchSize);
+    }
+
+    virtual ~UdpPeer() {
+        m_transport->close();
+    }
+
+    void listen() { m_transport->listenTo(0); }
+    void connect(unsigned short port) { m_transport->createConnection("127.0.0.1", port); }
+    unsigned short getPort() { return m_transport->getListeningPort(); }
+
+    void sendData(const char* buf, int len) {
+        m_transport->sendData(buf, len);
+    }
+
+    void onTransportData(char* buf, int len) { m_recvCount++; }
+    void onTransportError() { }
+    void onTransportConnected() { }
+
+    uint32_t getRecvCount() { return m_recvCount; }
+
+private:
+    boost::shared_ptr<owt_base::RawTransport<owt_base::UDP>> m_transport;
+    std::atomic<uint32_t> m_recvCount;
+};
+
+void runCase(uint32_t batchSize, uint32_t packets, uint32_t packetSize) {
+    UdpPeer receiver(batchSize, packetSize + 4), sender(batchSize, packetSize + 4);
+    receiver.listen();
+    sender.connect(receiver.getPort());
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+    std::vector<char> packet(packetSize, 'x');
+    auto start = std::chrono::steady_clock::now();
+    double startCpu = cpuSeconds();
+    for (uint32_t i = 0; i < packets; ++i) {
+        sender.sendData(packet.data(), packet.size());
+        // Keep the socket buffers from overflowing, losses would distort the
+        // result. Sleeping costs no CPU time.
+        if (i % 64 == 63)
+            boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+    }
+
+    // Wait until all the packets are in, or the receiver stops making progress.
+    uint32_t received = receiver.getRecvCount();
+    auto lastProgress = std::chrono::steady_clock::now();
+    while (received < packets
+            && std::chrono::steady_clock::now() - lastProgress < std::chrono::milliseconds(STALL_TIMEOUT_MS)) {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        uint32_t count = receiver.getRecvCount();
+        if (count != received) {
+            received = count;
+            lastProgress = std::chrono::steady_clock::now();
+        }
+    }
+    double cpu = cpuSeconds() - startCpu;
+    double elapsed = std::chrono::duration<double>(lastProgress - start).count();
+
+    cout << "Batch " << batchSize << ": received " << received << "/" << packets
+         << " packets in " << elapsed << "s using " << cpu << " CPU s, "
+         << (uint64_t)(cpu > 0 ? received / cpu : 0) << " packets/s per core" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t packets = argc > 1 ? atoi(argv[1]) : 200000;
+    uint32_t packetSize = argc > 2 ? atoi(argv[2]) : 1200;
+
+    setenv("OWT_IO_THREADS", "1", 0);
+
+    runCase(1, packets, packetSize);
+    runCase(32, packets, packetSize);
+    cout << "finish benchmark" << endl;
+    return 0;
+}
@@ -4,7 +4,7 @@
 
 #include "VCMFrameDecoder.h"
 
-#include <boost/shared_array.hpp>
+#include <boost/bind.hpp>
 
 #include <webrtc/modules/video_coding/codecs/h264/include/h264.h>
 #include <webrtc/modules/video_coding/codecs/vp8/include/vp8.h>
@@ -22,16 +22,20 @@ namespace owt_base {
 
 DEFINE_LOGGER(VCMFrameDecoder, "owt.VCMFrameDecoder");
 
-VCMFrameDecoder::VCMFrameDecoder(FrameFormat format)
+VCMFrameDecoder::VCMFrameDecoder(FrameFormat format, bool asyncDecode)
     : m_needDecode(false)
     , m_needKeyFrame(true)
 {
     memset(&m_codecInfo, 0, sizeof(m_codecInfo));
+    m_decodeStage.reset(new VideoDecodeStage(asyncDecode,
+            boost::bind(&VCMFrameDecoder::decodeFrame, this, _1),
+            boost::bind(&VCMFrameDecoder::requestKeyFrame, this)));
 }
 
 VCMFrameDecoder::~VCMFrameDecoder()
 {
     m_needDecode = false;
+    m_decodeStage.reset();
     if (m_decoder) {
         m_decoder->RegisterDecodeCompleteCallback(nullptr);
         m_decoder->Release();
@@ -103,6 +107,12 @@ int32_t VCMFrameDecoder::Decoded(VideoFrame& decodedImage)
     return 0;
 }
 
+void VCMFrameDecoder::requestKeyFrame()
+{
+    FeedbackMsg msg {.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME};
+    deliverFeedbackMsg(msg);
+}
+
 void VCMFrameDecoder::onFrame(const Frame& frame)
 {
     if (!m_needDecode)
@@ -118,39 +128,46 @@ void VCMFrameDecoder::onFrame(const Frame& frame)
 
     if (frame.payload == 0 || frame.length == 0) {
         ELOG_DEBUG_T("Null frame, request key frame");
-        FeedbackMsg msg {.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME};
-        deliverFeedbackMsg(msg);
+        requestKeyFrame();
         return;
     }
 
+    m_decodeStage->onFrame(frame);
+}
+
+bool VCMFrameDecoder::getStats(VideoDecoderStats& stats)
+{
+    m_decodeStage->getStats(stats);
+    return true;
+}
+
+void VCMFrameDecoder::decodeFrame(const Frame& frame)
+{
     if (m_needKeyFrame) {
         if (frame.additionalInfo.video.isKeyFrame) {
             m_needKeyFrame = false;
         } else {
             ELOG_DEBUG_T("Request key frame");
-            FeedbackMsg msg {.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME};
-            deliverFeedbackMsg(msg);
+            requestKeyFrame();
             return;
         }
     }
 
-    uint8_t *payload    = NULL;
+    uint8_t *payload    = frame.payload;
     size_t length       = frame.length;
     size_t padding      = EncodedImage::GetBufferPaddingBytes(m_codecInfo.codecType);
-    size_t size         = length + padding;
-    boost::shared_array<uint8_t> buffer;
-
-    if (padding > 0) {
-        buffer.reset(new uint8_t[size]);
-        if (buffer.get()) {
-            memcpy(buffer.get(), frame.payload, length);
-            memset(buffer.get() + length, 0, padding);
-        } else {
-            return;
-        }
+    size_t size         = length + frame.padding;
+
+    // The decoder zeros the padding itself, only copy if the producer didn't reserve it.
+    if (frame.padding < padding) {
+        if (m_paddedBuffer.size() < length + padding)
+            m_paddedBuffer.resize(length + padding);
+        memcpy(m_paddedBuffer.data(), frame.payload, length);
+        memset(m_paddedBuffer.data() + length, 0, padding);
+        payload = m_paddedBuffer.data();
+        size = length + padding;
     }
 
-    payload = buffer.get() ? buffer.get() : frame.payload;
     EncodedImage image(payload, length, size);
     image._frameType = frame.additionalInfo.video.isKeyFrame ? kVideoFrameKey : kVideoFrameDelta;
     image._completeFrame = true;
@@ -160,8 +177,7 @@ void VCMFrameDecoder::onFrame(const Frame& frame)
         ELOG_ERROR_T("Decode frame error: %d", ret);
 
         m_needKeyFrame = true;
-        FeedbackMsg msg {.type = VIDEO_FEEDBACK, .cmd = REQUEST_KEY_FRAME};
-        deliverFeedbackMsg(msg);
+        requestKeyFrame();
     }
 }
 
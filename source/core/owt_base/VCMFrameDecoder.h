@@ -6,6 +6,9 @@
 #define VCMFrameDecoder_h
 
 #include "MediaFramePipeline.h"
+#include "VideoDecodeStage.h"
+
+#include <vector>
 
 #include <boost/scoped_ptr.hpp>
 #include <logger.h>
@@ -19,7 +22,7 @@ class VCMFrameDecoder : public VideoFrameDecoder, public webrtc::DecodedImageCal
     DECLARE_LOGGER();
 
 public:
-    VCMFrameDecoder(FrameFormat format);
+    VCMFrameDecoder(FrameFormat format, bool asyncDecode = false);
     ~VCMFrameDecoder();
 
     static bool supportFormat(FrameFormat format) {
@@ -29,15 +32,22 @@ public:
     }
 
     bool init(FrameFormat format);
+    bool getStats(VideoDecoderStats& stats);
 
     void onFrame(const Frame&);
     int32_t Decoded(webrtc::VideoFrame& decodedImage);
 
 private:
+    void decodeFrame(const Frame&);
+    void requestKeyFrame();
+
     bool m_needDecode;
     bool m_needKeyFrame;
     webrtc::CodecSpecificInfo m_codecInfo;
     boost::scoped_ptr<webrtc::VideoDecoder> m_decoder;
+    // The frames without room for the padding are copied in here.
+    std::vector<uint8_t> m_paddedBuffer;
+    boost::scoped_ptr<VideoDecodeStage> m_decodeStage;
 };
 
 } /* namespace owt_base */
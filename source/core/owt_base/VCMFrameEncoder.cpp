@@ -2,6 +2,8 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+
 #include <boost/make_shared.hpp>
 
 #include <webrtc/system_wrappers/include/cpu_info.h>
@@ -21,58 +23,111 @@ namespace owt_base {
 
 DEFINE_LOGGER(VCMFrameEncoder, "owt.VCMFrameEncoder");
 
+VCMFrameEncoder::EncodeLayer::EncodeLayer(VCMFrameEncoder *owner, int32_t id)
+    : owner(owner)
+    , id(id)
+    , width(0)
+    , height(0)
+    , frameRate(0)
+    , bitrateKbps(0)
+    , keyFrameIntervalSeconds(0)
+    , targetKbps(0)
+    , requestKeyFrame(false)
+    , updateBitrateKbps(0)
+    , bsDumpfp(NULL)
+{
+}
+
+VCMFrameEncoder::EncodeLayer::~EncodeLayer()
+{
+    if (encoder) {
+        encoder->Release();
+        encoder.reset();
+    }
+
+    if (bsDumpfp) {
+        fclose(bsDumpfp);
+    }
+}
+
+webrtc::EncodedImageCallback::Result VCMFrameEncoder::EncodeLayer::OnEncodedImage(const EncodedImage& encoded_frame,
+        const CodecSpecificInfo* codec_specific_info,
+        const RTPFragmentationHeader* fragmentation)
+{
+    owner->onEncoded(this, encoded_frame);
+    return webrtc::EncodedImageCallback::Result(webrtc::EncodedImageCallback::Result::OK);
+}
+
+void VCMFrameEncoder::EncodeLayer::dump(uint8_t *buf, int len)
+{
+    if (bsDumpfp) {
+        if (owner->m_encodeFormat == FRAME_FORMAT_VP8 || owner->m_encodeFormat == FRAME_FORMAT_VP9) {
+            unsigned char mem[4];
+
+            mem[0] = (len >>  0) & 0xff;
+            mem[1] = (len >>  8) & 0xff;
+            mem[2] = (len >> 16) & 0xff;
+            mem[3] = (len >> 24) & 0xff;
+
+            fwrite(&mem, 1, 4, bsDumpfp);
+        }
+
+        fwrite(buf, 1, len, bsDumpfp);
+    }
+}
+
 VCMFrameEncoder::VCMFrameEncoder(FrameFormat format, VideoCodecProfile profile, bool useSimulcast)
     : m_streamId(0)
+    , m_layerId(0)
     , m_encodeFormat(format)
     , m_profile(profile)
-    , m_requestKeyFrame(false)
-    , m_updateBitrateKbps(0)
+    , m_useSimulcast(useSimulcast)
+    , m_strand("VCMFrameEncoder", IOScheduler::compute())
+    , m_encodeScheduled(false)
+    , m_encodedFrames(0)
+    , m_skippedFrames(0)
+    , m_queueLatencyMs(0)
+    , m_maxQueueLatencyMs(0)
+    , m_encodeTimeUs(0)
+    , m_maxEncodeTimeUs(0)
     , m_isAdaptiveMode(false)
     , m_width(0)
     , m_height(0)
-    , m_frameRate(0)
-    , m_bitrateKbps(0)
     , m_enableBsDump(false)
-    , m_bsDumpfp(NULL)
 {
     m_bufferManager.reset(new I420BufferManager(3));
     m_converter.reset(new FrameConverter());
-
-    m_srv       = boost::make_shared<boost::asio::io_service>();
-    m_srvWork   = boost::make_shared<boost::asio::io_service::work>(*m_srv);
-    m_thread    = boost::make_shared<boost::thread>(boost::bind(&boost::asio::io_service::run, m_srv));
 }
 
 VCMFrameEncoder::~VCMFrameEncoder()
 {
-    m_srvWork.reset();
-    m_srv->stop();
-    m_thread.reset();
-    m_srv.reset();
+    m_strand.drain();
 
     m_streamId = 0;
 
-    if(m_encoder) {
-        m_encoder->Release();
-        m_encoder.reset();
-    }
-
-    if (m_bsDumpfp) {
-        fclose(m_bsDumpfp);
-    }
+    m_streams.clear();
+    m_layers.clear();
 }
 
 bool VCMFrameEncoder::canSimulcast(FrameFormat format, uint32_t width, uint32_t height)
 {
-#if 0
-    VideoCodec videoCodec;
-    videoCodec = m_vcm->GetSendCodec();
-    return false
-           &&webrtc::VP8EncoderFactoryConfig::use_simulcast_adapter()
-           && m_encodeFormat == format
-           && videoCodec.width * height == videoCodec.height * width;
-#endif
-    return false;
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+
+    if (!m_useSimulcast || m_isAdaptiveMode || m_layers.empty()
+            || format != m_encodeFormat || width == 0 || height == 0)
+        return false;
+
+    // The layers are scaled down from the input, never up.
+    if ((int32_t)width > m_width || (int32_t)height > m_height)
+        return false;
+
+    // Nor cropped, the layers keep the aspect ratio of the input.
+    if ((uint64_t)width * m_height != (uint64_t)height * m_width)
+        return false;
+
+    // Once full, even a stream of a resolution already encoded may ask for
+    // another bitrate than the layer's, it gets an encoder of its own.
+    return m_layers.size() < kMaxSimulcastStreams;
 }
 
 bool VCMFrameEncoder::isIdle()
@@ -81,187 +136,156 @@ bool VCMFrameEncoder::isIdle()
     return m_streams.size() == 0;
 }
 
-int32_t VCMFrameEncoder::generateStream(uint32_t width, uint32_t height, uint32_t frameRate, uint32_t bitrateKbps, uint32_t keyFrameIntervalSeconds, owt_base::FrameDestination* dest)
+bool VCMFrameEncoder::initLayer(EncodeLayer *layer, uint32_t width, uint32_t height, uint32_t frameRate, uint32_t bitrateKbps, uint32_t keyFrameIntervalSeconds)
 {
-    boost::upgrade_lock<boost::shared_mutex> lock(m_mutex);
-    uint32_t targetKbps = bitrateKbps;
-
     VideoCodec codecSettings;
-    uint8_t simulcastId {0};
     int ret;
 
-    assert(frameRate != 0);
-    if (width == 0 || height == 0) {
-        m_isAdaptiveMode = true;
-        width = 3840;
-        height = 2160;
-        targetKbps = calcBitrate(width, height, frameRate);
-    }
-
-#if 0
-    if (m_streams.size() > 0) {
-        videoCodec = m_vcm->GetSendCodec();
-        for (int i = 0; i < videoCodec.numberOfSimulcastStreams; ++i) {
-            if (videoCodec.simulcastStream[i].width == width) {
-                simulcastId = i;
-                boost::shared_ptr<EncodeOut> encodeOut;
-                encodeOut.reset(new EncodeOut(m_streamId, this, dest));
-                OutStream stream = {.width = width, .height = height, .simulcastId = simulcastId, .encodeOut = encodeOut};
-                boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
-                m_streams[m_streamId] = stream;
-                ELOG_DEBUG_T("generateStream: {.width=%d, .height=%d}, simulcastId=%d", width, height, simulcastId);
-                return m_streamId++;
-            }
+    ELOG_DEBUG_T("Create encoder(%s)", getFormatStr(m_encodeFormat));
+    switch (m_encodeFormat) {
+    case FRAME_FORMAT_VP8:
+        if (m_profile != PROFILE_UNKNOWN) {
+            ELOG_WARN_T("Don't support profile setting(%d)", m_profile);
         }
-        if (videoCodec.numberOfSimulcastStreams >= kMaxSimulcastStreams)
-            return -1;
-    } else {
-#endif
-    {
-        ELOG_DEBUG_T("Create encoder(%s)", getFormatStr(m_encodeFormat));
-        switch (m_encodeFormat) {
-        case FRAME_FORMAT_VP8:
-            if (m_profile != PROFILE_UNKNOWN) {
-                ELOG_WARN_T("Don't support profile setting(%d)", m_profile);
-            }
 
-            m_encoder.reset(VP8Encoder::Create());
+        layer->encoder.reset(VP8Encoder::Create());
 
-            VCMCodecDataBase::Codec(kVideoCodecVP8, &codecSettings);
-            codecSettings.VP8()->resilience = kResilienceOff;
-            codecSettings.VP8()->denoisingOn = false;
-            codecSettings.VP8()->automaticResizeOn = false;
-            codecSettings.VP8()->frameDroppingOn = false;
-            codecSettings.VP8()->tl_factory = &tl_factory_;
+        VCMCodecDataBase::Codec(kVideoCodecVP8, &codecSettings);
+        codecSettings.VP8()->resilience = kResilienceOff;
+        codecSettings.VP8()->denoisingOn = false;
+        codecSettings.VP8()->automaticResizeOn = false;
+        codecSettings.VP8()->frameDroppingOn = false;
+        codecSettings.VP8()->tl_factory = &layer->tl_factory_;
 
-            codecSettings.VP8()->keyFrameInterval = frameRate * keyFrameIntervalSeconds;
-            break;
-        case FRAME_FORMAT_VP9:
-            if (m_profile != PROFILE_UNKNOWN) {
-                ELOG_WARN_T("Don't support profile setting(%d)", m_profile);
-            }
+        codecSettings.VP8()->keyFrameInterval = frameRate * keyFrameIntervalSeconds;
+        break;
+    case FRAME_FORMAT_VP9:
+        if (m_profile != PROFILE_UNKNOWN) {
+            ELOG_WARN_T("Don't support profile setting(%d)", m_profile);
+        }
 
-            m_encoder.reset(VP9Encoder::Create());
+        layer->encoder.reset(VP9Encoder::Create());
 
-            VCMCodecDataBase::Codec(kVideoCodecVP9, &codecSettings);
-            codecSettings.VP9()->numberOfTemporalLayers = 1;
-            codecSettings.VP9()->numberOfSpatialLayers = 1;
+        VCMCodecDataBase::Codec(kVideoCodecVP9, &codecSettings);
+        codecSettings.VP9()->numberOfTemporalLayers = 1;
+        codecSettings.VP9()->numberOfSpatialLayers = 1;
 
-            codecSettings.VP9()->keyFrameInterval = frameRate * keyFrameIntervalSeconds;
-            break;
-        case FRAME_FORMAT_H264:
-            if (m_profile != PROFILE_AVC_CONSTRAINED_BASELINE) {
-                ELOG_WARN_T("Only support profile (Constrained Baseline), required (%d)", m_profile);
-            }
+        codecSettings.VP9()->keyFrameInterval = frameRate * keyFrameIntervalSeconds;
+        break;
+    case FRAME_FORMAT_H264:
+        if (m_profile != PROFILE_AVC_CONSTRAINED_BASELINE) {
+            ELOG_WARN_T("Only support profile (Constrained Baseline), required (%d)", m_profile);
+        }
 
-            m_encoder.reset(H264Encoder::Create(cricket::VideoCodec(cricket::kH264CodecName)));
+        layer->encoder.reset(H264Encoder::Create(cricket::VideoCodec(cricket::kH264CodecName)));
 
-            VCMCodecDataBase::Codec(kVideoCodecH264, &codecSettings);
-            codecSettings.H264()->frameDroppingOn = true;
+        VCMCodecDataBase::Codec(kVideoCodecH264, &codecSettings);
+        codecSettings.H264()->frameDroppingOn = true;
 
-            codecSettings.H264()->keyFrameInterval = frameRate * keyFrameIntervalSeconds;
-            break;
-        default:
-            ELOG_ERROR_T("Invalid encoder(%s)", getFormatStr(m_encodeFormat));
-            return -1;
-        }
+        codecSettings.H264()->keyFrameInterval = frameRate * keyFrameIntervalSeconds;
+        break;
+    default:
+        ELOG_ERROR_T("Invalid encoder(%s)", getFormatStr(m_encodeFormat));
+        return false;
     }
 
-    codecSettings.startBitrate  = targetKbps;
-    codecSettings.targetBitrate = targetKbps;
-    codecSettings.maxBitrate    = targetKbps;
+    codecSettings.startBitrate  = bitrateKbps;
+    codecSettings.targetBitrate = bitrateKbps;
+    codecSettings.maxBitrate    = bitrateKbps;
     codecSettings.maxFramerate  = frameRate;
     codecSettings.width         = width;
     codecSettings.height        = height;
 
-    ret = m_encoder->InitEncode(&codecSettings, webrtc::CpuInfo::DetectNumberOfCores(), 0);
+    ret = layer->encoder->InitEncode(&codecSettings, webrtc::CpuInfo::DetectNumberOfCores(), 0);
     if (ret) {
         ELOG_ERROR_T("Video encoder init faild.\n");
-        return -1;
+        return false;
     }
 
-    m_encoder->RegisterEncodeCompleteCallback(this);
+    layer->encoder->RegisterEncodeCompleteCallback(layer);
 
-#if 0
-    for (; simulcastId < videoCodec.numberOfSimulcastStreams; ++simulcastId) {
-        if (videoCodec.simulcastStream[simulcastId].width > width)
-            break;
+    layer->width = width;
+    layer->height = height;
+    layer->frameRate = frameRate;
+    layer->bitrateKbps = bitrateKbps;
+    layer->keyFrameIntervalSeconds = keyFrameIntervalSeconds;
+    layer->targetKbps = bitrateKbps;
+    layer->bufferManager.reset(new I420BufferManager(2));
+
+    if (m_enableBsDump) {
+        char dumpFileName[128];
+
+        snprintf(dumpFileName, 128, "/tmp/vcmFrameEncoder-%p-%d.%s", this, layer->id, getFormatStr(m_encodeFormat));
+        layer->bsDumpfp = fopen(dumpFileName, "wb");
+        if (layer->bsDumpfp) {
+            ELOG_DEBUG("Enable bitstream dump, %s", dumpFileName);
+        } else {
+            ELOG_DEBUG("Can not open dump file, %s", dumpFileName);
+        }
     }
-    if (simulcastId < videoCodec.numberOfSimulcastStreams) {
-        uint8_t j = videoCodec.numberOfSimulcastStreams;
-        while (j > simulcastId) {
-            memcpy(&videoCodec.simulcastStream[j], &videoCodec.simulcastStream[j-1], sizeof(SimulcastStream));
-            --j;
+
+    return true;
+}
+
+int32_t VCMFrameEncoder::generateStream(uint32_t width, uint32_t height, uint32_t frameRate, uint32_t bitrateKbps, uint32_t keyFrameIntervalSeconds, owt_base::FrameDestination* dest)
+{
+    boost::upgrade_lock<boost::shared_mutex> lock(m_mutex);
+    uint32_t targetKbps = bitrateKbps;
+
+    assert(frameRate != 0);
+    if (width == 0 || height == 0) {
+        if (!m_layers.empty()) {
+            ELOG_ERROR_T("Adaptive stream can not share the encoder");
+            return -1;
         }
-    } else {
-        videoCodec.width = width;
-        videoCodec.height = height;
+
+        m_isAdaptiveMode = true;
+        width = 3840;
+        height = 2160;
+        targetKbps = calcBitrate(width, height, frameRate);
     }
 
-    videoCodec.simulcastStream[simulcastId] = SimulcastStream{
-        .width = static_cast<short unsigned>(width),
-        .height = static_cast<short unsigned>(height),
-        .numberOfTemporalLayers = 0,
-        .maxBitrate = targetKbps,
-        .targetBitrate = targetKbps,
-        .minBitrate = targetKbps / 4,
-        .qpMax = videoCodec.qpMax
-    };
-    ++videoCodec.numberOfSimulcastStreams;
-
-    uint32_t newTargetBitrate = videoCodec.simulcastStream[videoCodec.numberOfSimulcastStreams-1].targetBitrate;
-    uint32_t newMaxBitrate = videoCodec.simulcastStream[videoCodec.numberOfSimulcastStreams-1].maxBitrate;
-    uint32_t newMinBitrate = videoCodec.simulcastStream[videoCodec.numberOfSimulcastStreams-1].minBitrate;
-    for (uint8_t i = 0; i < videoCodec.numberOfSimulcastStreams-1; ++i) {
-        newTargetBitrate += videoCodec.simulcastStream[i].targetBitrate;
-        newMaxBitrate += videoCodec.simulcastStream[i].maxBitrate;
-        newMinBitrate += videoCodec.simulcastStream[i].targetBitrate;
+    // The streams of the same settings share the layer, unless its bitrate
+    // was retuned by the feedback of the stream using it.
+    boost::shared_ptr<EncodeLayer> layer;
+    for (auto& it : m_layers) {
+        if (it.second->width == (int32_t)width && it.second->height == (int32_t)height
+                && it.second->frameRate == frameRate
+                && it.second->targetKbps == targetKbps
+                && it.second->keyFrameIntervalSeconds == keyFrameIntervalSeconds) {
+            layer = it.second;
+            break;
+        }
     }
-    videoCodec.startBitrate = newMaxBitrate;
-    videoCodec.targetBitrate = newTargetBitrate;
-    videoCodec.maxBitrate = newMaxBitrate;
-    videoCodec.minBitrate = newMinBitrate;
 
-    int32_t ret = m_vcm->RegisterSendCodec(&videoCodec, 1, 1400);
-    boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
-    if (ret != VCM_OK) {
-        ELOG_ERROR_T("RegisterSendCodec error: %d", ret);
-        ELOG_DEBUG_T("Try fallback to previous video codec");
-        m_vcm->RegisterSendCodec(&fbVideoCodec, 1, 1400);
-        return -1;
-    } else {
-        if (simulcastId != videoCodec.numberOfSimulcastStreams-1) {
-            for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
-                if (it->second.simulcastId >= simulcastId) {
-                    it->second.simulcastId++;
-                }
-            }
+    if (!layer) {
+        if (m_layers.size() >= kMaxSimulcastStreams) {
+            ELOG_ERROR_T("No more simulcast layer for %dx%d", width, height);
+            return -1;
         }
+
+        layer.reset(new EncodeLayer(this, m_layerId));
+        if (!initLayer(layer.get(), width, height, frameRate, targetKbps, keyFrameIntervalSeconds))
+            return -1;
+        m_layerId++;
     }
-#endif
 
     boost::shared_ptr<EncodeOut> encodeOut;
     encodeOut.reset(new EncodeOut(m_streamId, this, dest));
-    OutStream stream = {.width = width, .height = height, .simulcastId = simulcastId, .encodeOut = encodeOut};
+    OutStream stream = {.width = width, .height = height, .simulcastId = layer->id, .encodeOut = encodeOut};
+
+    boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
+    m_layers[layer->id] = layer;
     m_streams[m_streamId] = stream;
     ELOG_DEBUG_T("generateStream: {.width=%d, .height=%d, .frameRate=%d, .bitrateKbps=%d, .keyFrameIntervalSeconds=%d}, simulcastId=%d, adaptiveMode=%d"
-            , width, height, frameRate, bitrateKbps, keyFrameIntervalSeconds, simulcastId, m_isAdaptiveMode);
-
-    m_width = width;
-    m_height = height;
-    m_frameRate = frameRate;
-    m_bitrateKbps = bitrateKbps;
-
-    if (m_enableBsDump) {
-        char dumpFileName[128];
-
-        snprintf(dumpFileName, 128, "/tmp/vcmFrameEncoder-%p-%d.%s", this, simulcastId, getFormatStr(m_encodeFormat));
-        m_bsDumpfp = fopen(dumpFileName, "wb");
-        if (m_bsDumpfp) {
-            ELOG_DEBUG("Enable bitstream dump, %s", dumpFileName);
-        } else {
-            ELOG_DEBUG("Can not open dump file, %s", dumpFileName);
-        }
+            , width, height, frameRate, bitrateKbps, keyFrameIntervalSeconds, layer->id, m_isAdaptiveMode);
+
+    // The input frames are converted to the largest layer, the others are scaled down from it.
+    m_width = 0;
+    m_height = 0;
+    for (auto& it : m_layers) {
+        m_width = std::max(m_width, it.second->width);
+        m_height = std::max(m_height, it.second->height);
     }
 
     return m_streamId++;
@@ -275,8 +299,25 @@ void VCMFrameEncoder::degenerateStream(int32_t streamId)
 
     auto it = m_streams.find(streamId);
     if (it != m_streams.end()) {
+        int32_t simulcastId = it->second.simulcastId;
+
         boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
         m_streams.erase(streamId);
+
+        for (auto& stream : m_streams) {
+            if (stream.second.simulcastId == simulcastId)
+                return;
+        }
+
+        ELOG_DEBUG_T("Release layer(%d)", simulcastId);
+        m_layers.erase(simulcastId);
+
+        m_width = 0;
+        m_height = 0;
+        for (auto& layer : m_layers) {
+            m_width = std::max(m_width, layer.second->width);
+            m_height = std::max(m_height, layer.second->height);
+        }
     }
 }
 
@@ -288,7 +329,19 @@ void VCMFrameEncoder::setBitrate(unsigned short kbps, int32_t streamId)
 
     auto it = m_streams.find(streamId);
     if (it != m_streams.end()) {
-        m_updateBitrateKbps = kbps;
+        // A stream can't throttle the others sharing its layer.
+        for (auto& stream : m_streams) {
+            if (stream.first != streamId && stream.second.simulcastId == it->second.simulcastId) {
+                ELOG_DEBUG_T("Layer(%d) shared, ignore bitrate of stream(%d)", it->second.simulcastId, streamId);
+                return;
+            }
+        }
+
+        auto layer = m_layers.find(it->second.simulcastId);
+        if (layer != m_layers.end()) {
+            layer->second->targetKbps = kbps;
+            layer->second->updateBitrateKbps = kbps;
+        }
     }
 }
 
@@ -300,10 +353,29 @@ void VCMFrameEncoder::requestKeyFrame(int32_t streamId)
 
     auto it = m_streams.find(streamId);
     if (it != m_streams.end()) {
-        m_requestKeyFrame = true;
+        auto layer = m_layers.find(it->second.simulcastId);
+        if (layer != m_layers.end())
+            layer->second->requestKeyFrame = true;
     }
 }
 
+bool VCMFrameEncoder::getStreamStats(int32_t streamId, VideoEncoderStats& stats)
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+
+    if (m_streams.find(streamId) == m_streams.end())
+        return false;
+
+    // All the streams come out of the same encode.
+    stats.encodedFrames = m_encodedFrames;
+    stats.skippedFrames = m_skippedFrames;
+    stats.queueLatencyMs = m_queueLatencyMs;
+    stats.maxQueueLatencyMs = m_maxQueueLatencyMs;
+    stats.encodeTimeUs = m_encodeTimeUs;
+    stats.maxEncodeTimeUs = m_maxEncodeTimeUs;
+    return true;
+}
+
 void VCMFrameEncoder::onFrame(const Frame& frame)
 {
     boost::shared_lock<boost::shared_mutex> lock(m_mutex);
@@ -317,7 +389,48 @@ void VCMFrameEncoder::onFrame(const Frame& frame)
         return;
     }
 
-    m_srv->post(boost::bind(&VCMFrameEncoder::Encode, this, videoFrame));
+    boost::unique_lock<boost::mutex> pendingLock(m_pendingMutex);
+    if (m_pendingFrame) {
+        ELOG_TRACE_T("Skip frame, timestamp %u", m_pendingFrame->timestamp());
+        m_skippedFrames++;
+    }
+    m_pendingFrame = videoFrame;
+    m_pendingSince = std::chrono::steady_clock::now();
+
+    if (!m_encodeScheduled) {
+        m_encodeScheduled = true;
+        m_strand.post(boost::bind(&VCMFrameEncoder::Encode, this));
+    }
+}
+
+void VCMFrameEncoder::encodePending()
+{
+    boost::shared_ptr<webrtc::VideoFrame> videoFrame;
+    std::chrono::steady_clock::time_point since;
+    {
+        boost::unique_lock<boost::mutex> pendingLock(m_pendingMutex);
+        videoFrame.swap(m_pendingFrame);
+        since = m_pendingSince;
+        m_encodeScheduled = false;
+    }
+
+    if (!videoFrame)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t queueLatencyMs = std::chrono::duration_cast<std::chrono::milliseconds>(start - since).count();
+    m_queueLatencyMs = queueLatencyMs;
+    if (queueLatencyMs > m_maxQueueLatencyMs)
+        m_maxQueueLatencyMs = queueLatencyMs;
+
+    // A pending key frame request is served by whichever frame is encoded next.
+    encode(videoFrame);
+
+    uint32_t encodeTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    m_encodeTimeUs = encodeTimeUs;
+    if (encodeTimeUs > m_maxEncodeTimeUs)
+        m_maxEncodeTimeUs = encodeTimeUs;
+    m_encodedFrames++;
 }
 
 boost::shared_ptr<webrtc::VideoFrame> VCMFrameEncoder::frameConvert(const Frame& frame)
@@ -383,50 +496,87 @@ void VCMFrameEncoder::encode(boost::shared_ptr<webrtc::VideoFrame> frame)
         return;
     }
 
-    if (m_width != frame->width() || m_height != frame->height()) {
-        ELOG_DEBUG_T("Update encoder resolution %dx%d->%dx%d", m_width, m_height, frame->width(), frame->height());
+    // Larger layers first, so that each one is scaled from the smallest
+    // frame of the pyramid still covering it.
+    std::vector<EncodeLayer*> layers;
+    for (auto& it : m_layers)
+        layers.push_back(it.second.get());
+    std::sort(layers.begin(), layers.end(), [](EncodeLayer* a, EncodeLayer* b) {
+            return a->width * a->height > b->width * b->height;
+            });
 
-        ret = m_encoder->SetResolution(frame->width(), frame->height());
-        if (ret != 0) {
-            ELOG_WARN_T("Update Encode size error: %d", ret);
+    std::vector<rtc::scoped_refptr<webrtc::VideoFrameBuffer>> pyramid;
+    pyramid.push_back(frame->video_frame_buffer());
+
+    for (auto layer : layers) {
+        if (m_isAdaptiveMode && (layer->width != frame->width() || layer->height != frame->height())) {
+            ELOG_DEBUG_T("Update encoder resolution %dx%d->%dx%d", layer->width, layer->height, frame->width(), frame->height());
+
+            ret = layer->encoder->SetResolution(frame->width(), frame->height());
+            if (ret != 0) {
+                ELOG_WARN_T("Update Encode size error: %d", ret);
+            }
+
+            layer->width = frame->width();
+            layer->height = frame->height();
+            layer->updateBitrateKbps = calcBitrate(layer->width, layer->height, layer->frameRate);
         }
 
-        m_width = frame->width();
-        m_height = frame->height();
-        m_updateBitrateKbps = calcBitrate(m_width, m_height, m_frameRate);
-    }
+        rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer;
+        for (auto it = pyramid.rbegin(); it != pyramid.rend(); ++it) {
+            if ((*it)->width() == layer->width && (*it)->height() == layer->height) {
+                buffer = *it;
+                break;
+            }
+            if ((*it)->width() >= layer->width && (*it)->height() >= layer->height) {
+                rtc::scoped_refptr<webrtc::I420Buffer> scaledBuffer = layer->bufferManager->getFreeBuffer(layer->width, layer->height);
+                if (!scaledBuffer) {
+                    ELOG_ERROR_T("No valid buffer");
+                    break;
+                }
+                if (!m_converter->convert(it->get(), scaledBuffer.get())) {
+                    ELOG_ERROR_T("frameConverter failed");
+                    break;
+                }
+                buffer = scaledBuffer;
+                pyramid.push_back(buffer);
+                break;
+            }
+        }
+        if (!buffer)
+            continue;
 
-    if (m_updateBitrateKbps) {
-        ELOG_DEBUG_T("Update encoder bitrate %d(kbps)->%d(kbps)", m_bitrateKbps, m_updateBitrateKbps.load());
+        if (layer->updateBitrateKbps) {
+            ELOG_DEBUG_T("Update encoder(%d) bitrate %d(kbps)->%d(kbps)", layer->id, layer->bitrateKbps, layer->updateBitrateKbps.load());
 
-        if (m_bitrateKbps != m_updateBitrateKbps) {
-            BitrateAllocation bitrate;
-            bitrate.SetBitrate(0, 0, m_updateBitrateKbps * 1000);
+            if (layer->bitrateKbps != layer->updateBitrateKbps) {
+                BitrateAllocation bitrate;
+                bitrate.SetBitrate(0, 0, layer->updateBitrateKbps * 1000);
 
-            ret = m_encoder->SetRateAllocation(bitrate, m_frameRate);
-            if (ret != 0) {
-                ELOG_WARN_T("Update Encode bitrate error: %d", ret);
+                ret = layer->encoder->SetRateAllocation(bitrate, layer->frameRate);
+                if (ret != 0) {
+                    ELOG_WARN_T("Update Encode bitrate error: %d", ret);
+                }
+                layer->bitrateKbps = layer->updateBitrateKbps;
             }
-            m_bitrateKbps = m_updateBitrateKbps;
+            layer->updateBitrateKbps = 0;
         }
-        m_updateBitrateKbps = 0;
-    }
 
-    std::vector<FrameType> types;
-    if (m_requestKeyFrame) {
-        types.push_back(kVideoFrameKey);
-        m_requestKeyFrame = false;
-    }
+        std::vector<FrameType> types;
+        if (layer->requestKeyFrame) {
+            types.push_back(kVideoFrameKey);
+            layer->requestKeyFrame = false;
+        }
 
-    ret = m_encoder->Encode(*frame.get(), NULL, types.size() ? &types : NULL);
-    if (ret != 0) {
-        ELOG_ERROR_T("Encode frame error: %d", ret);
+        webrtc::VideoFrame layerFrame(buffer, frame->timestamp(), 0, webrtc::kVideoRotation_0);
+        ret = layer->encoder->Encode(layerFrame, NULL, types.size() ? &types : NULL);
+        if (ret != 0) {
+            ELOG_ERROR_T("Encode frame error: %d", ret);
+        }
     }
 }
 
-webrtc::EncodedImageCallback::Result VCMFrameEncoder::OnEncodedImage(const EncodedImage& encoded_frame,
-        const CodecSpecificInfo* codec_specific_info,
-        const RTPFragmentationHeader* fragmentation)
+void VCMFrameEncoder::onEncoded(EncodeLayer *layer, const EncodedImage& encoded_frame)
 {
     boost::shared_lock<boost::shared_mutex> lock(m_mutex);
 
@@ -441,7 +591,8 @@ webrtc::EncodedImageCallback::Result VCMFrameEncoder::OnEncodedImage(const Encod
         frame.additionalInfo.video.height = encoded_frame._encodedHeight;
         frame.additionalInfo.video.isKeyFrame = (encoded_frame._frameType == kVideoFrameKey);
 
-        ELOG_TRACE_T("SendData, %s, %dx%d, %s, length(%d), timestamp %d",
+        ELOG_TRACE_T("SendData(%d), %s, %dx%d, %s, length(%d), timestamp %d",
+                layer->id,
                 getFormatStr(frame.format),
                 frame.additionalInfo.video.width,
                 frame.additionalInfo.video.height,
@@ -450,34 +601,14 @@ webrtc::EncodedImageCallback::Result VCMFrameEncoder::OnEncodedImage(const Encod
                 frame.timeStamp / 90
                 );
 
-        dump(frame.payload, frame.length);
+        layer->dump(frame.payload, frame.length);
 
         auto it = m_streams.begin();
         for (; it != m_streams.end(); ++it) {
-            if (it->second.encodeOut.get() && it->second.simulcastId == 0)
+            if (it->second.encodeOut.get() && it->second.simulcastId == layer->id)
                 it->second.encodeOut->onEncoded(frame);
         }
     }
-
-    return webrtc::EncodedImageCallback::Result(webrtc::EncodedImageCallback::Result::OK);
-}
-
-void VCMFrameEncoder::dump(uint8_t *buf, int len)
-{
-    if (m_bsDumpfp) {
-        if (m_encodeFormat == FRAME_FORMAT_VP8 || m_encodeFormat == FRAME_FORMAT_VP9) {
-            unsigned char mem[4];
-
-            mem[0] = (len >>  0) & 0xff;
-            mem[1] = (len >>  8) & 0xff;
-            mem[2] = (len >> 16) & 0xff;
-            mem[3] = (len >> 24) & 0xff;
-
-            fwrite(&mem, 1, 4, m_bsDumpfp);
-        }
-
-        fwrite(buf, 1, len, m_bsDumpfp);
-    }
 }
 
 } // namespace owt_base
@@ -7,6 +7,7 @@
 
 #include <map>
 #include <atomic>
+#include <chrono>
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
@@ -20,6 +21,7 @@
 #include <webrtc/modules/video_coding/codecs/i420/include/i420.h>
 
 #include "logger.h"
+#include "IOScheduler.h"
 #include "I420BufferManager.h"
 #include "MediaFramePipeline.h"
 #include "FrameConverter.h"
@@ -60,8 +62,12 @@ private:
 
 /**
  * This is the class to accept the raw frame and encode it to the given format.
+ * Streams of different resolutions share the encoder if simulcast is enabled,
+ * each resolution is encoded by its own codec instance out of one downscale
+ * pyramid of the input frame. Streams only share a codec instance if they
+ * ask for the same resolution, frame rate, bitrate and key frame interval.
  */
-class VCMFrameEncoder : public VideoFrameEncoder, public webrtc::EncodedImageCallback {
+class VCMFrameEncoder : public VideoFrameEncoder {
     DECLARE_LOGGER();
 
 public:
@@ -76,11 +82,6 @@ public:
 
     FrameFormat getInputFormat() {return FRAME_FORMAT_I420;}
 
-    // Implements DecodedImageCallback.
-    webrtc::EncodedImageCallback::Result OnEncodedImage(const EncodedImage& encoded_frame,
-            const CodecSpecificInfo* codec_specific_info,
-            const RTPFragmentationHeader* fragmentation) override;
-
     // Implements VideoFrameEncoder.
     void onFrame(const Frame&);
     bool canSimulcast(FrameFormat format, uint32_t width, uint32_t height);
@@ -89,16 +90,49 @@ public:
     void degenerateStream(int32_t streamId);
     void setBitrate(unsigned short kbps, int32_t streamId);
     void requestKeyFrame(int32_t streamId);
+    bool getStreamStats(int32_t streamId, VideoEncoderStats& stats);
 
 protected:
-    static void Encode(VCMFrameEncoder *This, boost::shared_ptr<webrtc::VideoFrame> videoFrame) {This->encode(videoFrame);};
+    static void Encode(VCMFrameEncoder *This) {This->encodePending();};
+    void encodePending();
     void encode(boost::shared_ptr<webrtc::VideoFrame> videoFrame);
 
     boost::shared_ptr<webrtc::VideoFrame> frameConvert(const Frame& frame);
 
-    void dump(uint8_t *buf, int len);
-
 private:
+    // The codec instance encoding one resolution.
+    struct EncodeLayer : public webrtc::EncodedImageCallback {
+        EncodeLayer(VCMFrameEncoder *owner, int32_t id);
+        ~EncodeLayer();
+
+        // Implements EncodedImageCallback.
+        webrtc::EncodedImageCallback::Result OnEncodedImage(const EncodedImage& encoded_frame,
+                const CodecSpecificInfo* codec_specific_info,
+                const RTPFragmentationHeader* fragmentation) override;
+
+        void dump(uint8_t *buf, int len);
+
+        VCMFrameEncoder *owner;
+        int32_t id;
+        int32_t width;
+        int32_t height;
+        uint32_t frameRate;
+        uint32_t bitrateKbps;
+        uint32_t keyFrameIntervalSeconds;
+        // Asked for by the streams, or by the feedback of its only stream.
+        std::atomic<uint32_t> targetKbps;
+
+        boost::scoped_ptr<webrtc::VideoEncoder> encoder;
+        webrtc::TemporalLayersFactory tl_factory_;
+        // The scaled input of the layer, unused by the largest one.
+        boost::scoped_ptr<I420BufferManager> bufferManager;
+
+        std::atomic<bool> requestKeyFrame;
+        std::atomic<uint32_t> updateBitrateKbps;
+
+        FILE *bsDumpfp;
+    };
+
     struct OutStream {
         uint32_t width;
         uint32_t height;
@@ -106,35 +140,46 @@ private:
         boost::shared_ptr<EncodeOut> encodeOut;
     };
 
+    bool initLayer(EncodeLayer *layer, uint32_t width, uint32_t height, uint32_t frameRate, uint32_t bitrateKbps, uint32_t keyFrameIntervalSeconds);
+    void onEncoded(EncodeLayer *layer, const EncodedImage& encoded_frame);
+
     int32_t m_streamId;
     std::map<int32_t/*streamId*/, OutStream> m_streams;
+    int32_t m_layerId;
+    std::map<int32_t/*simulcastId*/, boost::shared_ptr<EncodeLayer>> m_layers;
 
     FrameFormat m_encodeFormat;
     VideoCodecProfile m_profile;
-    boost::scoped_ptr<webrtc::VideoEncoder> m_encoder;
-    webrtc::TemporalLayersFactory tl_factory_;
+    bool m_useSimulcast;
 
     boost::scoped_ptr<I420BufferManager> m_bufferManager;
 
     boost::shared_mutex m_mutex;
 
-    boost::shared_ptr<boost::asio::io_service> m_srv;
-    boost::shared_ptr<boost::asio::io_service::work> m_srvWork;
-    boost::shared_ptr<boost::thread> m_thread;
+    IOStrand m_strand;
+
+    // Latest frame wins, a frame still waiting when a newer one comes in is
+    // skipped, so the encoder never falls behind the compositor.
+    boost::mutex m_pendingMutex;
+    boost::shared_ptr<webrtc::VideoFrame> m_pendingFrame;
+    std::chrono::steady_clock::time_point m_pendingSince;
+    bool m_encodeScheduled;
 
-    std::atomic<bool> m_requestKeyFrame;
-    std::atomic<uint32_t> m_updateBitrateKbps;
+    std::atomic<uint32_t> m_encodedFrames;
+    std::atomic<uint32_t> m_skippedFrames;
+    std::atomic<uint32_t> m_queueLatencyMs;
+    std::atomic<uint32_t> m_maxQueueLatencyMs;
+    std::atomic<uint32_t> m_encodeTimeUs;
+    std::atomic<uint32_t> m_maxEncodeTimeUs;
 
     bool m_isAdaptiveMode;
+    // The size of the input frames, the one of the largest layer
     int32_t m_width;
     int32_t m_height;
-    uint32_t m_frameRate;
-    uint32_t m_bitrateKbps;
 
     boost::scoped_ptr<FrameConverter> m_converter;
 
     bool m_enableBsDump;
-    FILE *m_bsDumpfp;
 };
 
 } /* namespace owt_base */
@@ -0,0 +1,188 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "VideoDecodeStage.h"
+
+#include <chrono>
+#include <stdint.h>
+
+#include <boost/bind.hpp>
+
+namespace owt_base {
+
+// About a quarter of a second at 30fps, more than that the decoder won't catch up.
+static const uint32_t MAX_QUEUED_FRAMES = 8;
+// Decoded in a row before the other jobs of the compute threads get a turn.
+static const uint32_t MAX_DECODES_PER_TASK = 2;
+// While waiting for a key frame, in case the request or the key frame is lost.
+static const int64_t KEY_FRAME_REQUEST_INTERVAL_MS = 1000;
+static const int64_t STATS_INTERVAL_MS = 10000;
+static const int64_t kHistogramBoundsMs[] = {2, 5, 10, 20, 40, 80, INT64_MAX};
+
+static int64_t steadyTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DEFINE_LOGGER(VideoDecodeStage, "owt.VideoDecodeStage");
+
+VideoDecodeStage::VideoDecodeStage(bool async, DecodeFunc decode, RequestKeyFrameFunc requestKeyFrame)
+    : m_async(async)
+    , m_decode(decode)
+    , m_requestKeyFrame(requestKeyFrame)
+    , m_decodeScheduled(false)
+    , m_waitKeyFrame(false)
+    , m_keyFrameRequestMs(0)
+    , m_droppedFrames(0)
+    , m_statsLogMs(0)
+    , m_strand("VideoDecodeStage", IOScheduler::compute())
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+VideoDecodeStage::~VideoDecodeStage()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_queueMutex);
+        m_queue.clear();
+    }
+    m_strand.drain();
+}
+
+void VideoDecodeStage::onFrame(const Frame& frame)
+{
+    if (!m_async) {
+        decode(frame);
+        return;
+    }
+
+    bool requestKeyFrame = false;
+    {
+        boost::unique_lock<boost::mutex> lock(m_queueMutex);
+        bool isKeyFrame = frame.additionalInfo.video.isKeyFrame;
+
+        if (m_waitKeyFrame && !isKeyFrame) {
+            m_droppedFrames++;
+            int64_t nowMs = steadyTimeUs() / 1000;
+            if (nowMs - m_keyFrameRequestMs < KEY_FRAME_REQUEST_INTERVAL_MS)
+                return;
+            m_keyFrameRequestMs = nowMs;
+            lock.unlock();
+
+            ELOG_DEBUG_T("Still waiting for a key frame, request it again");
+            if (m_requestKeyFrame)
+                m_requestKeyFrame();
+            return;
+        }
+
+        if (m_queue.size() >= MAX_QUEUED_FRAMES) {
+            // The queued frames are useless if a key frame comes in, and the
+            // ones coming after can't be decoded without them otherwise.
+            ELOG_DEBUG_T("Decoder falls behind, drop %zu queued frames", m_queue.size());
+            m_droppedFrames += m_queue.size();
+            m_queue.clear();
+
+            if (!isKeyFrame) {
+                m_droppedFrames++;
+                m_waitKeyFrame = true;
+                m_keyFrameRequestMs = steadyTimeUs() / 1000;
+                requestKeyFrame = true;
+            }
+        }
+
+        if (!requestKeyFrame) {
+            if (isKeyFrame)
+                m_waitKeyFrame = false;
+
+            QueuedFrame queued = {frame, FramePayload(frame)};
+            queued.frame.payload = queued.payload.data();
+            queued.frame.buffer = queued.payload.buffer();
+            queued.frame.padding = queued.payload.padding();
+            m_queue.push_back(queued);
+
+            if (!m_decodeScheduled) {
+                m_decodeScheduled = true;
+                m_strand.post(boost::bind(&VideoDecodeStage::DecodeQueued, this));
+            }
+        }
+    }
+
+    if (requestKeyFrame && m_requestKeyFrame)
+        m_requestKeyFrame();
+}
+
+void VideoDecodeStage::decodeQueued()
+{
+    for (uint32_t i = 0; i < MAX_DECODES_PER_TASK; i++) {
+        QueuedFrame queued;
+        {
+            boost::unique_lock<boost::mutex> lock(m_queueMutex);
+            if (m_queue.empty()) {
+                m_decodeScheduled = false;
+                return;
+            }
+            queued = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        decode(queued.frame);
+    }
+
+    // Back to the end of the compute queue rather than straight onto the
+    // strand, which would run it within the same batch.
+    m_strand.ioService().post(m_strand.wrap(boost::bind(&VideoDecodeStage::DecodeQueued, this)));
+}
+
+void VideoDecodeStage::decode(const Frame& frame)
+{
+    int64_t start = steadyTimeUs();
+    m_decode(frame);
+    updateStats(steadyTimeUs() - start);
+}
+
+void VideoDecodeStage::getStats(VideoDecoderStats& stats)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_statsMutex);
+        stats = m_stats;
+    }
+    boost::unique_lock<boost::mutex> lock(m_queueMutex);
+    stats.droppedFrames = m_droppedFrames;
+}
+
+void VideoDecodeStage::updateStats(int64_t decodeTimeUs)
+{
+    int64_t nowMs = steadyTimeUs() / 1000;
+
+    ELOG_TRACE_T("Decode time %ldus", decodeTimeUs);
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_statsMutex);
+        for (uint32_t i = 0; i < VideoDecoderStats::kHistogramBuckets; i++) {
+            if (decodeTimeUs < kHistogramBoundsMs[i] * 1000) {
+                m_stats.decodeTimeHistogram[i]++;
+                break;
+            }
+        }
+        m_stats.decodedFrames++;
+        m_stats.decodeTimeUs = decodeTimeUs;
+        if (m_stats.decodeTimeUs > m_stats.maxDecodeTimeUs)
+            m_stats.maxDecodeTimeUs = m_stats.decodeTimeUs;
+    }
+
+    if (m_statsLogMs == 0) {
+        m_statsLogMs = nowMs;
+    } else if (nowMs - m_statsLogMs >= STATS_INTERVAL_MS) {
+        VideoDecoderStats stats;
+        getStats(stats);
+
+        ELOG_DEBUG_T("Decode time of %u frames, <2ms:%u <5ms:%u <10ms:%u <20ms:%u <40ms:%u <80ms:%u >=80ms:%u, max %uus, dropped %u",
+                stats.decodedFrames, stats.decodeTimeHistogram[0], stats.decodeTimeHistogram[1], stats.decodeTimeHistogram[2],
+                stats.decodeTimeHistogram[3], stats.decodeTimeHistogram[4], stats.decodeTimeHistogram[5],
+                stats.decodeTimeHistogram[6], stats.maxDecodeTimeUs, stats.droppedFrames);
+        m_statsLogMs = nowMs;
+    }
+}
+
+} /* namespace owt_base */
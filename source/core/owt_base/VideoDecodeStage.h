@@ -0,0 +1,77 @@
+// Copyright (C) <2019> Intel Corporation
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef VideoDecodeStage_h
+#define VideoDecodeStage_h
+
+#include <deque>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <logger.h>
+
+#include "IOScheduler.h"
+#include "MediaFramePipeline.h"
+
+namespace owt_base {
+
+/**
+ * The decode step of a video decoder. In async mode the compressed frames are
+ * queued and decoded on a strand of IOScheduler::compute(), so that the thread
+ * delivering them, e.g. the io thread of a transport, is never held up by a slow
+ * decode, nor are the other transports sharing the IO pool. If the decoder
+ * falls behind, the queue is flushed and the frames up to the next key frame
+ * are dropped, the key frame being requested again every second until it
+ * comes. The queued frames are decoded a few at a time, for a busy decoder not
+ * to hold a compute thread. Otherwise the frames are decoded right away.
+ * Either way the decode times are collected into a histogram, available through
+ * getStats() and logged periodically.
+ */
+class VideoDecodeStage {
+    DECLARE_LOGGER();
+
+    struct QueuedFrame {
+        Frame frame;
+        FramePayload payload;
+    };
+
+public:
+    typedef boost::function<void(const Frame&)> DecodeFunc;
+    typedef boost::function<void()> RequestKeyFrameFunc;
+
+    VideoDecodeStage(bool async, DecodeFunc decode, RequestKeyFrameFunc requestKeyFrame);
+    ~VideoDecodeStage();
+
+    void onFrame(const Frame& frame);
+    void getStats(VideoDecoderStats& stats);
+
+private:
+    static void DecodeQueued(VideoDecodeStage *This) { This->decodeQueued(); }
+    void decodeQueued();
+    void decode(const Frame& frame);
+    void updateStats(int64_t decodeTimeUs);
+
+    bool m_async;
+    DecodeFunc m_decode;
+    RequestKeyFrameFunc m_requestKeyFrame;
+
+    boost::mutex m_queueMutex;
+    std::deque<QueuedFrame> m_queue;
+    bool m_decodeScheduled;
+    bool m_waitKeyFrame;
+    int64_t m_keyFrameRequestMs;
+    uint32_t m_droppedFrames;
+
+    // m_stats.droppedFrames is not kept up to date, m_droppedFrames is
+    boost::mutex m_statsMutex;
+    VideoDecoderStats m_stats;
+    int64_t m_statsLogMs;
+
+    IOStrand m_strand;
+};
+
+} /* namespace owt_base */
+
+#endif /* VideoDecodeStage_h */
@@ -312,6 +312,8 @@ int32_t VideoFrameConstructor::Decode(const webrtc::EncodedImage& encodedImage,
         frame.format = format;
         frame.payload = encodedImage._buffer;
         frame.length = encodedImage._length;
+        // The jitter buffer reserves the decoder padding in the frame buffer.
+        frame.padding = encodedImage._size - encodedImage._length;
         frame.timeStamp = encodedImage._timeStamp;
         frame.additionalInfo.video.width = m_width;
         frame.additionalInfo.video.height = m_height;
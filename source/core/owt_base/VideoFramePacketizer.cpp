@@ -4,6 +4,7 @@
 
 #include "VideoFramePacketizer.h"
 #include "MediaUtilities.h"
+#include "NaluScanner.h"
 #include <rtputils.h>
 
 namespace owt_base {
@@ -164,88 +165,106 @@ void VideoFramePacketizer::OnNetworkChanged(const uint32_t target_bitrate, const
 }
 
 
-static int getNextNaluPosition(uint8_t *buffer, int buffer_size, bool &is_aud_or_sei) {
-    if (buffer_size < 4) {
-        return -1;
+#define MAX_NALS_PER_SCAN 64
+
+// An H.264/H.265 frame as handed to the RTP module, without the NALs the
+// clients can't handle and with the NALs located. The packetizers all get
+// the same frame from the thread delivering it, the first one prepares it
+// and the others find it in the cache of the thread. The frames are told
+// apart by their buffer, which the cache holds so that it is not reused for
+// another frame meanwhile, the frames without one are not cached.
+struct PreparedFrame {
+    boost::intrusive_ptr<FrameBuffer> buffer;
+    const uint8_t* source;
+    uint32_t sourceLength;
+    uint32_t timeStamp;
+    FrameFormat format;
+
+    boost::intrusive_ptr<FrameBuffer> filtered;
+    uint8_t* payload;
+    int length;
+    webrtc::RTPFragmentationHeader fragInfo;
+};
+
+static thread_local boost::shared_ptr<PreparedFrame> preparedFrameCache;
+
+static boost::shared_ptr<PreparedFrame> prepareFrame(const Frame& frame)
+{
+    boost::shared_ptr<PreparedFrame> prepared = preparedFrameCache;
+    if (prepared
+            && frame.buffer
+            && prepared->buffer.get() == frame.buffer
+            && prepared->source == frame.payload
+            && prepared->sourceLength == frame.length
+            && prepared->timeStamp == frame.timeStamp
+            && prepared->format == frame.format) {
+        return prepared;
     }
-    is_aud_or_sei = false;
-    uint8_t *head = buffer;
-    uint8_t *end = buffer + buffer_size - 4;
-    while (head < end) {
-        if (head[0]) {
-            head++;
-            continue;
-        }
-        if (head[1]) {
-            head +=2;
-            continue;
-        }
-        if (head[2]) {
-            head +=3;
-            continue;
-        }
-        if (head[3] != 0x01) {
-            head++;
-            continue;
-        }
-        if (((head[4] & 0x1F) == 9) || ((head[4] & 0x1F) == 6)) {
-            is_aud_or_sei = true;
+
+    prepared.reset(new PreparedFrame());
+    prepared->buffer = frame.buffer;
+    prepared->source = frame.payload;
+    prepared->sourceLength = frame.length;
+    prepared->timeStamp = frame.timeStamp;
+    prepared->format = frame.format;
+    prepared->payload = frame.payload;
+    prepared->length = frame.length;
+
+    //FIXME: temporarily filter out AUD because chrome M59 could NOT handle it correctly.
+    //FIXME: temporarily filter out SEI because safari could NOT handle it correctly.
+    bool dropAUDandSEI = (frame.format == FRAME_FORMAT_H264);
+    webrtc::RTPFragmentationHeader& frag_info = prepared->fragInfo;
+    NaluPosition nalus[MAX_NALS_PER_SCAN];
+    int firstNaluOffset = -1;
+    int scanned = 0;
+    int count;
+
+    do {
+        count = scanNalus(frame.payload + scanned, frame.length - scanned, nalus, MAX_NALS_PER_SCAN);
+        for (int i = 0; i < count; i++) {
+            int offset = scanned + nalus[i].offset;
+            int payloadOffset = scanned + nalus[i].payloadOffset;
+            int end = payloadOffset + nalus[i].length;
+            if (firstNaluOffset < 0)
+                firstNaluOffset = offset;
+
+            uint8_t type = h264NaluType(nalus[i]);
+            if (dropAUDandSEI && (type == 9 || type == 6)) {
+                if (!prepared->filtered) {
+                    // The payload is shared with the other destinations of the frame, leave it
+                    // untouched. The NALs kept so far are the ones before this one.
+                    prepared->filtered = FrameBuffer::create(frame.length);
+                    prepared->payload = prepared->filtered->data();
+                    prepared->length = offset - firstNaluOffset;
+                    memcpy(prepared->payload, frame.payload + firstNaluOffset, prepared->length);
+                    for (uint16_t j = 0; j < frag_info.fragmentationVectorSize; j++)
+                        frag_info.fragmentationOffset[j] -= firstNaluOffset;
+                }
+                continue;
+            }
+
+            if (prepared->filtered) {
+                memcpy(prepared->payload + prepared->length, frame.payload + offset, end - offset);
+                payloadOffset = prepared->length + (payloadOffset - offset);
+                prepared->length += end - offset;
+            }
+
+            /* SPS, PPS, I, P*/
+            uint16_t last = frag_info.fragmentationVectorSize;
+            frag_info.VerifyAndAllocateFragmentationHeader(last + 1);
+            frag_info.fragmentationOffset[last] = payloadOffset;
+            frag_info.fragmentationLength[last] = nalus[i].length;
         }
 
-        return static_cast<int>(head - buffer);
-    }
-    return -1;
-}
+        if (count > 0)
+            scanned += nalus[count - 1].payloadOffset + nalus[count - 1].length;
+    } while (count == MAX_NALS_PER_SCAN);
 
-#define MAX_NALS_PER_FRAME 128
-static int dropAUDandSEI(uint8_t* framePayload, int frameLength) {
-    uint8_t *origin_pkt_data = framePayload;
-    int origin_pkt_length = frameLength;
-    uint8_t *head = origin_pkt_data;
-
-    std::vector<int> nal_offset;
-    std::vector<bool> nal_type_is_aud_or_sei;
-    std::vector<int> nal_size;
-    bool is_aud_or_sei = false, has_aud_or_sei = false;
-
-    int sc_positions_length = 0;
-    int sc_position = 0;
-    while (sc_positions_length < MAX_NALS_PER_FRAME) {
-         int nalu_position = getNextNaluPosition(origin_pkt_data + sc_position,
-              origin_pkt_length - sc_position, is_aud_or_sei);
-         if (nalu_position < 0) {
-             break;
-         }
-         sc_position += nalu_position;
-         nal_offset.push_back(sc_position); //include start code.
-         sc_position += 4;
-         sc_positions_length++;
-         if (is_aud_or_sei) {
-             has_aud_or_sei = true;
-             nal_type_is_aud_or_sei.push_back(true);
-         } else {
-             nal_type_is_aud_or_sei.push_back(false);
-         }
-    }
-    if (sc_positions_length == 0 || !has_aud_or_sei)
-        return frameLength;
-    // Calculate size of each NALs
-    for (unsigned int count = 0; count < nal_offset.size(); count++) {
-       if (count + 1 == nal_offset.size()) {
-           nal_size.push_back(origin_pkt_length - nal_offset[count]);
-       } else {
-           nal_size.push_back(nal_offset[count+1] - nal_offset[count]);
-       }
-    }
-    // remove in place the AUD NALs
-    int new_size = 0;
-    for (unsigned int i = 0; i < nal_offset.size(); i++) {
-       if (!nal_type_is_aud_or_sei[i]) {
-           memmove(head + new_size, head + nal_offset[i], nal_size[i]);
-           new_size += nal_size[i];
-       }
-    }
-    return new_size;
+    if (frame.buffer)
+        preparedFrameCache = prepared;
+    else
+        preparedFrameCache.reset();
+    return prepared;
 }
 
 static void dump(void* index, FrameFormat format, uint8_t* buf, int len)
@@ -325,48 +344,18 @@ void VideoFramePacketizer::onFrame(const Frame& frame)
         boost::shared_lock<boost::shared_mutex> lock(m_rtpRtcpMutex);
         m_rtpRtcp->SendOutgoingData(webrtc::kVideoFrameKey, VP9_90000_PT, timeStamp, timeStamp / 90, frame.payload, frame.length, nullptr, &h, &transport_frame_id_out);
     } else if (frame.format == FRAME_FORMAT_H264 || frame.format == FRAME_FORMAT_H265) {
-        int frame_length = frame.length;
         if (m_enableDump) {
-            dump(this, frame.format, frame.payload, frame_length);
+            dump(this, frame.format, frame.payload, frame.length);
         }
 
-        //FIXME: temporarily filter out AUD because chrome M59 could NOT handle it correctly.
-        //FIXME: temporarily filter out SEI because safari could NOT handle it correctly.
-        if (frame.format == FRAME_FORMAT_H264) {
-            frame_length = dropAUDandSEI(frame.payload, frame_length);
-        }
-
-        int nalu_found_length = 0;
-        uint8_t* buffer_start = frame.payload;
-        int buffer_length = frame_length;
-        int nalu_start_offset = 0;
-        int nalu_end_offset = 0;
-        int sc_len = 0;
-        RTPFragmentationHeader frag_info;
-
+        boost::shared_ptr<PreparedFrame> prepared = prepareFrame(frame);
 
         h.codec = (frame.format == FRAME_FORMAT_H264)?(webrtc::kRtpVideoH264):(webrtc::kRtpVideoH265);
-        while (buffer_length > 0) {
-            nalu_found_length = findNALU(buffer_start, buffer_length, &nalu_start_offset, &nalu_end_offset, &sc_len);
-            if (nalu_found_length < 0) {
-                /* Error, should never happen */
-                break;
-            } else {
-                /* SPS, PPS, I, P*/
-                uint16_t last = frag_info.fragmentationVectorSize;
-                frag_info.VerifyAndAllocateFragmentationHeader(last + 1);
-                frag_info.fragmentationOffset[last] = nalu_start_offset + (buffer_start - frame.payload);
-                frag_info.fragmentationLength[last] = nalu_found_length;
-                buffer_start += (nalu_start_offset + nalu_found_length);
-                buffer_length -= (nalu_start_offset + nalu_found_length);
-            }
-        }
-
         boost::shared_lock<boost::shared_mutex> lock(m_rtpRtcpMutex);
         if (frame.format == FRAME_FORMAT_H264) {
-          m_rtpRtcp->SendOutgoingData(webrtc::kVideoFrameKey, H264_90000_PT, timeStamp, timeStamp / 90, frame.payload, frame_length, &frag_info, &h, &transport_frame_id_out);
+          m_rtpRtcp->SendOutgoingData(webrtc::kVideoFrameKey, H264_90000_PT, timeStamp, timeStamp / 90, prepared->payload, prepared->length, &prepared->fragInfo, &h, &transport_frame_id_out);
         } else {
-          m_rtpRtcp->SendOutgoingData(webrtc::kVideoFrameKey, H265_90000_PT, timeStamp, timeStamp / 90, frame.payload, frame_length, &frag_info, &h, &transport_frame_id_out);
+          m_rtpRtcp->SendOutgoingData(webrtc::kVideoFrameKey, H265_90000_PT, timeStamp, timeStamp / 90, prepared->payload, prepared->length, &prepared->fragInfo, &h, &transport_frame_id_out);
         }
     }
 }
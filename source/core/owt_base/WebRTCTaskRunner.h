@@ -5,14 +5,198 @@
 #ifndef WebRTCTaskRunner_h
 #define WebRTCTaskRunner_h
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <stdlib.h>
+
+#include <boost/thread.hpp>
+
 #include <webrtc/base/location.h>
+#include <webrtc/base/timeutils.h>
+#include <webrtc/modules/include/module.h>
 #include <webrtc/modules/utility/include/process_thread.h>
 
 namespace owt_base {
 
+struct WebRTCProcessThreadStats {
+    uint32_t modules;
+    // How late the thread got to a module due, a busy thread lags behind.
+    uint32_t lastDelayMs;
+    uint32_t maxDelayMs;
+};
+
+/**
+ * A small pool of webrtc ProcessThreads shared by all the RTP/RTCP modules of
+ * the process, which mostly sleep between their timers and don't need a
+ * thread each. The pool size defaults to half the cores, from 2 to 8, and
+ * can be overridden with the OWT_PROCESS_THREADS environment variable.
+ */
+class WebRTCProcessThreadPool {
+    static const int64_t kProbeIntervalMs = 100;
+
+    // Scheduled on each thread to measure how late it runs the modules.
+    class Probe : public webrtc::Module {
+    public:
+        Probe()
+            : m_nextProcessMs(rtc::TimeMillis() + kProbeIntervalMs)
+            , m_lastDelayMs(0)
+            , m_maxDelayMs(0)
+        {
+        }
+
+        int64_t TimeUntilNextProcess() override
+        {
+            return std::max<int64_t>(0, m_nextProcessMs - rtc::TimeMillis());
+        }
+
+        void Process() override
+        {
+            int64_t nowMs = rtc::TimeMillis();
+            uint32_t delayMs = std::max<int64_t>(0, nowMs - m_nextProcessMs);
+            m_lastDelayMs = delayMs;
+            if (delayMs > m_maxDelayMs)
+                m_maxDelayMs = delayMs;
+            m_nextProcessMs = nowMs + kProbeIntervalMs;
+        }
+
+        int64_t m_nextProcessMs;
+        std::atomic<uint32_t> m_lastDelayMs;
+        std::atomic<uint32_t> m_maxDelayMs;
+    };
+
+    struct Shard {
+        std::unique_ptr<webrtc::ProcessThread> thread;
+        Probe probe;
+        std::atomic<uint32_t> modules;
+        // The task runners bound to the thread, to spread the new ones.
+        uint32_t runners;
+    };
+
+public:
+    static WebRTCProcessThreadPool& instance();
+
+    // The thread a new task runner should put its modules on.
+    webrtc::ProcessThread* acquire();
+    void release(webrtc::ProcessThread*);
+
+    void registerModule(webrtc::ProcessThread*, webrtc::Module*);
+    void deRegisterModule(webrtc::ProcessThread*, webrtc::Module*);
+
+    // Resets the max delays.
+    std::vector<WebRTCProcessThreadStats> getStats();
+
+private:
+    WebRTCProcessThreadPool();
+    ~WebRTCProcessThreadPool();
+
+    Shard* find(webrtc::ProcessThread*);
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    boost::mutex m_mutex;
+};
+
+inline WebRTCProcessThreadPool& WebRTCProcessThreadPool::instance()
+{
+    static WebRTCProcessThreadPool pool;
+    return pool;
+}
+
+inline WebRTCProcessThreadPool::WebRTCProcessThreadPool()
+{
+    const char* env = getenv("OWT_PROCESS_THREADS");
+    uint32_t threads = env ? atoi(env) : 0;
+    if (threads == 0)
+        threads = std::min(8u, std::max(2u, boost::thread::hardware_concurrency() / 2));
+
+    for (uint32_t i = 0; i < threads; ++i) {
+        std::unique_ptr<Shard> shard(new Shard);
+        shard->thread = webrtc::ProcessThread::Create("WebRTCProcessThread");
+        shard->modules = 0;
+        shard->runners = 0;
+        shard->thread->RegisterModule(&shard->probe, RTC_FROM_HERE);
+        shard->thread->Start();
+        m_shards.push_back(std::move(shard));
+    }
+}
+
+inline WebRTCProcessThreadPool::~WebRTCProcessThreadPool()
+{
+    for (auto& shard : m_shards) {
+        shard->thread->DeRegisterModule(&shard->probe);
+        shard->thread->Stop();
+    }
+}
+
+inline webrtc::ProcessThread* WebRTCProcessThreadPool::acquire()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    Shard* least = m_shards.front().get();
+    for (auto& shard : m_shards) {
+        if (shard->modules + shard->runners < least->modules + least->runners)
+            least = shard.get();
+    }
+    least->runners++;
+    return least->thread.get();
+}
+
+inline void WebRTCProcessThreadPool::release(webrtc::ProcessThread* thread)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    Shard* shard = find(thread);
+    if (shard)
+        shard->runners--;
+}
+
+inline void WebRTCProcessThreadPool::registerModule(webrtc::ProcessThread* thread, webrtc::Module* module)
+{
+    Shard* shard = find(thread);
+    if (shard) {
+        shard->thread->RegisterModule(module, RTC_FROM_HERE);
+        shard->modules++;
+    }
+}
+
+inline void WebRTCProcessThreadPool::deRegisterModule(webrtc::ProcessThread* thread, webrtc::Module* module)
+{
+    // Returns once the module is not being processed anymore.
+    Shard* shard = find(thread);
+    if (shard) {
+        shard->thread->DeRegisterModule(module);
+        shard->modules--;
+    }
+}
+
+inline std::vector<WebRTCProcessThreadStats> WebRTCProcessThreadPool::getStats()
+{
+    std::vector<WebRTCProcessThreadStats> stats;
+    for (auto& shard : m_shards) {
+        WebRTCProcessThreadStats shardStats;
+        shardStats.modules = shard->modules;
+        shardStats.lastDelayMs = shard->probe.m_lastDelayMs;
+        shardStats.maxDelayMs = shard->probe.m_maxDelayMs.exchange(0);
+        stats.push_back(shardStats);
+    }
+    return stats;
+}
+
+inline WebRTCProcessThreadPool::Shard* WebRTCProcessThreadPool::find(webrtc::ProcessThread* thread)
+{
+    // The shards are never removed, no need to lock.
+    for (auto& shard : m_shards) {
+        if (shard->thread.get() == thread)
+            return shard.get();
+    }
+    return nullptr;
+}
+
 /**
- * This thread is now responsible for running the non critical process for each modules.
- * It's now simply a wrapper of the webrtc ProcessThread, and we need it because it's shared
+ * This is now responsible for running the non critical process for each modules.
+ * It's a handle onto one thread of the WebRTCProcessThreadPool, all the modules of
+ * a task runner are processed on the same thread. We need it because it's shared
  * by different objects and we want to manage its lifetime automatically.
  */
 class WebRTCTaskRunner {
@@ -28,41 +212,53 @@ public:
     webrtc::ProcessThread* unwrap();
 
 private:
-    std::unique_ptr<webrtc::ProcessThread> m_processThread;
+    webrtc::ProcessThread* m_processThread;
+    std::set<webrtc::Module*> m_modules;
+    boost::mutex m_mutex;
 };
 
 inline WebRTCTaskRunner::WebRTCTaskRunner(const char* task_name)
-    : m_processThread(webrtc::ProcessThread::Create(task_name))
+    : m_processThread(WebRTCProcessThreadPool::instance().acquire())
 {
 }
 
 inline WebRTCTaskRunner::~WebRTCTaskRunner()
 {
+    Stop();
+    WebRTCProcessThreadPool::instance().release(m_processThread);
 }
 
 inline void WebRTCTaskRunner::Start()
 {
-    m_processThread->Start();
+    // The threads of the pool are always running.
 }
 
 inline void WebRTCTaskRunner::Stop()
 {
-    m_processThread->Stop();
+    // The thread is shared, only stop processing the modules of this runner.
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (auto module : m_modules)
+        WebRTCProcessThreadPool::instance().deRegisterModule(m_processThread, module);
+    m_modules.clear();
 }
 
 inline void WebRTCTaskRunner::RegisterModule(webrtc::Module* module)
 {
-    m_processThread->RegisterModule(module, RTC_FROM_HERE);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_modules.insert(module).second)
+        WebRTCProcessThreadPool::instance().registerModule(m_processThread, module);
 }
 
 inline void WebRTCTaskRunner::DeRegisterModule(webrtc::Module* module)
 {
-    m_processThread->DeRegisterModule(module);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_modules.erase(module))
+        WebRTCProcessThreadPool::instance().deRegisterModule(m_processThread, module);
 }
 
 inline webrtc::ProcessThread* WebRTCTaskRunner::unwrap()
 {
-    return m_processThread.get();
+    return m_processThread;
 }
 
 } /* namespace owt_base */